@@ -0,0 +1,900 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+// offsets handed to one crib-dragging task
+#define   CRIB_TASK_OFFSETS   (64 * 1024)
+
+// the English scoring model is defined over a 26-letter alphabet
+#define   ALPHABET_SIZE       26
+
+// ciphertext letters trial-decrypted for every candidate key (four vectors)
+#define   BRUTE_FORCE_PREFIX  64
+
+// the most candidates a brute force search keeps
+#define   BRUTE_FORCE_MAX_TOP 256
+
+// letters examined by the plaintext filter
+#define   FILTER_WINDOW       64
+
+// bits in the Bloom filter of common words (512 bytes, so it stays in L1)
+#define   BLOOM_BITS          4096
+
+// strips out-of-range characters, leaving the offset of each in-range character from
+// `range_low`; returns the number of in-range characters
+static size_t compact_letters(char range_low, char range_high, const char *text, size_t len,
+                              unsigned char *letters)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        letters[n] = (unsigned char)(c - range_low);
+        n += (range_low <= c && c <= range_high);
+    }
+    return n;
+}
+
+struct crib_job {
+    const unsigned char *letters;
+    size_t n_offsets;           // number of letter positions the crib can start at
+    const unsigned char *crib;  // crib characters as offsets from range_low
+    size_t crib_len;
+    size_t max_period;
+    int range_size;
+    char range_low;
+    // per-task results, merged in offset order once all tasks are done; a task keeps its
+    // first `capacity` matches, which are all the merge can use, and only counts the rest
+    size_t capacity;
+    struct crib_match **found;
+    size_t *n_found;
+    size_t *cap_found;
+    atomic_bool failed;
+};
+
+// records a match of the crib at letter position `pos` with key period `period`
+// (the caller later converts `offset` from a letter position to a byte offset)
+static bool crib_record(struct crib_job *job, size_t task, size_t pos, size_t period,
+                        const unsigned char *fragment)
+{
+    if (job->n_found[task] >= job->capacity) {
+        job->n_found[task]++;
+        return true;
+    }
+    if (job->n_found[task] == job->cap_found[task]) {
+        size_t cap = job->cap_found[task] ? 2 * job->cap_found[task] : 16;
+        cap = cap < job->capacity ? cap : job->capacity;
+        struct crib_match *grown = mem_realloc(job->found[task], cap * sizeof(*grown));
+        if (grown == NULL) {
+            return false;
+        }
+        job->found[task] = grown;
+        job->cap_found[task] = cap;
+    }
+
+    struct crib_match *m = &job->found[task][job->n_found[task]++];
+    m->offset = pos;
+    m->period = period;
+    // the letter at position pos + j was encrypted with key character (pos + j) % period
+    for (size_t j = 0; j < period; j++) {
+        m->key[(pos + j) % period] = (char)(job->range_low + fragment[j]);
+    }
+    m->key[period] = '\0';
+    return true;
+}
+
+// the smallest period of the key fragment implied by the crib at `pos`, or 0
+static size_t crib_period_scalar(const struct crib_job *job, size_t pos, unsigned char *fragment)
+{
+    for (size_t j = 0; j < job->crib_len; j++) {
+        int d = job->letters[pos + j] - job->crib[j];
+        fragment[j] = (unsigned char)(d < 0 ? d + job->range_size : d);
+    }
+    for (size_t period = 1; period <= job->max_period; period++) {
+        size_t j = 0;
+        while (j + period < job->crib_len && fragment[j] == fragment[j + period]) {
+            j++;
+        }
+        if (j + period == job->crib_len) {
+            return period;
+        }
+    }
+    return 0;
+}
+
+static void crib_task(void *arg, size_t task)
+{
+    struct crib_job *job = arg;
+    size_t pos = task * CRIB_TASK_OFFSETS;
+    size_t end = pos + CRIB_TASK_OFFSETS < job->n_offsets ? pos + CRIB_TASK_OFFSETS : job->n_offsets;
+    unsigned char fragment[CRIB_MAX_LENGTH];
+
+#ifdef SAFECIPHER_X86
+    // sixteen starting positions at once: lane i of diff[j] holds the key character
+    // implied by crib[j] at position pos + i
+    __m128i diff[CRIB_MAX_LENGTH];
+    __m128i size = _mm_set1_epi8((char)(unsigned char)job->range_size);
+
+    for (; pos + 16 <= end; pos += 16) {
+        for (size_t j = 0; j < job->crib_len; j++) {
+            __m128i c = _mm_loadu_si128((const __m128i *)(const void *)(job->letters + pos + j));
+            __m128i k = _mm_set1_epi8((char)job->crib[j]);
+            __m128i no_borrow = _mm_cmpeq_epi8(_mm_max_epu8(c, k), c);
+            diff[j] = _mm_add_epi8(_mm_sub_epi8(c, k), _mm_andnot_si128(no_borrow, size));
+        }
+
+        unsigned found = 0;
+        size_t period_of[16] = {0};
+        for (size_t period = 1; period <= job->max_period && found != 0xFFFF; period++) {
+            __m128i eq = _mm_cmpeq_epi8(diff[0], diff[0]);
+            for (size_t j = 0; j + period < job->crib_len; j++) {
+                eq = _mm_and_si128(eq, _mm_cmpeq_epi8(diff[j], diff[j + period]));
+            }
+            unsigned fresh = (unsigned)_mm_movemask_epi8(eq) & ~found;
+            for (unsigned lane = 0; lane < 16; lane++) {
+                if (fresh & (1u << lane)) {
+                    period_of[lane] = period;
+                }
+            }
+            found |= fresh;
+        }
+
+        for (unsigned lane = 0; found != 0 && lane < 16; lane++) {
+            if (period_of[lane] != 0) {
+                unsigned char lanes[16];
+                for (size_t j = 0; j < period_of[lane]; j++) {
+                    _mm_storeu_si128((__m128i *)(void *)lanes, diff[j]);
+                    fragment[j] = lanes[lane];
+                }
+                if (!crib_record(job, task, pos + lane, period_of[lane], fragment)) {
+                    job->failed = true;
+                    return;
+                }
+            }
+        }
+    }
+#endif
+    for (; pos < end; pos++) {
+        size_t period = crib_period_scalar(job, pos, fragment);
+        if (period != 0 && !crib_record(job, task, pos, period, fragment)) {
+            job->failed = true;
+            return;
+        }
+    }
+}
+
+// crib dragging over a vigenere ciphertext
+size_t vigenere_crib_drag(char range_low, char range_high, const char *crib,
+                          const char *cipher_text, size_t max_period,
+                          struct crib_match *matches, size_t capacity)
+{
+    size_t crib_len = strlen(crib);
+    size_t len = strlen(cipher_text);
+    unsigned char crib_letters[CRIB_MAX_LENGTH];
+
+    if (crib_len < 2 || crib_len > CRIB_MAX_LENGTH
+        || compact_letters(range_low, range_high, crib, crib_len, crib_letters) != crib_len) {
+        return SIZE_MAX;
+    }
+    // a period needs at least as many comparisons as it has characters to be convincing
+    if (max_period == 0 || max_period > crib_len / 2) {
+        max_period = crib_len / 2;
+    }
+
+    unsigned char *letters = mem_malloc(len + 1);
+    if (letters == NULL) {
+        return SIZE_MAX;
+    }
+    size_t n_letters = compact_letters(range_low, range_high, cipher_text, len, letters);
+    if (n_letters < crib_len) {
+        free(letters);
+        return 0;
+    }
+
+    struct crib_job job = {
+        .letters = letters,
+        .n_offsets = n_letters - crib_len + 1,
+        .crib = crib_letters,
+        .crib_len = crib_len,
+        .max_period = max_period,
+        .range_size = range_high - range_low + 1,
+        .range_low = range_low,
+        .capacity = capacity,
+    };
+    size_t tasks = (job.n_offsets + CRIB_TASK_OFFSETS - 1) / CRIB_TASK_OFFSETS;
+    job.found = mem_calloc(tasks, sizeof(*job.found));
+    job.n_found = mem_calloc(tasks, sizeof(*job.n_found));
+    job.cap_found = mem_calloc(tasks, sizeof(*job.cap_found));
+    size_t total = SIZE_MAX;
+
+    if (job.found != NULL && job.n_found != NULL && job.cap_found != NULL) {
+        parallel_run(tasks, crib_task, &job);
+    } else {
+        job.failed = true;
+    }
+
+    if (!job.failed) {
+        // merge in offset order, mapping letter positions back to byte offsets
+        size_t pos = 0;
+        size_t byte = 0;
+        total = 0;
+        for (size_t t = 0; t < tasks; t++) {
+            size_t i = 0;
+            for (; i < job.n_found[t] && total < capacity; i++, total++) {
+                struct crib_match *m = &job.found[t][i];
+                for (;; byte++) {
+                    char c = cipher_text[byte];
+                    if (range_low <= c && c <= range_high) {
+                        if (pos == m->offset) {
+                            break;
+                        }
+                        pos++;
+                    }
+                }
+                matches[total] = *m;
+                matches[total].offset = byte;
+            }
+            total += job.n_found[t] - i;
+        }
+    }
+
+    for (size_t t = 0; job.found != NULL && t < tasks; t++) {
+        free(job.found[t]);
+    }
+    free(job.found);
+    free(job.n_found);
+    free(job.cap_found);
+    free(letters);
+    return total;
+}
+
+/* English plaintext scoring. Letter frequencies and the most common bigrams are from
+ * Norvig's survey of the Google Books corpus; the remaining bigrams are estimated
+ * from the letter frequencies. */
+
+static const double letter_frequency[ALPHABET_SIZE] = {
+    8.167, 1.492, 2.782, 4.253, 12.702, 2.228, 2.015, 6.094, 6.966, 0.153, 0.772, 4.025, 2.406,
+    6.749, 7.507, 1.929, 0.095, 5.987, 6.327, 9.056, 2.758, 0.978, 2.360, 0.150, 1.974, 0.074,
+};
+
+static const struct {
+    char pair[3];
+    double frequency;
+} common_bigrams[] = {
+    {"TH", 3.56}, {"HE", 3.07}, {"IN", 2.43}, {"ER", 2.05}, {"AN", 1.99}, {"RE", 1.85},
+    {"ON", 1.76}, {"AT", 1.49}, {"EN", 1.45}, {"ND", 1.35}, {"TI", 1.34}, {"ES", 1.34},
+    {"OR", 1.28}, {"TE", 1.20}, {"OF", 1.17}, {"ED", 1.17}, {"IS", 1.13}, {"IT", 1.12},
+    {"AL", 1.09}, {"AR", 1.07}, {"ST", 1.05}, {"TO", 1.04}, {"NT", 1.04}, {"NG", 0.95},
+    {"SE", 0.93}, {"HA", 0.93}, {"AS", 0.87}, {"OU", 0.87}, {"IO", 0.83}, {"LE", 0.83},
+    {"VE", 0.83}, {"CO", 0.79}, {"ME", 0.79}, {"DE", 0.76}, {"HI", 0.76}, {"RI", 0.73},
+    {"RO", 0.73}, {"IC", 0.70}, {"NE", 0.69}, {"EA", 0.69}, {"RA", 0.69}, {"CE", 0.65},
+    {"LI", 0.62}, {"CH", 0.60}, {"LL", 0.58}, {"BE", 0.58}, {"MA", 0.57}, {"SI", 0.55},
+    {"OM", 0.55}, {"UR", 0.54},
+};
+
+struct english_model {
+    // per-letter weights summed sixteen at a time by the fast score (padded for loads)
+    unsigned char monogram[32];
+    // per-letter weight expected from English text and from uniformly random text
+    double monogram_english;
+    double monogram_random;
+    // log-likelihood of each bigram, scaled by 16
+    int bigram[ALPHABET_SIZE * ALPHABET_SIZE];
+    // bit b of rare[a] is set if the bigram ab (almost) never occurs in English, even
+    // across a word boundary; rare_bytes[k] holds byte k of each row for pshufb lookups
+    uint32_t rare[ALPHABET_SIZE];
+    unsigned char rare_bytes[4][32];
+    // common words of three to five letters
+    uint64_t bloom[BLOOM_BITS / 64];
+};
+
+static struct english_model english;
+static pthread_once_t english_once = PTHREAD_ONCE_INIT;
+
+static const char *const common_words[] = {
+    "THE", "AND", "FOR", "ARE", "BUT", "NOT", "YOU", "ALL", "ANY", "CAN", "HAD", "HER",
+    "WAS", "ONE", "OUR", "OUT", "DAY", "GET", "HAS", "HIM", "HIS", "HOW", "MAN", "NEW",
+    "NOW", "OLD", "SEE", "TWO", "WAY", "WHO", "DID", "ITS", "LET", "PUT", "SAY", "SHE",
+    "TOO", "USE", "THAT", "WITH", "HAVE", "THIS", "WILL", "YOUR", "FROM", "THEY", "KNOW",
+    "WANT", "BEEN", "GOOD", "MUCH", "SOME", "TIME", "VERY", "WHEN", "COME", "HERE", "JUST",
+    "LIKE", "LONG", "MAKE", "MANY", "MORE", "ONLY", "OVER", "SUCH", "TAKE", "THAN", "THEM",
+    "WELL", "WERE", "WHAT", "INTO", "UPON", "SAID", "EACH", "WHICH", "THEIR", "THERE",
+    "WOULD", "ABOUT", "COULD", "OTHER", "THESE", "FIRST", "AFTER", "WHERE", "THOSE",
+    "BEING", "EVERY", "UNDER", "NEVER", "GREAT", "SHALL",
+};
+
+// the three bit positions of a word (given as the number `h` formed by its letters in
+// base 26, and its length) in the Bloom filter
+static void bloom_bits(uint32_t h, size_t len, uint32_t bits[3])
+{
+    uint32_t key = h * 8 + (uint32_t)len;
+    bits[0] = (key * 0x9E3779B1u) >> 20;
+    bits[1] = (key * 0x85EBCA77u) >> 20;
+    bits[2] = (key * 0xC2B2AE3Du) >> 20;
+}
+
+static bool is_vowel(size_t letter)
+{
+    return letter == 'A' - 'A' || letter == 'E' - 'A' || letter == 'I' - 'A'
+           || letter == 'O' - 'A' || letter == 'U' - 'A' || letter == 'Y' - 'A';
+}
+
+static void filter_init(struct english_model *model)
+{
+    for (size_t a = 0; a < ALPHABET_SIZE; a++) {
+        for (size_t b = 0; b < ALPHABET_SIZE; b++) {
+            // Q is followed by U; J, V and Z by a vowel (words rarely end in them, so
+            // this holds across word boundaries too); and no consonant precedes an X
+            bool rare = (a == 'Q' - 'A' && b != 'U' - 'A')
+                        || ((a == 'J' - 'A' || a == 'V' - 'A' || a == 'Z' - 'A')
+                            && !is_vowel(b) && b != a)
+                        || (b == 'X' - 'A' && !is_vowel(a) && a != 'N' - 'A');
+            if (rare) {
+                model->rare[a] |= UINT32_C(1) << b;
+            }
+        }
+        for (size_t k = 0; k < 4; k++) {
+            model->rare_bytes[k][a] = (unsigned char)(model->rare[a] >> (8 * k));
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(common_words) / sizeof(common_words[0]); i++) {
+        uint32_t h = 0;
+        uint32_t place = 1;
+        size_t len = strlen(common_words[i]);
+        for (size_t j = 0; j < len; j++, place *= ALPHABET_SIZE) {
+            h += (uint32_t)(common_words[i][j] - 'A') * place;
+        }
+        uint32_t bits[3];
+        bloom_bits(h, len, bits);
+        for (size_t j = 0; j < 3; j++) {
+            model->bloom[bits[j] / 64] |= UINT64_C(1) << (bits[j] % 64);
+        }
+    }
+}
+
+static void english_init(void)
+{
+    double listed = 0.0;
+    double unlisted_weight = 0.0;
+    double bigram[ALPHABET_SIZE * ALPHABET_SIZE] = {0};
+    size_t n_common = sizeof(common_bigrams) / sizeof(common_bigrams[0]);
+
+    for (size_t a = 0; a < ALPHABET_SIZE; a++) {
+        double w = 64.0 + 6.0 * log2(letter_frequency[a] / 100.0);
+        english.monogram[a] = (unsigned char)(w < 1.0 ? 1.0 : w + 0.5);
+        english.monogram_english += letter_frequency[a] / 100.0 * english.monogram[a];
+        english.monogram_random += english.monogram[a] / (double)ALPHABET_SIZE;
+    }
+
+    for (size_t i = 0; i < n_common; i++) {
+        size_t a = (size_t)(common_bigrams[i].pair[0] - 'A');
+        size_t b = (size_t)(common_bigrams[i].pair[1] - 'A');
+        bigram[a * ALPHABET_SIZE + b] = common_bigrams[i].frequency;
+        listed += common_bigrams[i].frequency;
+    }
+    for (size_t i = 0; i < ALPHABET_SIZE * ALPHABET_SIZE; i++) {
+        if (bigram[i] == 0.0) {
+            unlisted_weight += letter_frequency[i / ALPHABET_SIZE] * letter_frequency[i % ALPHABET_SIZE];
+        }
+    }
+    // share the remaining probability among the other bigrams by letter frequency
+    for (size_t i = 0; i < ALPHABET_SIZE * ALPHABET_SIZE; i++) {
+        double p = bigram[i];
+        if (p == 0.0) {
+            p = (100.0 - listed) * letter_frequency[i / ALPHABET_SIZE]
+                * letter_frequency[i % ALPHABET_SIZE] / unlisted_weight;
+        }
+        english.bigram[i] = (int)lround(16.0 * log2(p / 100.0));
+    }
+
+    filter_init(&english);
+}
+
+static const struct english_model *english_model(void)
+{
+    pthread_once(&english_once, english_init);
+    return &english;
+}
+
+// log-likelihood of `n` letters (as offsets from 'A') being English, scaled by 16
+static int bigram_score(const struct english_model *model, const unsigned char *letters, size_t n)
+{
+    int score = 0;
+    for (size_t i = 1; i < n; i++) {
+        score += model->bigram[letters[i - 1] * ALPHABET_SIZE + letters[i]];
+    }
+    return score;
+}
+
+/* The plaintext filter: a cheap first stage that rejects nearly all wrong trial
+ * decryptions before the bigram scorer runs. Text passes if it has few bigrams that
+ * English never produces and contains some common words. */
+
+// the number of rare bigrams among `letters[0..n)`
+static unsigned rare_bigrams_scalar(const struct english_model *model,
+                                    const unsigned char *letters, size_t n)
+{
+    unsigned count = 0;
+    for (size_t i = 1; i < n; i++) {
+        count += (model->rare[letters[i - 1]] >> letters[i]) & 1;
+    }
+    return count;
+}
+
+#ifdef SAFECIPHER_X86
+
+// looks up a 26-entry byte table for sixteen letters at once
+__attribute__((target("ssse3")))
+static inline __m128i lookup26(const unsigned char *table, __m128i idx)
+{
+    __m128i low = _mm_loadu_si128((const __m128i *)(const void *)table);
+    __m128i high = _mm_loadu_si128((const __m128i *)(const void *)(table + 16));
+    __m128i is_high = _mm_cmpgt_epi8(idx, _mm_set1_epi8(15));
+    // letters below 16 index the high table negatively, which pshufb maps to zero
+    return _mm_or_si128(_mm_andnot_si128(is_high, _mm_shuffle_epi8(low, idx)),
+                        _mm_shuffle_epi8(high, _mm_sub_epi8(idx, _mm_set1_epi8(16))));
+}
+
+// rare_bigrams_scalar for sixteen bigrams per iteration: the byte of the first letter's
+// row that holds the second letter's bit is looked up, then tested against that bit
+// (`letters` must be readable up to FILTER_WINDOW + 16 bytes)
+__attribute__((target("ssse3")))
+static unsigned rare_bigrams_ssse3(const struct english_model *model,
+                                   const unsigned char *letters, size_t n)
+{
+    const __m128i bit_table = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)0x80,
+                                            1, 2, 4, 8, 16, 32, 64, (char)0x80);
+    const __m128i lane = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    unsigned count = 0;
+
+    for (size_t i = 0; i + 1 < n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(const void *)(letters + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(const void *)(letters + i + 1));
+        __m128i which = _mm_and_si128(_mm_srli_epi16(b, 3), _mm_set1_epi8(3));
+        __m128i row = _mm_setzero_si128();
+        for (int k = 0; k < 4; k++) {
+            __m128i byte = lookup26(model->rare_bytes[k], a);
+            row = _mm_or_si128(row, _mm_and_si128(_mm_cmpeq_epi8(which, _mm_set1_epi8((char)k)), byte));
+        }
+        __m128i bit = _mm_shuffle_epi8(bit_table, _mm_and_si128(b, _mm_set1_epi8(7)));
+        __m128i rare = _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+        // only bigrams that end within the text count
+        __m128i valid = _mm_cmpgt_epi8(_mm_set1_epi8((char)(n - 1 - i < 16 ? n - 1 - i : 16)), lane);
+        count += (unsigned)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_and_si128(rare, valid)));
+    }
+    return count;
+}
+
+#endif
+
+// the number of positions in `letters[0..n)` at which a common word starts
+static unsigned common_words_found(const struct english_model *model,
+                                   const unsigned char *letters, size_t n)
+{
+    unsigned found = 0;
+
+    for (size_t i = 0; i + 3 <= n; i++) {
+        uint32_t h = letters[i] + letters[i + 1] * 26u + letters[i + 2] * 676u;
+        uint32_t place = 17576;
+        for (size_t len = 3; len <= 5 && i + len <= n; len++) {
+            if (len > 3) {
+                h += letters[i + len - 1] * place;
+                place *= ALPHABET_SIZE;
+            }
+            uint32_t bits[3];
+            bloom_bits(h, len, bits);
+            if ((model->bloom[bits[0] / 64] >> (bits[0] % 64)) & (model->bloom[bits[1] / 64] >> (bits[1] % 64))
+                & (model->bloom[bits[2] / 64] >> (bits[2] % 64)) & 1) {
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// the plaintext filter over the first FILTER_WINDOW of `n` letters (as offsets from 'A',
+// readable up to FILTER_WINDOW + 16 bytes)
+static bool filter_accept(const struct english_model *model, const unsigned char *letters, size_t n)
+{
+    if (n > FILTER_WINDOW) {
+        n = FILTER_WINDOW;
+    }
+    if (n < 2) {
+        return true;
+    }
+
+    unsigned rare;
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        rare = rare_bigrams_ssse3(model, letters, n);
+    } else
+#endif
+    {
+        rare = rare_bigrams_scalar(model, letters, n);
+    }
+    // English averages well under one rare bigram in sixteen; random text over two
+    if (rare > 1 + (n - 1) / 16) {
+        return false;
+    }
+    return common_words_found(model, letters, n) >= n / 32;
+}
+
+// plaintext filter on a string
+bool plaintext_plausible(char range_low, char range_high, const char *text)
+{
+    unsigned char letters[FILTER_WINDOW + 16] = {0};
+    size_t n = 0;
+
+    if (range_high - range_low + 1 != ALPHABET_SIZE) {
+        return false;
+    }
+    for (; *text && n < FILTER_WINDOW; text++) {
+        if (range_low <= *text && *text <= range_high) {
+            letters[n++] = (unsigned char)(*text - range_low);
+        }
+    }
+    return filter_accept(english_model(), letters, n);
+}
+
+struct brute_job {
+    const struct english_model *model;
+    unsigned char cipher[BRUTE_FORCE_PREFIX];
+    size_t n;                   // valid letters in `cipher`
+    size_t key_len;
+    size_t head;                // leading key characters fixed by the task index
+    size_t k;
+    char range_low;
+    unsigned threshold;         // fast score a candidate needs to be fully scored
+    // per column of the key, 25 (that is, -1 mod 26) at the prefix positions it covers
+    unsigned char column_step[BRUTE_FORCE_MAX_KEY][BRUTE_FORCE_PREFIX];
+    unsigned char valid[BRUTE_FORCE_PREFIX];    // 0xFF for the first `n` positions
+    struct key_candidate *top;  // `k` per task, best first
+    size_t *n_top;
+    atomic_ullong keys;
+};
+
+// inserts a candidate into a best-first list of at most `k` entries
+static void top_insert(struct key_candidate *top, size_t *n_top, size_t k,
+                       const struct key_candidate *candidate)
+{
+    size_t i = *n_top;
+    if (i == k) {
+        if (candidate->score <= top[k - 1].score) {
+            return;
+        }
+        i--;
+    } else {
+        (*n_top)++;
+    }
+    while (i > 0 && top[i - 1].score < candidate->score) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i] = *candidate;
+}
+
+// sum of the monogram weights of the valid letters of `plain`
+static unsigned monogram_score_scalar(const struct brute_job *job, const unsigned char *plain)
+{
+    unsigned score = 0;
+    for (size_t i = 0; i < job->n; i++) {
+        score += job->model->monogram[plain[i]];
+    }
+    return score;
+}
+
+#ifdef SAFECIPHER_X86
+
+// the monogram score sixteen letters at a time: two table lookups cover 26 letters
+__attribute__((target("ssse3")))
+static unsigned monogram_score_ssse3(const struct brute_job *job, const unsigned char *plain)
+{
+    const __m128i low_table = _mm_loadu_si128((const __m128i *)(const void *)job->model->monogram);
+    const __m128i high_table = _mm_loadu_si128((const __m128i *)(const void *)(job->model->monogram + 16));
+    const __m128i fifteen = _mm_set1_epi8(15);
+    const __m128i sixteen = _mm_set1_epi8(16);
+    __m128i sum = _mm_setzero_si128();
+
+    for (size_t i = 0; i < BRUTE_FORCE_PREFIX; i += 16) {
+        __m128i idx = _mm_loadu_si128((const __m128i *)(const void *)(plain + i));
+        __m128i high = _mm_cmpgt_epi8(idx, fifteen);
+        // letters below 16 index the high table negatively, which pshufb maps to zero
+        __m128i w = _mm_or_si128(_mm_andnot_si128(high, _mm_shuffle_epi8(low_table, idx)),
+                                 _mm_shuffle_epi8(high_table, _mm_sub_epi8(idx, sixteen)));
+        w = _mm_and_si128(w, _mm_loadu_si128((const __m128i *)(const void *)(job->valid + i)));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(w, _mm_setzero_si128()));
+    }
+    return (unsigned)(_mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4));
+}
+
+// moves every letter in a key column back by one place: 16 letters per instruction
+static inline void column_step_sse2(const struct brute_job *job, unsigned char *plain, size_t column)
+{
+    const __m128i last = _mm_set1_epi8(ALPHABET_SIZE - 1);
+    const __m128i size = _mm_set1_epi8(ALPHABET_SIZE);
+
+    for (size_t i = 0; i < BRUTE_FORCE_PREFIX; i += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(const void *)(plain + i));
+        __m128i step = _mm_loadu_si128((const __m128i *)(const void *)(job->column_step[column] + i));
+        p = _mm_add_epi8(p, step);
+        p = _mm_sub_epi8(p, _mm_and_si128(_mm_cmpgt_epi8(p, last), size));
+        _mm_storeu_si128((__m128i *)(void *)(plain + i), p);
+    }
+}
+
+#endif
+
+static void brute_task(void *arg, size_t task)
+{
+    struct brute_job *job = arg;
+    struct key_candidate *top = job->top + task * job->k;
+    size_t *n_top = &job->n_top[task];
+    unsigned char key[BRUTE_FORCE_MAX_KEY] = {0};
+    unsigned char plain[BRUTE_FORCE_PREFIX + 16] = {0};
+    unsigned long long tried = 0;
+#ifdef SAFECIPHER_X86
+    bool ssse3 = cpu_supports(CPU_SSSE3);
+#endif
+
+    for (size_t i = job->head, t = task; i > 0; i--, t /= ALPHABET_SIZE) {
+        key[i - 1] = (unsigned char)(t % ALPHABET_SIZE);
+    }
+    for (size_t i = 0; i < job->n; i++) {
+        int p = job->cipher[i] - key[i % job->key_len];
+        plain[i] = (unsigned char)(p < 0 ? p + ALPHABET_SIZE : p);
+    }
+
+    for (;;) {
+        unsigned fast;
+#ifdef SAFECIPHER_X86
+        fast = ssse3 ? monogram_score_ssse3(job, plain) : monogram_score_scalar(job, plain);
+#else
+        fast = monogram_score_scalar(job, plain);
+#endif
+        tried++;
+        if (fast >= job->threshold && filter_accept(job->model, plain, job->n)) {
+            struct key_candidate candidate;
+            candidate.score = bigram_score(job->model, plain, job->n);
+            if (*n_top < job->k || candidate.score > top[job->k - 1].score) {
+                for (size_t i = 0; i < job->key_len; i++) {
+                    candidate.key[i] = (char)(job->range_low + key[i]);
+                }
+                candidate.key[job->key_len] = '\0';
+                top_insert(top, n_top, job->k, &candidate);
+            }
+        }
+
+        // next key: advancing a key character by one (including the wrap from the last
+        // character back to the first) moves its column of plaintext back by one
+        size_t column = job->key_len;
+        bool done = true;
+        while (column > job->head) {
+            column--;
+#ifdef SAFECIPHER_X86
+            column_step_sse2(job, plain, column);
+#else
+            for (size_t i = column; i < job->n; i += job->key_len) {
+                plain[i] = (unsigned char)(plain[i] == 0 ? ALPHABET_SIZE - 1 : plain[i] - 1);
+            }
+#endif
+            key[column] = (unsigned char)((key[column] + 1) % ALPHABET_SIZE);
+            if (key[column] != 0) {
+                done = false;
+                break;
+            }
+        }
+        if (done) {
+            break;
+        }
+    }
+    atomic_fetch_add(&job->keys, tried);
+}
+
+// exhaustive vigenere key search
+size_t vigenere_brute_force(char range_low, char range_high, const char *cipher_text,
+                            size_t key_len, struct key_candidate *best, size_t k,
+                            struct brute_force_stats *stats)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (range_high - range_low + 1 != ALPHABET_SIZE || key_len == 0
+        || key_len > BRUTE_FORCE_MAX_KEY || k == 0 || k > BRUTE_FORCE_MAX_TOP) {
+        return SIZE_MAX;
+    }
+
+    struct brute_job *job = mem_calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return SIZE_MAX;
+    }
+    job->model = english_model();
+    for (const char *c = cipher_text; *c && job->n < BRUTE_FORCE_PREFIX; c++) {
+        if (range_low <= *c && *c <= range_high) {
+            job->cipher[job->n++] = (unsigned char)(*c - range_low);
+        }
+    }
+    job->key_len = key_len;
+    job->head = key_len < 2 ? key_len : 2;
+    job->k = k;
+    job->range_low = range_low;
+    // halfway between the fast score of random letters and that of English
+    job->threshold = (unsigned)((double)job->n
+                                * (job->model->monogram_random + job->model->monogram_english) / 2);
+    for (size_t i = 0; i < job->n; i++) {
+        job->column_step[i % key_len][i] = ALPHABET_SIZE - 1;
+        job->valid[i] = 0xFF;
+    }
+
+    size_t tasks = 1;
+    for (size_t i = 0; i < job->head; i++) {
+        tasks *= ALPHABET_SIZE;
+    }
+    job->top = mem_malloc(tasks * k * sizeof(*job->top));
+    job->n_top = mem_calloc(tasks, sizeof(*job->n_top));
+    size_t found = SIZE_MAX;
+
+    if (job->top != NULL && job->n_top != NULL) {
+        parallel_run(tasks, brute_task, job);
+        found = 0;
+        for (size_t t = 0; t < tasks; t++) {
+            for (size_t i = 0; i < job->n_top[t]; i++) {
+                top_insert(best, &found, k, &job->top[t * k + i]);
+            }
+        }
+        if (stats != NULL) {
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            stats->keys = atomic_load(&job->keys);
+            stats->seconds = (double)(end.tv_sec - start.tv_sec)
+                             + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        }
+    }
+
+    free(job->top);
+    free(job->n_top);
+    free(job);
+    return found;
+}
+
+/* Letter histograms. */
+
+// bytes counted by one histogram task at least, and at most (so counts fit in 32 bits)
+#define   HISTOGRAM_MIN_CHUNK   (1u << 20)
+#define   HISTOGRAM_MAX_CHUNK   (1u << 28)
+
+struct histogram_job {
+    char range_low;
+    char range_high;
+    size_t range_size;
+    const char *text;
+    size_t len;
+    size_t period;
+    size_t chunk;
+    // per task: counts by column relative to the task's first in-range character
+    uint32_t *counts;
+    size_t *in_range;
+};
+
+// counts every byte value in `text[0..len)` into four interleaved tables, so that runs
+// of the same letter do not serialise on one counter's store-to-load forwarding
+static void count_bytes(const unsigned char *text, size_t len, uint32_t tables[4][256])
+{
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, sizeof(word));
+        tables[0][word & 0xFF]++;
+        tables[1][(word >> 8) & 0xFF]++;
+        tables[2][(word >> 16) & 0xFF]++;
+        tables[3][(word >> 24) & 0xFF]++;
+        tables[0][(word >> 32) & 0xFF]++;
+        tables[1][(word >> 40) & 0xFF]++;
+        tables[2][(word >> 48) & 0xFF]++;
+        tables[3][word >> 56]++;
+    }
+    for (; i < len; i++) {
+        tables[i % 4][text[i]]++;
+    }
+}
+
+static void histogram_task(void *arg, size_t task)
+{
+    struct histogram_job *job = arg;
+    size_t start = task * job->chunk;
+    size_t len = job->len - start < job->chunk ? job->len - start : job->chunk;
+    const char *text = job->text + start;
+    uint32_t *counts = job->counts + task * job->period * job->range_size;
+    size_t in_range = 0;
+
+    if (job->period == 1) {
+        uint32_t tables[4][256] = {{0}};
+        count_bytes((const unsigned char *)text, len, tables);
+        for (size_t i = 0; i < job->range_size; i++) {
+            unsigned char c = (unsigned char)(job->range_low + (int)i);
+            counts[i] = tables[0][c] + tables[1][c] + tables[2][c] + tables[3][c];
+            in_range += counts[i];
+        }
+    } else {
+        // consecutive in-range characters fall in different columns, so one table will do
+        size_t column = 0;
+        for (size_t i = 0; i < len; i++) {
+            char c = text[i];
+            if (job->range_low <= c && c <= job->range_high) {
+                counts[column * job->range_size + (size_t)(c - job->range_low)]++;
+                column = column + 1 == job->period ? 0 : column + 1;
+                in_range++;
+            }
+        }
+    }
+    job->in_range[task] = in_range;
+}
+
+// histogram of in-range characters, optionally by key column
+bool letter_histogram(char range_low, char range_high, const char *text, size_t len,
+                      size_t period, size_t *counts)
+{
+    struct histogram_job job = {
+        .range_low = range_low,
+        .range_high = range_high,
+        .range_size = (size_t)(range_high - range_low + 1),
+        .text = text,
+        .len = len,
+        .period = period == 0 ? 1 : period,
+    };
+
+    // a few tasks per thread balance the load without multiplying the tables to merge
+    size_t threads = parallel_threads();
+    job.chunk = len / (4 * threads) + 1;
+    if (job.chunk < HISTOGRAM_MIN_CHUNK) {
+        job.chunk = HISTOGRAM_MIN_CHUNK;
+    } else if (job.chunk > HISTOGRAM_MAX_CHUNK) {
+        job.chunk = HISTOGRAM_MAX_CHUNK;
+    }
+    size_t tasks = len == 0 ? 1 : (len + job.chunk - 1) / job.chunk;
+    size_t table_size = job.period * job.range_size;
+
+    job.counts = mem_calloc(tasks * table_size, sizeof(*job.counts));
+    job.in_range = mem_calloc(tasks, sizeof(*job.in_range));
+    if (job.counts == NULL || job.in_range == NULL) {
+        free(job.counts);
+        free(job.in_range);
+        return false;
+    }
+
+    if (tasks == 1) {
+        histogram_task(&job, 0);
+    } else {
+        parallel_run(tasks, histogram_task, &job);
+    }
+
+    // a task's column 0 is the column of the in-range characters before it, mod period
+    memset(counts, 0, table_size * sizeof(*counts));
+    size_t phase = 0;
+    for (size_t t = 0; t < tasks; t++) {
+        const uint32_t *local = job.counts + t * table_size;
+        for (size_t column = 0; column < job.period; column++) {
+            size_t *global = counts + (phase + column) % job.period * job.range_size;
+            for (size_t i = 0; i < job.range_size; i++) {
+                global[i] += local[column * job.range_size + i];
+            }
+        }
+        phase = (phase + job.in_range[t]) % job.period;
+    }
+
+    free(job.counts);
+    free(job.in_range);
+    return true;
+}
@@ -0,0 +1,101 @@
+#include "crypto.h"
+#include "internal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// one malloc'ed region; allocations are carved from `data` front to back
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    max_align_t data[];
+};
+
+struct arena {
+    struct arena_block *first, *last;
+    struct arena_block *current;    // the block allocations come from, if any is left
+    size_t used;                    // bytes of `current` handed out since the last reset
+    size_t block_size;
+    size_t mallocs;
+    size_t bytes;                   // the total size of all blocks
+};
+
+struct arena *arena_create(size_t block_size)
+{
+    struct arena *arena = mem_calloc(1, sizeof(*arena));
+
+    if (arena != NULL) {
+        arena->block_size = block_size;
+    }
+    return arena;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    const size_t align = _Alignof(max_align_t);
+
+    if (size > SIZE_MAX - align - sizeof(struct arena_block)) {
+        return NULL;
+    }
+    size = (size + align - 1) / align * align;
+
+    // a block too small for what is asked is passed over until the reset, and a new block
+    // only goes on the end once every kept block has been tried, so a batch that makes
+    // the same allocations as an earlier one never calls malloc
+    while (arena->current != NULL && arena->current->size - arena->used < size) {
+        arena->current = arena->current->next;
+        arena->used = 0;
+    }
+    if (arena->current == NULL) {
+        size_t block = size > arena->block_size ? size : arena->block_size;
+        struct arena_block *b = mem_malloc(sizeof(*b) + block);
+        if (b == NULL) {
+            return NULL;
+        }
+        b->next = NULL;
+        b->size = block;
+        if (arena->last != NULL) {
+            arena->last->next = b;
+        } else {
+            arena->first = b;
+        }
+        arena->last = b;
+        arena->current = b;
+        arena->used = 0;
+        arena->mallocs++;
+        arena->bytes += block;
+    }
+    void *p = (char *)arena->current->data + arena->used;
+    arena->used += size;
+    return p;
+}
+
+void arena_reset(struct arena *arena)
+{
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+size_t arena_mallocs(const struct arena *arena)
+{
+    return arena->mallocs;
+}
+
+size_t arena_bytes(const struct arena *arena)
+{
+    return arena->bytes;
+}
+
+void arena_destroy(struct arena *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+    for (struct arena_block *b = arena->first; b != NULL;) {
+        struct arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,965 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "crypto.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#ifdef SAFECIPHER_ZLIB
+#include <zlib.h>
+#endif
+
+#define   RANGE_LOW   'A'
+#define   RANGE_HIGH  'Z'
+
+// repetitions of each measurement; the fastest is reported
+#define   REPEATS     5
+
+// the command-line program, built optimised and without sanitizers by `make bench`
+#define   BENCH_CLI   "./safecipher-bench-cli"
+
+// the peak RSS streaming may reach whatever the input size, with four workers: ten 1 MiB
+// chunks in flight, and what the program and the C library take before reading anything
+#define   STREAM_THREADS       "4"
+#define   STREAM_BUDGET_KIB    ((10 + 8) << 10)
+
+// seconds on a monotonic clock
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// prints one result as a line of JSON
+static void report(const char *benchmark, const char *variant, size_t bytes, double seconds)
+{
+    printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"bytes\": %zu, "
+           "\"seconds\": %.6f, \"gb_per_s\": %.3f}\n",
+           benchmark, variant, bytes, seconds, (double)bytes / seconds / 1e9);
+}
+
+// prints one result as a line of JSON, with the CPU time the process spent (on all its
+// threads) alongside the wall time
+static void report_cpu(const char *benchmark, const char *variant, size_t bytes, double seconds,
+                       double cpu_seconds)
+{
+    printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"bytes\": %zu, "
+           "\"seconds\": %.6f, \"gb_per_s\": %.3f, \"cpu_seconds_per_gb\": %.4f}\n",
+           benchmark, variant, bytes, seconds, (double)bytes / seconds / 1e9,
+           cpu_seconds / ((double)bytes / 1e9));
+}
+
+// CPU seconds used by the whole process
+static double cpu_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// a null-terminated string of `len` upper-case letters with a space every few letters
+static char *random_text(size_t len)
+{
+    char *text = malloc(len + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    srand(1);
+    for (size_t i = 0; i < len; i++) {
+        text[i] = rand() % 6 == 0 ? ' ' : (char)(RANGE_LOW + rand() % (RANGE_HIGH - RANGE_LOW + 1));
+    }
+    text[len] = '\0';
+    return text;
+}
+
+// the obvious single-table loop letter_histogram is measured against
+static void naive_histogram(const char *text, size_t len, size_t *counts)
+{
+    memset(counts, 0, (RANGE_HIGH - RANGE_LOW + 1) * sizeof(*counts));
+    for (size_t i = 0; i < len; i++) {
+        if (RANGE_LOW <= text[i] && text[i] <= RANGE_HIGH) {
+            counts[text[i] - RANGE_LOW]++;
+        }
+    }
+}
+
+static bool bench_histogram(const char *text, size_t len)
+{
+    size_t naive[RANGE_HIGH - RANGE_LOW + 1];
+    size_t counts[RANGE_HIGH - RANGE_LOW + 1];
+    double best_naive = 1e9;
+    double best = 1e9;
+
+    for (int r = 0; r < REPEATS; r++) {
+        double start = now();
+        naive_histogram(text, len, naive);
+        double mid = now();
+        if (!letter_histogram(RANGE_LOW, RANGE_HIGH, text, len, 0, counts)) {
+            return false;
+        }
+        double end = now();
+        best_naive = mid - start < best_naive ? mid - start : best_naive;
+        best = end - mid < best ? end - mid : best;
+    }
+    if (memcmp(naive, counts, sizeof(counts)) != 0) {
+        fprintf(stderr, "histogram: results differ from the naive loop\n");
+        return false;
+    }
+    report("histogram", "naive", len, best_naive);
+    report("histogram", "letter_histogram", len, best);
+    return true;
+}
+
+// encrypts and decrypts with 2x2 and 3x3 key matrices, checking the round trip
+static bool bench_hill(const char *text, size_t len)
+{
+    static const char *const keys[] = { "DDCF", "GYBNQKURP" };
+    static const char *const variants[] = { "2x2-encrypt", "3x3-encrypt" };
+    char *cipher = malloc(len + 1);
+    char *plain = malloc(len + 1);
+    bool ok = cipher != NULL && plain != NULL;
+
+    for (size_t k = 0; ok && k < sizeof(keys) / sizeof(keys[0]); k++) {
+        double best = 1e9;
+        for (int r = 0; ok && r < REPEATS; r++) {
+            double start = now();
+            ok = hill_encrypt(RANGE_LOW, RANGE_HIGH, keys[k], text, cipher);
+            double end = now();
+            best = end - start < best ? end - start : best;
+        }
+        ok = ok && hill_decrypt(RANGE_LOW, RANGE_HIGH, keys[k], cipher, plain);
+        if (ok && strcmp(plain, text) != 0) {
+            fprintf(stderr, "hill: decryption does not restore the plaintext\n");
+            ok = false;
+        }
+        if (ok) {
+            report("hill", variants[k], len, best);
+        }
+    }
+    free(cipher);
+    free(plain);
+    return ok;
+}
+
+// encrypts the text as it is and with the spaces removed (the usual Playfair input,
+// which the vector path translates sixteen letters at a time)
+static bool bench_playfair(const char *text, size_t len)
+{
+    char *letters = malloc(len + 1);
+    char *cipher = malloc(2 * len + 2);
+    bool ok = letters != NULL && cipher != NULL;
+    size_t n = 0;
+
+    for (size_t i = 0; ok && i < len; i++) {
+        if (text[i] != ' ') {
+            letters[n++] = text[i];
+        }
+    }
+    for (int words = 0; ok && words < 2; words++) {
+        const char *in = words ? text : letters;
+        size_t in_len = words ? len : n;
+        double best = 1e9;
+        if (!words) {
+            letters[n] = '\0';
+        }
+        for (int r = 0; ok && r < REPEATS; r++) {
+            double start = now();
+            ok = playfair_encrypt("PLAYFAIREXAMPLE", in, cipher, 2 * len + 2);
+            double end = now();
+            best = end - start < best ? end - start : best;
+        }
+        if (ok) {
+            report("playfair", words ? "encrypt-words" : "encrypt-letters", in_len, best);
+        }
+    }
+    free(letters);
+    free(cipher);
+    return ok;
+}
+
+// transposes the text in 64 KiB messages, so that every message after the first reuses
+// the cached permutation, then runs a Vigenere + rail fence pipeline over the whole buffer
+static bool bench_transposition(const char *text, size_t len)
+{
+    size_t msg_len = len < (64 << 10) ? len : 64 << 10;
+    size_t messages = len / msg_len;
+    char *msg = malloc(msg_len + 1);
+    char *cipher = malloc(len + 1);
+    char *plain = malloc(len + 1);
+    bool ok = msg != NULL && cipher != NULL && plain != NULL;
+
+    for (int route = 0; ok && route < 2; route++) {
+        double best = 1e9;
+        for (int r = 0; ok && r < REPEATS; r++) {
+            double start = now();
+            for (size_t m = 0; ok && m < messages; m++) {
+                memcpy(msg, text + m * msg_len, msg_len);
+                msg[msg_len] = '\0';
+                ok = route ? route_encrypt(RANGE_LOW, RANGE_HIGH, 64, msg, cipher + m * msg_len)
+                           : rail_fence_encrypt(RANGE_LOW, RANGE_HIGH, 3, msg, cipher + m * msg_len);
+            }
+            double end = now();
+            best = end - start < best ? end - start : best;
+        }
+        if (ok) {
+            report("transposition", route ? "route-64-messages" : "rail-3-messages",
+                   messages * msg_len, best);
+        }
+    }
+
+    const struct cipher_step steps[] = {
+        { .kind = CIPHER_VIGENERE, .key = "LEMON" },
+        { .kind = CIPHER_RAIL_FENCE, .size = 3 },
+    };
+    double best = 1e9;
+    for (int r = 0; ok && r < REPEATS; r++) {
+        double start = now();
+        ok = cipher_pipeline(RANGE_LOW, RANGE_HIGH, steps, 2, false, text, cipher);
+        double end = now();
+        best = end - start < best ? end - start : best;
+    }
+    ok = ok && cipher_pipeline(RANGE_LOW, RANGE_HIGH, steps, 2, true, cipher, plain);
+    if (ok && strcmp(plain, text) != 0) {
+        fprintf(stderr, "transposition: pipeline does not restore the plaintext\n");
+        ok = false;
+    }
+    if (ok) {
+        report("transposition", "vigenere-rail-pipeline", len, best);
+    }
+    free(msg);
+    free(cipher);
+    free(plain);
+    return ok;
+}
+
+// the published output of an Enigma I with rotors I-II-III, reflector B, rings and start
+// AAA and no plugs, over 25 A's: it covers all three rotors' wirings, the reflector and
+// the middle rotor's step at rotor III's notch
+static bool enigma_known_answer(void)
+{
+    const struct enigma_settings settings = { {1, 2, 3}, {'A', 'A', 'A'}, {'A', 'A', 'A'},
+                                              'B', "" };
+    const char *expected = "BDZGOWCXLTKSBTMCDLPBMUQOF";
+    char out[26] = "";
+
+    if (!enigma_crypt(&settings, "AAAAAAAAAAAAAAAAAAAAAAAAA", out) || strcmp(out, expected) != 0) {
+        fprintf(stderr, "enigma: I-II-III:AAA:AAA gives %s, not %s\n", out, expected);
+        return false;
+    }
+    return true;
+}
+
+// enciphers the text as one message, then as 256-character messages that share a
+// machine configuration but start at different positions: first with separate calls
+// (over a sample of the messages), then as one batch
+static bool bench_enigma(const char *text, size_t len)
+{
+    enum { MESSAGE = 256, SAMPLE = 4096 };
+    size_t count = len / MESSAGE;
+    struct enigma_settings *settings = malloc((count + 1) * sizeof(*settings));
+    const char **in = malloc((count + 1) * sizeof(*in));
+    char **out = malloc((count + 1) * sizeof(*out));
+    char *messages = malloc(2 * count * (MESSAGE + 1) + 1);
+    char *cipher = malloc(len + 1);
+    bool ok = settings != NULL && in != NULL && out != NULL && messages != NULL && cipher != NULL
+              && enigma_known_answer();
+    double best = 1e9;
+
+    for (size_t i = 0; ok && i < count; i++) {
+        settings[i] = (struct enigma_settings){ {2, 4, 5}, {'B', 'U', 'L'},
+                                                {(char)('A' + i % 26), (char)('A' + i / 26 % 26), 'A'},
+                                                'B', "AV BS CG DL FU HZ IN KM OW RX" };
+        in[i] = messages + i * (MESSAGE + 1);
+        out[i] = messages + (count + i) * (MESSAGE + 1);
+        memcpy(messages + i * (MESSAGE + 1), text + i * MESSAGE, MESSAGE);
+        messages[i * (MESSAGE + 1) + MESSAGE] = '\0';
+    }
+
+    for (int r = 0; ok && r < REPEATS; r++) {
+        double start = now();
+        ok = enigma_crypt(&settings[0], text, cipher);
+        double end = now();
+        best = end - start < best ? end - start : best;
+    }
+    if (ok) {
+        report("enigma", "one-message", len, best);
+    }
+
+    size_t sample = count < SAMPLE ? count : SAMPLE;
+    best = 1e9;
+    for (int r = 0; ok && r < REPEATS; r++) {
+        double start = now();
+        for (size_t i = 0; ok && i < sample; i++) {
+            ok = enigma_crypt(&settings[i], in[i], out[i]);
+        }
+        double end = now();
+        best = end - start < best ? end - start : best;
+    }
+    if (ok) {
+        report("enigma", "separate-messages", sample * MESSAGE, best);
+    }
+
+    best = 1e9;
+    for (int r = 0; ok && r < REPEATS; r++) {
+        double start = now();
+        ok = enigma_crypt_batch(settings, count, in, out);
+        double end = now();
+        best = end - start < best ? end - start : best;
+    }
+    if (ok) {
+        report("enigma", "batch", count * MESSAGE, best);
+    }
+    free(settings);
+    free(in);
+    free(out);
+    free(messages);
+    free(cipher);
+    return ok;
+}
+
+// encrypts with the Caesar cipher into hex and base64, first as two passes over a full
+// ciphertext buffer and then fused, and decodes and decrypts the result fused
+static bool bench_encoding(const char *text, size_t len)
+{
+    static const char *const names[] = { "hex", "base64" };
+    char *cipher = malloc(len + 1);
+    char *encoded = malloc(2 * len + 1);
+    char *plain = malloc(len + 1);
+    bool ok = cipher != NULL && encoded != NULL && plain != NULL;
+
+    for (int e = 0; ok && e < 2; e++) {
+        enum text_encoding encoding = e == 0 ? ENCODING_HEX : ENCODING_BASE64;
+        char variant[32];
+        double best_separate = 1e9, best_fused = 1e9, best_decode = 1e9;
+        size_t n = 0;
+        for (int r = 0; r < REPEATS; r++) {
+            double start = now();
+            caesar_encrypt(RANGE_LOW, RANGE_HIGH, 3, text, cipher);
+            text_encode(encoding, cipher, len, encoded);
+            double mid = now();
+            n = caesar_encrypt_encoded(RANGE_LOW, RANGE_HIGH, 3, text, len, encoding, encoded);
+            double end = now();
+            best_separate = mid - start < best_separate ? mid - start : best_separate;
+            best_fused = end - mid < best_fused ? end - mid : best_fused;
+        }
+        for (int r = 0; ok && r < REPEATS; r++) {
+            double start = now();
+            ok = caesar_decrypt_encoded(RANGE_LOW, RANGE_HIGH, 3, encoded, n, encoding, plain) == len;
+            double end = now();
+            best_decode = end - start < best_decode ? end - start : best_decode;
+        }
+        if (ok && memcmp(plain, text, len) != 0) {
+            fprintf(stderr, "encoding: %s round trip does not restore the plaintext\n", names[e]);
+            ok = false;
+        }
+        if (ok) {
+            snprintf(variant, sizeof(variant), "%s-two-pass", names[e]);
+            report("caesar-encoded", variant, len, best_separate);
+            snprintf(variant, sizeof(variant), "%s-fused", names[e]);
+            report("caesar-encoded", variant, len, best_fused);
+            snprintf(variant, sizeof(variant), "%s-decode-fused", names[e]);
+            report("caesar-encoded", variant, len, best_decode);
+        }
+    }
+    free(cipher);
+    free(encoded);
+    free(plain);
+    return ok;
+}
+
+// measures crc32c on its own, then a Vigenere pass checksummed afterwards with two more
+// passes against the same pass with the checksums taken inside the cipher loop
+static bool bench_checksum(const char *text, size_t len)
+{
+    const struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = "LEMON" };
+    char *cipher = malloc(len + 1);
+    bool ok = cipher != NULL;
+    double best_crc = 1e9, best_separate = 1e9, best_fused = 1e9;
+    uint32_t crc_in = 0, crc_out = 0;
+    struct cipher_checksums sums = { 0, 0 };
+
+    for (int r = 0; ok && r < REPEATS; r++) {
+        double start = now();
+        crc_in = crc32c(0, text, len);
+        double mid = now();
+        vigenere_encrypt(RANGE_LOW, RANGE_HIGH, "LEMON", text, cipher);
+        crc_in = crc32c(0, text, len);
+        crc_out = crc32c(0, cipher, len);
+        double mid2 = now();
+        ok = cipher_substitute(RANGE_LOW, RANGE_HIGH, &step, false, text, len, ENCODING_NONE,
+                               cipher, &sums) == len;
+        double end = now();
+        best_crc = mid - start < best_crc ? mid - start : best_crc;
+        best_separate = mid2 - mid < best_separate ? mid2 - mid : best_separate;
+        best_fused = end - mid2 < best_fused ? end - mid2 : best_fused;
+    }
+    if (ok && (sums.input != crc_in || sums.output != crc_out)) {
+        fprintf(stderr, "checksum: fused checksums differ from separate passes\n");
+        ok = false;
+    }
+    if (ok) {
+        report("checksum", "crc32c", len, best_crc);
+        report("checksum", "vigenere-then-crc32c", len, best_separate);
+        report("checksum", "vigenere-crc32c-fused", len, best_fused);
+    }
+    free(cipher);
+    return ok;
+}
+
+// encrypts and decrypts text of the alphabets the CLI names, each letter of the text
+// moved into the range, checking the round trip: every range should run at about the
+// speed of A-Z
+static bool bench_ranges(const char *text, size_t len)
+{
+    static const struct {
+        const char *name;
+        char low, high;
+        const char *key;
+    } ranges[] = {
+        { "upper", 'A', 'Z', "LEMON" },
+        { "lower", 'a', 'z', "lemon" },
+        { "digits", '0', '9', "31415" },
+        { "printable", ' ', '~', "L3m0n!" },
+    };
+    char *in = malloc(len + 1);
+    char *cipher = malloc(len + 1);
+    char *plain = malloc(len + 1);
+    bool ok = in != NULL && cipher != NULL && plain != NULL;
+
+    for (size_t r = 0; ok && r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        int size = ranges[r].high - ranges[r].low + 1;
+        double best_caesar = 1e9, best_vigenere = 1e9;
+
+        for (size_t i = 0; i < len; i++) {
+            in[i] = text[i] == ' ' ? ' ' : (char)(ranges[r].low + (text[i] - RANGE_LOW) % size);
+        }
+        in[len] = '\0';
+        for (int n = 0; n < REPEATS; n++) {
+            double start = now();
+            caesar_encrypt(ranges[r].low, ranges[r].high, 7, in, cipher);
+            double mid = now();
+            vigenere_encrypt(ranges[r].low, ranges[r].high, ranges[r].key, in, cipher);
+            double end = now();
+            best_caesar = mid - start < best_caesar ? mid - start : best_caesar;
+            best_vigenere = end - mid < best_vigenere ? end - mid : best_vigenere;
+        }
+        vigenere_decrypt(ranges[r].low, ranges[r].high, ranges[r].key, cipher, plain);
+        ok = strcmp(in, plain) == 0;
+        caesar_encrypt(ranges[r].low, ranges[r].high, 7, in, cipher);
+        caesar_decrypt(ranges[r].low, ranges[r].high, 7, cipher, plain);
+        ok = ok && strcmp(in, plain) == 0;
+        if (!ok) {
+            fprintf(stderr, "ranges: %s does not round-trip\n", ranges[r].name);
+            break;
+        }
+        char variant[32];
+        snprintf(variant, sizeof(variant), "caesar-%s", ranges[r].name);
+        report("ranges", variant, len, best_caesar);
+        snprintf(variant, sizeof(variant), "vigenere-%s", ranges[r].name);
+        report("ranges", variant, len, best_vigenere);
+    }
+    free(in);
+    free(cipher);
+    free(plain);
+    return ok;
+}
+
+// the byte-at-a-time loops the CLI checked keys with before range_check and
+// whitespace_check
+static size_t naive_range_check(const char *text, size_t len)
+{
+    size_t i = 0;
+    while (i < len && RANGE_LOW <= text[i] && text[i] <= RANGE_HIGH) {
+        i++;
+    }
+    return i;
+}
+
+static size_t naive_whitespace_check(const char *text, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !isspace((unsigned char)text[i])) {
+        i++;
+    }
+    return i;
+}
+
+// validates a key as long as the text, all letters but for a digit and a tab at the end,
+// checking the position found against the byte loops
+static bool bench_validate(const char *text, size_t len)
+{
+    char *key = malloc(len + 1);
+    double best_naive_range = 1e9, best_range = 1e9, best_naive_space = 1e9, best_space = 1e9;
+    size_t naive_range = 0, range = 0, naive_space = 0, space = 0;
+
+    if (key == NULL || len < 2) {
+        free(key);
+        return key != NULL;
+    }
+    for (size_t i = 0; i < len; i++) {
+        key[i] = text[i] == ' ' ? RANGE_LOW : text[i];
+    }
+    key[len - 2] = '7';
+    key[len - 1] = '\t';
+    key[len] = '\0';
+    for (int r = 0; r < REPEATS; r++) {
+        double t0 = now();
+        naive_range = naive_range_check(key, len);
+        double t1 = now();
+        range = range_check(RANGE_LOW, RANGE_HIGH, key, len);
+        double t2 = now();
+        naive_space = naive_whitespace_check(key, len);
+        double t3 = now();
+        space = whitespace_check(key, len);
+        double t4 = now();
+        best_naive_range = t1 - t0 < best_naive_range ? t1 - t0 : best_naive_range;
+        best_range = t2 - t1 < best_range ? t2 - t1 : best_range;
+        best_naive_space = t3 - t2 < best_naive_space ? t3 - t2 : best_naive_space;
+        best_space = t4 - t3 < best_space ? t4 - t3 : best_space;
+    }
+    free(key);
+    if (range != naive_range || range != len - 2 || space != naive_space || space != len - 1) {
+        fprintf(stderr, "validate: positions differ from the byte loops\n");
+        return false;
+    }
+    report("validate", "range-naive", len, best_naive_range);
+    report("validate", "range_check", len, best_range);
+    report("validate", "whitespace-naive", len, best_naive_space);
+    report("validate", "whitespace_check", len, best_space);
+    return true;
+}
+
+// streams the text from a temporary file to /dev/null with one worker thread and with
+// the default number
+static bool bench_stream(const char *text, size_t len)
+{
+    const struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = "LEMON" };
+    FILE *in = tmpfile();
+    int out = open("/dev/null", O_WRONLY);
+    bool ok = in != NULL && out >= 0 && fwrite(text, 1, len, in) == len && fflush(in) == 0;
+    const char *threads = getenv("SAFECIPHER_THREADS");
+    char *saved = threads != NULL ? strdup(threads) : NULL;
+
+    for (int single = 1; ok && single >= 0; single--) {
+        double best = 1e9;
+        if (single) {
+            setenv("SAFECIPHER_THREADS", "1", 1);
+        } else if (saved != NULL) {
+            setenv("SAFECIPHER_THREADS", saved, 1);
+        } else {
+            unsetenv("SAFECIPHER_THREADS");
+        }
+        for (int r = 0; ok && r < REPEATS; r++) {
+            ok = lseek(fileno(in), 0, SEEK_SET) == 0;
+            double start = now();
+            ok = ok && cipher_stream(RANGE_LOW, RANGE_HIGH, &step, false, fileno(in), out, false, NULL);
+            double end = now();
+            best = end - start < best ? end - start : best;
+        }
+        if (ok) {
+            report("stream", single ? "vigenere-1-worker" : "vigenere-all-workers", len, best);
+        }
+    }
+    free(saved);
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out >= 0) {
+        close(out);
+    }
+    return ok;
+}
+
+// reads a pipe to its end, as the next program in a pipeline would
+static void *drain_pipe(void *arg)
+{
+    static char buf[1 << 16];
+    int fd = *(int *)arg;
+
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+// streams the text into a pipe drained by another thread, copying it in with write()
+// and splicing it in; the CPU time per GB (which counts the drain's copy out of the pipe
+// in both cases) shows the copy splicing saves
+static bool bench_splice(const char *text, size_t len)
+{
+    const struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = "LEMON" };
+    FILE *in = tmpfile();
+    bool ok = in != NULL && fwrite(text, 1, len, in) == len && fflush(in) == 0;
+
+    for (int zero_copy = 0; ok && zero_copy <= 1; zero_copy++) {
+        double best = 1e9, best_cpu = 1e9;
+        for (int r = 0; ok && r < REPEATS; r++) {
+            int fds[2];
+            pthread_t drain;
+            ok = lseek(fileno(in), 0, SEEK_SET) == 0 && pipe(fds) == 0;
+            if (!ok) {
+                break;
+            }
+            bool draining = pthread_create(&drain, NULL, drain_pipe, &fds[0]) == 0;
+            double start = now(), cpu_start = cpu_now();
+            ok = draining && cipher_stream(RANGE_LOW, RANGE_HIGH, &step, false, fileno(in),
+                                           fds[1], zero_copy, NULL);
+            close(fds[1]);
+            if (draining) {
+                pthread_join(drain, NULL);
+            }
+            double end = now(), cpu_end = cpu_now();
+            close(fds[0]);
+            best = end - start < best ? end - start : best;
+            best_cpu = cpu_end - cpu_start < best_cpu ? cpu_end - cpu_start : best_cpu;
+        }
+        if (ok) {
+            report_cpu("stream-pipe", zero_copy ? "vmsplice" : "write", len, best, best_cpu);
+        }
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    return ok;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// one client submits the whole buffer as one job, and once it has started sixteen other
+// clients submit a thousand 100-byte jobs between them, all on a single worker;
+// reports the small jobs' latencies with every job run whole (first come, first served)
+// and with jobs cut into 64 KiB chunks scheduled by deficit round-robin
+static bool bench_scheduler(const char *text, size_t len)
+{
+    enum { SMALL_JOBS = 1000, SMALL_LEN = 100, SMALL_CLIENTS = 16 };
+    const struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = "LEMON" };
+    const size_t quanta[2] = { SIZE_MAX, 64 << 10 };
+    char *out = malloc(len + SMALL_JOBS * SMALL_LEN);
+    double *latency = malloc(SMALL_JOBS * sizeof(*latency));
+    double *submitted = malloc(SMALL_JOBS * sizeof(*submitted));
+    struct scheduler_job **jobs = malloc(SMALL_JOBS * sizeof(*jobs));
+    bool ok = out != NULL && latency != NULL && submitted != NULL && jobs != NULL
+              && len >= SMALL_JOBS * SMALL_LEN;
+
+    for (int q = 0; ok && q < 2; q++) {
+        struct scheduler *scheduler = scheduler_create(1, SMALL_JOBS + 1, 0, quanta[q]);
+        struct scheduler_job *large;
+        ok = scheduler != NULL;
+        double start = now();
+        ok = ok && scheduler_submit(scheduler, 0, RANGE_LOW, RANGE_HIGH, &step, false, text,
+                                    len, out, NULL, &large) == SCHEDULER_OK;
+        // lets the worker start on the large job before the small ones arrive
+        nanosleep(&(struct timespec){ .tv_nsec = 5000000 }, NULL);
+        for (size_t i = 0; ok && i < SMALL_JOBS; i++) {
+            submitted[i] = now();
+            ok = scheduler_submit(scheduler, 1 + i % SMALL_CLIENTS, RANGE_LOW, RANGE_HIGH,
+                                  &step, false, text + i * SMALL_LEN, SMALL_LEN,
+                                  out + len + i * SMALL_LEN, NULL, &jobs[i]) == SCHEDULER_OK;
+        }
+        // the small jobs finish in the order they were submitted, so waiting in that
+        // order sees each one finish
+        for (size_t i = 0; ok && i < SMALL_JOBS; i++) {
+            scheduler_wait(scheduler, jobs[i]);
+            latency[i] = now() - submitted[i];
+        }
+        if (ok) {
+            scheduler_wait(scheduler, large);
+        }
+        double end = now();
+        scheduler_destroy(scheduler);
+        if (ok) {
+            qsort(latency, SMALL_JOBS, sizeof(*latency), compare_doubles);
+            printf("{\"benchmark\": \"scheduler\", \"variant\": \"%s\", \"large_bytes\": %zu, "
+                   "\"small_jobs\": %d, \"small_p50_us\": %.1f, \"small_p99_us\": %.1f, "
+                   "\"small_max_us\": %.1f, \"seconds\": %.6f}\n",
+                   q == 0 ? "whole-jobs" : "drr-64k", len, SMALL_JOBS,
+                   latency[SMALL_JOBS / 2] * 1e6, latency[SMALL_JOBS * 99 / 100] * 1e6,
+                   latency[SMALL_JOBS - 1] * 1e6, end - start);
+        }
+    }
+    free(out);
+    free(latency);
+    free(submitted);
+    free(jobs);
+    return ok;
+}
+
+// starts a job over the whole buffer and stops it part way, by cancelling its token and
+// by letting its deadline pass; reports the longest time (over the repetitions) from the
+// cancellation or the deadline until the job has stopped and its worker is free
+static bool bench_cancel(const char *text, size_t len)
+{
+    const struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = "LEMON" };
+    struct scheduler *scheduler = scheduler_create(1, 1, 0, SIZE_MAX);
+    char *out = malloc(len);
+    bool ok = scheduler != NULL && out != NULL;
+
+    for (int deadline = 0; ok && deadline <= 1; deadline++) {
+        double worst = 0;
+        for (int r = 0; ok && r < REPEATS; r++) {
+            struct cancel_token token;
+            struct scheduler_job *job;
+            cancel_token_init(&token, deadline ? 5 : 0);
+            double start = now();
+            ok = scheduler_submit(scheduler, 0, RANGE_LOW, RANGE_HIGH, &step, false, text, len,
+                                  out, &token, &job) == SCHEDULER_OK;
+            if (!ok) {
+                break;
+            }
+            nanosleep(&(struct timespec){ .tv_nsec = 5000000 }, NULL);
+            double stop = deadline ? start + 0.005 : now();
+            if (!deadline) {
+                cancel_token_cancel(&token);
+            }
+            // the whole buffer takes far longer than 5 ms, so the job must have stopped
+            ok = !scheduler_wait(scheduler, job);
+            double end = now();
+            worst = end - stop > worst ? end - stop : worst;
+        }
+        if (ok) {
+            printf("{\"benchmark\": \"cancel\", \"variant\": \"%s\", \"bytes\": %zu, "
+                   "\"worst_stop_us\": %.1f}\n", deadline ? "deadline" : "cancel", len, worst * 1e6);
+        }
+    }
+    scheduler_destroy(scheduler);
+    free(out);
+    return ok;
+}
+
+#ifdef SAFECIPHER_ZLIB
+
+// compresses the buffer (zlib format, which the gzip stream also reads) and streams it
+// through decompression, the cipher and compression at two compression levels; reports
+// the throughput in decompressed bytes
+static bool bench_gzip(const char *text, size_t len)
+{
+    const struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = "LEMON" };
+    const int levels[2] = { 1, 6 };
+    uLongf packed_len = compressBound((uLong)len);
+    unsigned char *packed = malloc(packed_len);
+    FILE *in = tmpfile();
+    int out = open("/dev/null", O_WRONLY);
+    bool ok = packed != NULL && in != NULL && out >= 0
+              && compress2(packed, &packed_len, (const unsigned char *)text, (uLong)len, 1) == Z_OK
+              && fwrite(packed, 1, packed_len, in) == packed_len && fflush(in) == 0;
+
+    for (int l = 0; ok && l < 2; l++) {
+        double best = 1e9;
+        for (int r = 0; ok && r < REPEATS; r++) {
+            ok = lseek(fileno(in), 0, SEEK_SET) == 0;
+            double start = now();
+            ok = ok && cipher_stream_gzip(RANGE_LOW, RANGE_HIGH, &step, false, fileno(in), out,
+                                          levels[l], NULL);
+            double end = now();
+            best = end - start < best ? end - start : best;
+        }
+        if (ok) {
+            report("gzip-stream", l == 0 ? "vigenere-level-1" : "vigenere-level-6", len, best);
+        }
+    }
+    free(packed);
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out >= 0) {
+        close(out);
+    }
+    return ok;
+}
+
+#endif
+
+// runs a program to completion with its output discarded; returns false if it could not
+// be started or failed
+static bool run_program(char *const argv[], posix_spawn_file_actions_t *actions)
+{
+    extern char **environ;
+    pid_t pid;
+    int status;
+
+    if (posix_spawn(&pid, argv[0], actions, NULL, argv, environ) != 0) {
+        return false;
+    }
+    if (waitpid(pid, &status, 0) != pid) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// runs the command-line program on a five-letter message many times over and reports
+// the exec-to-exit times, next to those of a program that does nothing (the cost of
+// process creation alone); a one-shot run should add little to that
+static bool bench_startup(void)
+{
+    enum { RUNS = 500 };
+    char *const commands[][6] = {
+        { "/bin/true", NULL },
+        { BENCH_CLI, "caesar-encrypt", "3", "HELLO", NULL },
+        { BENCH_CLI, "vigenere-encrypt", "LEMON", "HELLO", NULL },
+        { BENCH_CLI, "--checksum", "vigenere-encrypt", "LEMON", "HELLO" },
+    };
+    const char *variants[] = { "true", "caesar", "vigenere", "vigenere-checksum" };
+    posix_spawn_file_actions_t actions;
+    double *times = malloc(RUNS * sizeof(*times));
+    bool ok = times != NULL && posix_spawn_file_actions_init(&actions) == 0;
+
+    if (ok && access(BENCH_CLI, X_OK) != 0) {
+        fprintf(stderr, "%s not found, skipping the startup benchmark\n", BENCH_CLI);
+        posix_spawn_file_actions_destroy(&actions);
+        free(times);
+        return true;
+    }
+    ok = ok && posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                                O_WRONLY, 0) == 0
+         && posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                             O_WRONLY, 0) == 0;
+    for (size_t c = 0; ok && c < sizeof(commands) / sizeof(commands[0]); c++) {
+        for (size_t i = 0; ok && i < RUNS; i++) {
+            double start = now();
+            ok = run_program(commands[c], &actions);
+            times[i] = now() - start;
+        }
+        if (ok) {
+            qsort(times, RUNS, sizeof(*times), compare_doubles);
+            printf("{\"benchmark\": \"startup\", \"variant\": \"%s\", \"runs\": %d, "
+                   "\"p50_us\": %.1f, \"p99_us\": %.1f}\n", variants[c], RUNS,
+                   times[RUNS / 2] * 1e6, times[RUNS * 99 / 100] * 1e6);
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    free(times);
+    return ok;
+}
+
+// streams the first eighth of the buffer and then all of it through the command-line
+// program with --stats, and reports the peak RSS and the allocations of each run; fails
+// if either run goes over the memory budget, or if the larger input allocates more
+static bool bench_memory(const char *text, size_t len)
+{
+    char *const command[] = { BENCH_CLI, "--stats", "--stream", "vigenere-encrypt", "LEMON", NULL };
+    const size_t sizes[2] = { len / 8, len };
+    FILE *in = tmpfile();
+    FILE *err = tmpfile();
+    posix_spawn_file_actions_t actions;
+    const char *threads = getenv("SAFECIPHER_THREADS");
+    char *saved = threads != NULL ? strdup(threads) : NULL;
+    unsigned long long first_allocated = 0;
+    bool ok = in != NULL && err != NULL && posix_spawn_file_actions_init(&actions) == 0;
+
+    if (ok && access(BENCH_CLI, X_OK) != 0) {
+        fprintf(stderr, "%s not found, skipping the memory benchmark\n", BENCH_CLI);
+        posix_spawn_file_actions_destroy(&actions);
+        ok = false;
+    } else if (ok) {
+        ok = posix_spawn_file_actions_adddup2(&actions, fileno(in), STDIN_FILENO) == 0
+             && posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                                 O_WRONLY, 0) == 0
+             && posix_spawn_file_actions_adddup2(&actions, fileno(err), STDERR_FILENO) == 0;
+        setenv("SAFECIPHER_THREADS", STREAM_THREADS, 1);
+        for (int i = 0; ok && i < 2; i++) {
+            size_t peak_kib = 0, largest = 0;
+            unsigned long long allocations = 0, allocated = 0;
+            ok = ftruncate(fileno(in), 0) == 0 && lseek(fileno(in), 0, SEEK_SET) == 0
+                 && write(fileno(in), text, sizes[i]) == (ssize_t)sizes[i]
+                 && lseek(fileno(in), 0, SEEK_SET) == 0
+                 && ftruncate(fileno(err), 0) == 0 && lseek(fileno(err), 0, SEEK_SET) == 0
+                 && run_program(command, &actions);
+            rewind(err);
+            ok = ok && fscanf(err, "memory: peak RSS %zu KiB; %llu allocations, %llu bytes, "
+                              "largest %zu bytes", &peak_kib, &allocations, &allocated,
+                              &largest) == 4;
+            if (ok) {
+                printf("{\"benchmark\": \"memory\", \"variant\": \"stream\", \"input_bytes\": %zu, "
+                       "\"peak_rss_kib\": %zu, \"allocations\": %llu, \"allocated_bytes\": %llu, "
+                       "\"largest_allocation\": %zu, \"budget_kib\": %d}\n", sizes[i], peak_kib,
+                       allocations, allocated, largest, STREAM_BUDGET_KIB);
+                first_allocated = i == 0 ? allocated : first_allocated;
+                if (peak_kib > STREAM_BUDGET_KIB || allocated > first_allocated) {
+                    fprintf(stderr, "streaming %zu bytes took %zu KiB (budget %d KiB) and "
+                            "allocated %llu bytes\n", sizes[i], peak_kib, STREAM_BUDGET_KIB,
+                            allocated);
+                    ok = false;
+                }
+            }
+        }
+        if (saved != NULL) {
+            setenv("SAFECIPHER_THREADS", saved, 1);
+        } else {
+            unsetenv("SAFECIPHER_THREADS");
+        }
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    free(saved);
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (err != NULL) {
+        fclose(err);
+    }
+    return ok;
+}
+
+// runs every benchmark over a buffer of the given size in MiB (default 64)
+int main(int argc, char **argv)
+{
+    size_t mib = 64;
+
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [size in MiB]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2) {
+        char *endptr;
+        long n = strtol(argv[1], &endptr, 10);
+        if (*endptr != '\0' || n <= 0) {
+            fprintf(stderr, "Size must be a positive integer\n");
+            return 1;
+        }
+        mib = (size_t)n;
+    }
+
+    size_t len = mib << 20;
+    char *text = random_text(len);
+    if (text == NULL) {
+        fprintf(stderr, "Could not allocate %zu MiB\n", mib);
+        return 1;
+    }
+
+    bool ok = bench_histogram(text, len) && bench_hill(text, len) && bench_playfair(text, len)
+        && bench_transposition(text, len) && bench_enigma(text, len)
+        && bench_encoding(text, len) && bench_checksum(text, len)
+        && bench_ranges(text, len) && bench_validate(text, len)
+        && bench_stream(text, len)
+        && bench_splice(text, len)
+#ifdef SAFECIPHER_ZLIB
+        && bench_gzip(text, len)
+#endif
+        && bench_scheduler(text, len)
+        && bench_cancel(text, len)
+        && bench_startup()
+        && bench_memory(text, len);
+
+    struct memory_stats stats;
+    memory_stats(&stats);
+    printf("{\"benchmark\": \"memory\", \"variant\": \"all-benchmarks\", \"peak_rss_kib\": %zu, "
+           "\"allocations\": %" PRIu64 ", \"allocated_bytes\": %" PRIu64 ", "
+           "\"largest_allocation\": %zu}\n", stats.peak_rss / 1024, stats.allocations,
+           stats.allocated, stats.largest);
+    free(text);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// the CRC-32C (Castagnoli) polynomial, bit-reversed
+#define   CRC32C_POLY   0x82f63b78u
+
+// bytes per lane of the three-lane hardware loop; a multiple of eight
+#define   CRC_LANE      512
+
+// slicing-by-8 tables for the portable loop, and tables advancing a CRC state over
+// CRC_LANE and 2 * CRC_LANE zero bytes (a linear map, applied a byte of the state at a
+// time) to join the three lanes. Each set is built the first time it is needed, so the
+// hardware loop never builds the slicing tables but to make the shift tables, and short
+// inputs (one-shot CLI runs) build neither
+static struct {
+    uint32_t slice[8][256];
+    uint32_t shift[2][4][256];
+} crc_tables;
+
+static pthread_once_t crc_slice_once = PTHREAD_ONCE_INIT;
+
+// advances the raw CRC state over `len` bytes, eight at a time
+static uint32_t crc32c_scalar(uint32_t state, const unsigned char *p, size_t len)
+{
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t low = state ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8
+                                | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        state = crc_tables.slice[7][low & 0xff] ^ crc_tables.slice[6][low >> 8 & 0xff]
+              ^ crc_tables.slice[5][low >> 16 & 0xff] ^ crc_tables.slice[4][low >> 24]
+              ^ crc_tables.slice[3][p[4]] ^ crc_tables.slice[2][p[5]]
+              ^ crc_tables.slice[1][p[6]] ^ crc_tables.slice[0][p[7]];
+    }
+    for (; len > 0; p++, len--) {
+        state = crc_tables.slice[0][(state ^ *p) & 0xff] ^ state >> 8;
+    }
+    return state;
+}
+
+static void crc_slice_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? c >> 1 ^ CRC32C_POLY : c >> 1;
+        }
+        crc_tables.slice[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = crc_tables.slice[t - 1][i];
+            crc_tables.slice[t][i] = crc_tables.slice[0][c & 0xff] ^ c >> 8;
+        }
+    }
+}
+
+#ifdef SAFECIPHER_X86
+
+static pthread_once_t crc_shift_once = PTHREAD_ONCE_INIT;
+
+static void crc_shift_init(void)
+{
+    static const unsigned char zeros[2 * CRC_LANE];
+
+    pthread_once(&crc_slice_once, crc_slice_init);
+    // the zero-byte shift is linear in the state, so each table entry is the XOR of the
+    // images of its set bits
+    for (int shift = 0; shift < 2; shift++) {
+        uint32_t bit[32];
+        for (int b = 0; b < 32; b++) {
+            bit[b] = crc32c_scalar((uint32_t)1 << b, zeros, (size_t)(shift + 1) * CRC_LANE);
+        }
+        for (int byte = 0; byte < 4; byte++) {
+            for (uint32_t v = 0; v < 256; v++) {
+                uint32_t image = 0;
+                for (int b = 0; b < 8; b++) {
+                    if (v >> b & 1) {
+                        image ^= bit[8 * byte + b];
+                    }
+                }
+                crc_tables.shift[shift][byte][v] = image;
+            }
+        }
+    }
+}
+
+// the state after `shift` (0 for one lane, 1 for two) lanes of zero bytes
+static uint32_t crc_shift(int shift, uint32_t state)
+{
+    return crc_tables.shift[shift][0][state & 0xff] ^ crc_tables.shift[shift][1][state >> 8 & 0xff]
+         ^ crc_tables.shift[shift][2][state >> 16 & 0xff] ^ crc_tables.shift[shift][3][state >> 24];
+}
+
+// advances the raw CRC state with the SSE4.2 instruction; its three-cycle latency would
+// limit one dependency chain to eight bytes per three cycles, so three lanes of each
+// 3 * CRC_LANE bytes run side by side and are joined with the shift tables
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t state, const unsigned char *p, size_t len)
+{
+    uint64_t a = state;
+
+    if (len >= 3 * CRC_LANE) {
+        pthread_once(&crc_shift_once, crc_shift_init);
+    }
+    for (; len >= 3 * CRC_LANE; p += 3 * CRC_LANE, len -= 3 * CRC_LANE) {
+        uint64_t b = 0, c = 0;
+        for (size_t i = 0; i < CRC_LANE; i += 8) {
+            uint64_t x, y, z;
+            memcpy(&x, p + i, 8);
+            memcpy(&y, p + CRC_LANE + i, 8);
+            memcpy(&z, p + 2 * CRC_LANE + i, 8);
+            a = _mm_crc32_u64(a, x);
+            b = _mm_crc32_u64(b, y);
+            c = _mm_crc32_u64(c, z);
+        }
+        a = crc_shift(1, (uint32_t)a) ^ crc_shift(0, (uint32_t)b) ^ (uint32_t)c;
+    }
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t x;
+        memcpy(&x, p, 8);
+        a = _mm_crc32_u64(a, x);
+    }
+    uint32_t s = (uint32_t)a;
+    for (; len > 0; p++, len--) {
+        s = _mm_crc32_u8(s, *p);
+    }
+    return s;
+}
+
+#endif
+
+uint32_t crc32c(uint32_t crc, const char *data, size_t len)
+{
+    uint32_t state = ~crc;
+
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSE42)) {
+        return ~crc32c_sse42(state, (const unsigned char *)data, len);
+    }
+#endif
+    pthread_once(&crc_slice_once, crc_slice_init);
+    return ~crc32c_scalar(state, (const unsigned char *)data, len);
+}
@@ -0,0 +1,1124 @@
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// in-range characters transformed per batch; rounded down to a whole number of blocks
+#define   HILL_CHUNK   4096
+
+// padding around a batch, covering the reach of the vector kernels' loads and stores
+#define   HILL_PAD     8
+
+struct hill_key {
+    size_t n;           // the order of the matrix
+    unsigned m;         // the size of the range (the modulus)
+    uint16_t matrix[HILL_MAX_ORDER][HILL_MAX_ORDER];
+};
+
+// the inverse of `a` modulo `m`, or 0 if `a` has none
+static unsigned modular_inverse(unsigned a, unsigned m)
+{
+    long r0 = (long)m, r1 = (long)(a % m);
+    long t0 = 0, t1 = 1;
+
+    while (r1 != 0) {
+        long q = r0 / r1;
+        long r = r0 - q * r1;
+        long t = t0 - q * t1;
+        r0 = r1;
+        r1 = r;
+        t0 = t1;
+        t1 = t;
+    }
+    if (r0 != 1) {
+        return 0;
+    }
+    return (unsigned)((t0 % (long)m + (long)m) % (long)m);
+}
+
+// reads a key of n * n in-range characters (the matrix, row by row) into `k`
+static bool hill_key_init(struct hill_key *k, char range_low, char range_high, const char *key)
+{
+    size_t len = strlen(key);
+    size_t n = 1;
+
+    while (n * n < len) {
+        n++;
+    }
+    if (len == 0 || n * n != len || n > HILL_MAX_ORDER || range_low >= range_high) {
+        return false;
+    }
+    k->n = n;
+    k->m = (unsigned)(range_high - range_low + 1);
+    for (size_t i = 0; i < len; i++) {
+        if (key[i] < range_low || key[i] > range_high) {
+            return false;
+        }
+        k->matrix[i / n][i % n] = (uint16_t)(key[i] - range_low);
+    }
+    return true;
+}
+
+// replaces the matrix of `k` by its inverse modulo `m`, returning false if it has none
+//
+// Since `m` need not be prime, pivots are not simply scaled to one: each column is first
+// reduced Euclid-style, repeatedly subtracting multiples of one row from another, until a
+// single row holds the gcd of the column. The matrix is invertible exactly when every
+// such pivot is a unit modulo `m`.
+static bool hill_invert(struct hill_key *k)
+{
+    size_t n = k->n;
+    long m = (long)k->m;
+    long a[HILL_MAX_ORDER][2 * HILL_MAX_ORDER];
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            a[i][j] = k->matrix[i][j];
+            a[i][n + j] = i == j;
+        }
+    }
+
+    for (size_t c = 0; c < n; c++) {
+        for (size_t r = c + 1; r < n; r++) {
+            while (a[r][c] != 0) {
+                long q = a[c][c] / a[r][c];
+                for (size_t j = 0; j < 2 * n; j++) {
+                    long v = (a[c][j] - q * a[r][j]) % m;
+                    a[c][j] = a[r][j];
+                    a[r][j] = v < 0 ? v + m : v;
+                }
+            }
+        }
+        unsigned inverse = modular_inverse((unsigned)a[c][c], (unsigned)m);
+        if (inverse == 0) {
+            return false;
+        }
+        for (size_t j = 0; j < 2 * n; j++) {
+            a[c][j] = a[c][j] * (long)inverse % m;
+        }
+        for (size_t r = 0; r < n; r++) {
+            if (r != c && a[r][c] != 0) {
+                long f = a[r][c];
+                for (size_t j = 0; j < 2 * n; j++) {
+                    a[r][j] = ((a[r][j] - f * a[c][j]) % m + m) % m;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            k->matrix[i][j] = (uint16_t)a[i][n + j];
+        }
+    }
+    return true;
+}
+
+// copies the offsets from `range_low` of the in-range characters of `in[*pos..len)` into
+// `vals`, stopping once `max` have been found; advances `*pos` past the last one read
+static size_t range_gather_scalar(char range_low, char range_high, const char *in, size_t len,
+                                 size_t *pos, uint8_t *vals, size_t max)
+{
+    size_t i = *pos, k = 0;
+
+    for (; i < len && k < max; i++) {
+        char c = in[i];
+        vals[k] = (uint8_t)(c - range_low);
+        k += range_low <= c && c <= range_high;
+    }
+    *pos = i;
+    return k;
+}
+
+// copies `in[start..end)` to `out`, replacing the first `count` in-range characters by
+// `range_low` plus the corresponding element of `vals`
+static void range_scatter_scalar(char range_low, char range_high, const char *in, char *out,
+                                size_t start, size_t end, const uint8_t *vals, size_t count)
+{
+    size_t k = 0;
+
+    for (size_t i = start; i < end; i++) {
+        char c = in[i];
+        bool replace = range_low <= c && c <= range_high && k < count;
+        out[i] = replace ? (char)(range_low + vals[k]) : c;
+        k += replace;
+    }
+}
+
+#ifdef SAFECIPHER_X86
+
+// shuffles that move the bytes selected by an 8-bit mask to the front of a vector, and
+// back out again to the positions of the set bits
+struct pack_tables {
+    uint8_t compress[256][16];
+    uint8_t expand[256][16];
+};
+
+static struct pack_tables pack_tables;
+static pthread_once_t pack_once = PTHREAD_ONCE_INIT;
+
+static void pack_init(void)
+{
+    for (unsigned mask = 0; mask < 256; mask++) {
+        unsigned j = 0;
+        memset(pack_tables.compress[mask], 0x80, 16);
+        memset(pack_tables.expand[mask], 0x80, 16);
+        for (unsigned p = 0; p < 8; p++) {
+            if (mask & (1u << p)) {
+                pack_tables.compress[mask][j] = (uint8_t)p;
+                pack_tables.expand[mask][p] = (uint8_t)j;
+                j++;
+            }
+        }
+    }
+}
+
+// `range_gather_scalar`, left-packing the in-range bytes of each half vector with pshufb
+__attribute__((target("ssse3")))
+static size_t range_gather_ssse3(char range_low, char range_high, const char *in, size_t len,
+                                size_t *pos, uint8_t *vals, size_t max)
+{
+    __m128i low = _mm_set1_epi8(range_low);
+    __m128i high = _mm_set1_epi8(range_high);
+    size_t i = *pos, k = 0;
+
+    pthread_once(&pack_once, pack_init);
+    for (; i + 16 <= len && k + 16 <= max; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(in + i));
+        __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpgt_epi8(v, high));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(out_of_range) & 0xFFFF;
+        __m128i offsets = _mm_sub_epi8(v, low);
+        const __m128i *shuffle = (const __m128i *)(const void *)pack_tables.compress;
+
+        _mm_storel_epi64((__m128i *)(void *)(vals + k),
+                         _mm_shuffle_epi8(offsets, _mm_loadu_si128(shuffle + (mask & 0xFF))));
+        k += (size_t)__builtin_popcount(mask & 0xFF);
+        _mm_storel_epi64((__m128i *)(void *)(vals + k),
+                         _mm_shuffle_epi8(_mm_srli_si128(offsets, 8),
+                                          _mm_loadu_si128(shuffle + (mask >> 8))));
+        k += (size_t)__builtin_popcount(mask >> 8);
+    }
+    *pos = i;
+    return k + range_gather_scalar(range_low, range_high, in, len, pos, vals + k, max - k);
+}
+
+// `range_scatter_scalar`, expanding the values back to the in-range positions with pshufb
+__attribute__((target("ssse3")))
+static void range_scatter_ssse3(char range_low, char range_high, const char *in, char *out,
+                               size_t start, size_t end, const uint8_t *vals, size_t count)
+{
+    __m128i low = _mm_set1_epi8(range_low);
+    __m128i high = _mm_set1_epi8(range_high);
+    size_t i = start, k = 0;
+
+    pthread_once(&pack_once, pack_init);
+    for (; i + 16 <= end && k + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(in + i));
+        __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpgt_epi8(v, high));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(out_of_range) & 0xFFFF;
+        const __m128i *shuffle = (const __m128i *)(const void *)pack_tables.expand;
+
+        __m128i a = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(const void *)(vals + k)),
+                                     _mm_loadu_si128(shuffle + (mask & 0xFF)));
+        k += (size_t)__builtin_popcount(mask & 0xFF);
+        __m128i b = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(const void *)(vals + k)),
+                                     _mm_loadu_si128(shuffle + (mask >> 8)));
+        k += (size_t)__builtin_popcount(mask >> 8);
+        __m128i r = _mm_add_epi8(_mm_unpacklo_epi64(a, b), low);
+        _mm_storeu_si128((__m128i *)(void *)(out + i),
+                         _mm_or_si128(_mm_and_si128(out_of_range, v), _mm_andnot_si128(out_of_range, r)));
+    }
+    range_scatter_scalar(range_low, range_high, in, out, i, end, vals + k, count - k);
+}
+
+#endif
+
+// `range_gather_scalar` with the fastest kernel the CPU supports
+static size_t range_gather(char range_low, char range_high, const char *in, size_t len,
+                           size_t *pos, uint8_t *vals, size_t max)
+{
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        return range_gather_ssse3(range_low, range_high, in, len, pos, vals, max);
+    }
+#endif
+    return range_gather_scalar(range_low, range_high, in, len, pos, vals, max);
+}
+
+// `range_scatter_scalar` with the fastest kernel the CPU supports
+static void range_scatter(char range_low, char range_high, const char *in, char *out,
+                          size_t start, size_t end, const uint8_t *vals, size_t count)
+{
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        range_scatter_ssse3(range_low, range_high, in, out, start, end, vals, count);
+        return;
+    }
+#endif
+    range_scatter_scalar(range_low, range_high, in, out, start, end, vals, count);
+}
+
+static void hill_blocks_scalar(const struct hill_key *k, const uint8_t *in, uint8_t *out,
+                               size_t blocks)
+{
+    size_t n = k->n;
+
+    for (size_t b = 0; b < blocks; b++) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned sum = 0;
+            for (size_t j = 0; j < n; j++) {
+                sum += (unsigned)k->matrix[i][j] * in[b * n + j];
+            }
+            out[b * n + i] = (uint8_t)(sum % k->m);
+        }
+    }
+}
+
+#ifdef SAFECIPHER_X86
+
+// whether a row of the product fits the 16-bit lanes of `hill_blocks_ssse3`, which also
+// needs every matrix entry to fit a signed byte
+static bool hill_fits_16(const struct hill_key *k)
+{
+    return k->m <= 128 && k->n * (k->m - 1) * (k->m - 1) <= INT16_MAX;
+}
+
+// multiplies `blocks` consecutive n-element blocks of `in` by the key matrix, eight
+// output characters at a time, without rearranging the blocks
+//
+// Output t = b * n + i is the sum over the diagonals d of K[i][i + d] * in[t + d]. Each
+// adjacent pair of diagonals is one pmaddubsw of the input (shuffled so that each 16-bit
+// lane holds in[t + d] and in[t + d + 1]) against coefficients that repeat with the block
+// phase, zero where a diagonal leaves the matrix. The row sums are reduced modulo `m`
+// together with a multiply-high by 2^16 / m and a single correction.
+//
+// `in` must be readable from `in - (n - 1)` to `in + blocks * n + 24`.
+__attribute__((target("ssse3")))
+static void hill_blocks_ssse3(const struct hill_key *k, const uint8_t *in, uint8_t *out,
+                              size_t blocks)
+{
+    size_t n = k->n, count = blocks * n;
+    __m128i coef[HILL_MAX_ORDER][HILL_MAX_ORDER];
+    __m128i pairs = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8);
+    __m128i m = _mm_set1_epi16((short)k->m);
+    __m128i magic = _mm_set1_epi16((short)(unsigned short)(65536 / k->m + 1));
+
+    // coef[r][e] serves the vector whose first output has block phase r, and pairs the
+    // diagonals 2e - (n - 1) and 2e - (n - 1) + 1
+    for (size_t r = 0; r < n; r++) {
+        for (size_t e = 0; e < n; e++) {
+            signed char lanes[16];
+            for (size_t l = 0; l < 16; l++) {
+                size_t i = (r + l / 2) % n;
+                size_t j = i + 2 * e + l % 2;      // i + d + (n - 1)
+                lanes[l] = (signed char)(j >= n - 1 && j - (n - 1) < n
+                                         ? k->matrix[i][j - (n - 1)] : 0);
+            }
+            coef[r][e] = _mm_loadu_si128((const __m128i *)(const void *)lanes);
+        }
+    }
+
+    size_t phase = 0, step = 8 % n;
+    for (size_t t = 0; t < count; t += 8) {
+        __m128i sum = _mm_setzero_si128();
+        const uint8_t *window = in + t - (n - 1);
+        for (size_t e = 0; e < n; e++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(window + 2 * e));
+            sum = _mm_add_epi16(sum, _mm_maddubs_epi16(_mm_shuffle_epi8(v, pairs), coef[phase][e]));
+        }
+        __m128i q = _mm_mulhi_epu16(sum, magic);
+        __m128i r = _mm_sub_epi16(sum, _mm_mullo_epi16(q, m));
+        r = _mm_add_epi16(r, _mm_and_si128(_mm_cmplt_epi16(r, _mm_setzero_si128()), m));
+        _mm_storel_epi64((__m128i *)(void *)(out + t), _mm_packus_epi16(r, r));
+        phase += step;
+        phase -= phase >= n ? n : 0;
+    }
+}
+
+// the AVX2 version of `hill_blocks_ssse3`, sixteen output characters at a time
+//
+// `in` must be readable from `in - (n - 1)` to `in + blocks * n + 32`.
+__attribute__((target("avx2")))
+static void hill_blocks_avx2(const struct hill_key *k, const uint8_t *in, uint8_t *out,
+                             size_t blocks)
+{
+    size_t n = k->n, count = blocks * n;
+    __m256i coef[HILL_MAX_ORDER][HILL_MAX_ORDER];
+    __m256i pairs = _mm256_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8,
+                                     0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8);
+    __m256i m = _mm256_set1_epi16((short)k->m);
+    __m256i magic = _mm256_set1_epi16((short)(unsigned short)(65536 / k->m + 1));
+
+    for (size_t r = 0; r < n; r++) {
+        for (size_t e = 0; e < n; e++) {
+            signed char lanes[32];
+            for (size_t l = 0; l < 32; l++) {
+                size_t i = (r + l / 2) % n;
+                size_t j = i + 2 * e + l % 2;
+                lanes[l] = (signed char)(j >= n - 1 && j - (n - 1) < n
+                                         ? k->matrix[i][j - (n - 1)] : 0);
+            }
+            coef[r][e] = _mm256_loadu_si256((const __m256i *)(const void *)lanes);
+        }
+    }
+
+    size_t phase = 0, step = 16 % n;
+    for (size_t t = 0; t < count; t += 16) {
+        __m256i sum = _mm256_setzero_si256();
+        const uint8_t *window = in + t - (n - 1);
+        for (size_t e = 0; e < n; e++) {
+            // the upper lane starts eight characters further on
+            __m256i v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(const void *)(window + 2 * e))),
+                _mm_loadu_si128((const __m128i *)(const void *)(window + 2 * e + 8)), 1);
+            sum = _mm256_add_epi16(sum, _mm256_maddubs_epi16(_mm256_shuffle_epi8(v, pairs),
+                                                             coef[phase][e]));
+        }
+        __m256i q = _mm256_mulhi_epu16(sum, magic);
+        __m256i r = _mm256_sub_epi16(sum, _mm256_mullo_epi16(q, m));
+        r = _mm256_add_epi16(r, _mm256_and_si256(_mm256_cmpgt_epi16(_mm256_setzero_si256(), r), m));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), 0x08);
+        _mm_storeu_si128((__m128i *)(void *)(out + t), _mm256_castsi256_si128(packed));
+        phase += step;
+        phase -= phase >= n ? n : 0;
+    }
+}
+
+#endif
+
+// applies the hill cipher with the (possibly inverted) key matrix `k` to `text`
+static void hill_transform(char range_low, char range_high, const struct hill_key *k,
+                           const char *in, char *out, size_t len)
+{
+    // `vals` is padded on both sides for the overlapping loads of the vector kernels
+    uint8_t vals[HILL_PAD + HILL_CHUNK + 4 * HILL_PAD] = {0};
+    uint8_t products[HILL_CHUNK + 2 * HILL_PAD];
+    size_t chunk = HILL_CHUNK / k->n * k->n;
+    size_t pos = 0;
+    void (*blocks_kernel)(const struct hill_key *, const uint8_t *, uint8_t *, size_t) =
+        hill_blocks_scalar;
+
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_AVX2) && hill_fits_16(k)) {
+        blocks_kernel = hill_blocks_avx2;
+    } else if (cpu_supports(CPU_SSSE3) && hill_fits_16(k)) {
+        blocks_kernel = hill_blocks_ssse3;
+    }
+#endif
+    while (pos < len) {
+        size_t start = pos;
+        size_t count = range_gather(range_low, range_high, in, len, &pos, vals + HILL_PAD, chunk);
+        // a partial block can only occur at the end of the text; it passes through
+        size_t blocks = count / k->n;
+        blocks_kernel(k, vals + HILL_PAD, products, blocks);
+        range_scatter(range_low, range_high, in, out, start, pos, products, blocks * k->n);
+    }
+}
+
+// reads `key` into `k`, inverted if decrypting; an encryption key is only usable if it
+// can be inverted again
+static bool hill_prepare(char range_low, char range_high, const char *key, bool decrypt,
+                         struct hill_key *k)
+{
+    struct hill_key inverse;
+
+    if (!hill_key_init(k, range_low, range_high, key)) {
+        return false;
+    }
+    inverse = *k;
+    if (!hill_invert(&inverse)) {
+        return false;
+    }
+    if (decrypt) {
+        *k = inverse;
+    }
+    return true;
+}
+
+static bool hill_cipher(char range_low, char range_high, const char *key, bool decrypt,
+                        const char *in, char *out)
+{
+    struct hill_key k;
+
+    out[0] = '\0';
+    if (!hill_prepare(range_low, range_high, key, decrypt, &k)) {
+        return false;
+    }
+
+    size_t len = strlen(in);
+    hill_transform(range_low, range_high, &k, in, out, len);
+    out[len] = '\0';
+    return true;
+}
+
+// hill cipher encryption
+bool hill_encrypt(char range_low, char range_high, const char *key,
+                  const char *plain_text, char *cipher_text)
+{
+    return hill_cipher(range_low, range_high, key, false, plain_text, cipher_text);
+}
+
+// hill cipher decryption
+bool hill_decrypt(char range_low, char range_high, const char *key,
+                  const char *cipher_text, char *plain_text)
+{
+    return hill_cipher(range_low, range_high, key, true, cipher_text, plain_text);
+}
+
+/* Playfair */
+
+// digraphs are indexed by the offsets of their letters from 'A'
+#define   PLAYFAIR_LETTERS   26
+
+// per-key translation of every digraph, each entry holding the two output letters as
+// `first | second << 8`; zero marks digraphs the cipher never translates (doubled
+// letters, or J, which is merged with I). One extra entry lets a 32-bit gather read the
+// last digraph.
+struct playfair_key {
+    uint16_t table[PLAYFAIR_LETTERS * PLAYFAIR_LETTERS + 1];
+};
+
+// builds the 5x5 grid for `key` and from it the digraph table for one direction
+static bool playfair_key_init(struct playfair_key *k, const char *key, bool decrypt)
+{
+    int row[PLAYFAIR_LETTERS], col[PLAYFAIR_LETTERS];
+    char grid[5][5];
+    bool used[PLAYFAIR_LETTERS] = {false};
+    size_t cells = 0;
+    // the grid is filled from the key, then from the rest of the alphabet
+    static const char alphabet[] = "ABCDEFGHIKLMNOPQRSTUVWXYZ";
+
+    if (key[0] == '\0') {
+        return false;
+    }
+    for (size_t i = 0; key[i] != '\0'; i++) {
+        if (key[i] < 'A' || key[i] > 'Z') {
+            return false;
+        }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (const char *p = pass == 0 ? key : alphabet; *p != '\0'; p++) {
+            int letter = (*p == 'J' ? 'I' : *p) - 'A';
+            if (!used[letter]) {
+                used[letter] = true;
+                grid[cells / 5][cells % 5] = (char)('A' + letter);
+                row[letter] = (int)(cells / 5);
+                col[letter] = (int)(cells % 5);
+                cells++;
+            }
+        }
+    }
+
+    int step = decrypt ? 4 : 1;     // one cell back is four cells forward
+    memset(k->table, 0, sizeof(k->table));
+    for (int a = 0; a < PLAYFAIR_LETTERS; a++) {
+        for (int b = 0; b < PLAYFAIR_LETTERS; b++) {
+            if (a == b || a == 'J' - 'A' || b == 'J' - 'A') {
+                continue;
+            }
+            char x, y;
+            if (row[a] == row[b]) {
+                x = grid[row[a]][(col[a] + step) % 5];
+                y = grid[row[b]][(col[b] + step) % 5];
+            } else if (col[a] == col[b]) {
+                x = grid[(row[a] + step) % 5][col[a]];
+                y = grid[(row[b] + step) % 5][col[b]];
+            } else {
+                x = grid[row[a]][col[b]];
+                y = grid[row[b]][col[a]];
+            }
+            k->table[a * PLAYFAIR_LETTERS + b] = (uint16_t)((unsigned char)x | (unsigned char)y << 8);
+        }
+    }
+    return true;
+}
+
+#ifdef SAFECIPHER_X86
+
+// translates whole vectors of sixteen letters from the start of `in`, eight digraphs
+// at a time with one gather from the table, and returns the number of bytes done; stops
+// at the first vector containing anything but A to Z (after merging J into I when
+// encrypting) or a doubled letter, which the caller handles
+__attribute__((target("avx2")))
+static size_t playfair_avx2(const struct playfair_key *k, bool decrypt, const char *in,
+                            size_t len, char *out, size_t room)
+{
+    __m128i a = _mm_set1_epi8('A');
+    __m128i z = _mm_set1_epi8('Z');
+    __m128i j = _mm_set1_epi8('J');
+    __m128i weights = _mm_setr_epi8(26, 1, 26, 1, 26, 1, 26, 1, 26, 1, 26, 1, 26, 1, 26, 1);
+    size_t i = 0;
+
+    for (; i + 16 <= len && i + 16 <= room; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(in + i));
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, a), _mm_cmpgt_epi8(v, z));
+        __m128i is_j = _mm_cmpeq_epi8(v, j);
+        if (decrypt) {
+            bad = _mm_or_si128(bad, is_j);
+        } else {
+            v = _mm_add_epi8(v, is_j);
+        }
+        // compare the two letters of every digraph
+        __m128i doubled = _mm_cmpeq_epi8(v, _mm_srli_si128(v, 1));
+        if (_mm_movemask_epi8(bad) != 0 || (_mm_movemask_epi8(doubled) & 0x5555) != 0) {
+            break;
+        }
+        __m128i index = _mm_maddubs_epi16(_mm_sub_epi8(v, a), weights);
+        __m256i pairs = _mm256_i32gather_epi32((const int *)(const void *)k->table,
+                                               _mm256_cvtepu16_epi32(index), 2);
+        pairs = _mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(pairs, pairs), 0x08);
+        _mm_storeu_si128((__m128i *)(void *)(out + i), _mm256_castsi256_si128(packed));
+    }
+    return i;
+}
+
+#endif
+
+// the filler separating a doubled letter, or completing a final single letter
+static char playfair_filler(char c)
+{
+    return c == 'X' ? 'Q' : 'X';
+}
+
+// translates the letters A to Z of `in` a digraph at a time, copying everything else in
+// place; when encrypting, J is read as I and fillers are inserted as needed, and when
+// decrypting, text the encryption could not have produced is rejected
+static bool playfair_cipher(const char *key, bool decrypt, const char *in, char *out,
+                            size_t out_size)
+{
+    struct playfair_key k;
+    size_t len = strlen(in);
+    size_t o = 0;           // output position
+    size_t slot = 0;        // where the translation of the pending letter goes
+    char pending = 0;       // the first letter of an incomplete digraph, if any
+
+    if (out_size == 0) {
+        return false;
+    }
+    out[0] = '\0';
+    if (!playfair_key_init(&k, key, decrypt)) {
+        return false;
+    }
+#ifdef SAFECIPHER_X86
+    bool vector = cpu_supports(CPU_AVX2);
+    size_t backoff = 16;
+#endif
+
+    for (size_t i = 0; i < len; ) {
+        size_t stop = len;
+#ifdef SAFECIPHER_X86
+        if (vector && pending == 0) {
+            size_t done = playfair_avx2(&k, decrypt, in + i, len - i, out + o, out_size - 1 - o);
+            i += done;
+            o += done;
+            // text that is not a run of bare letters (such as words with spaces) keeps
+            // failing the vector check, so back off from retrying it
+            backoff = done > 0 ? 16 : backoff < 128 ? 2 * backoff : backoff;
+        }
+        // the scalar loop takes at least `backoff` characters before trying again, and
+        // then finishes any digraph it has started so that the vectors stay aligned
+        stop = len - i > backoff ? i + backoff : len;
+#endif
+        for (; i < len && (i < stop || pending != 0); i++) {
+            char c = in[i];
+            // leave room for the terminating null character
+            if (o + 1 >= out_size) {
+                out[0] = '\0';
+                return false;
+            }
+            if (c < 'A' || c > 'Z') {
+                out[o++] = c;
+                continue;
+            }
+            if (c == 'J') {
+                if (decrypt) {
+                    out[0] = '\0';
+                    return false;
+                }
+                c = 'I';
+            }
+            if (pending == 0) {
+                pending = c;
+                slot = o++;
+                continue;
+            }
+            char second = c;
+            if (c == pending) {
+                if (decrypt || o + 2 >= out_size) {
+                    out[0] = '\0';
+                    return false;
+                }
+                second = playfair_filler(c);
+            }
+            uint16_t t = k.table[(pending - 'A') * PLAYFAIR_LETTERS + (second - 'A')];
+            out[slot] = (char)(t & 0xFF);
+            out[o++] = (char)(t >> 8);
+            if (c == pending) {
+                // the repeated letter starts the next digraph
+                slot = o++;
+            } else {
+                pending = 0;
+            }
+        }
+    }
+
+    if (pending != 0) {
+        if (decrypt || o + 1 >= out_size) {
+            out[0] = '\0';
+            return false;
+        }
+        uint16_t t = k.table[(pending - 'A') * PLAYFAIR_LETTERS + (playfair_filler(pending) - 'A')];
+        out[slot] = (char)(t & 0xFF);
+        out[o++] = (char)(t >> 8);
+    }
+    out[o] = '\0';
+    return true;
+}
+
+// playfair cipher encryption
+bool playfair_encrypt(const char *key, const char *plain_text, char *cipher_text,
+                      size_t cipher_size)
+{
+    return playfair_cipher(key, false, plain_text, cipher_text, cipher_size);
+}
+
+// playfair cipher decryption
+bool playfair_decrypt(const char *key, const char *cipher_text, char *plain_text)
+{
+    return playfair_cipher(key, true, cipher_text, plain_text, strlen(cipher_text) + 1);
+}
+
+/* Transposition */
+
+// texts up to this many in-range characters keep their permutation in the cache
+#define   PERMUTATION_CACHE_MAX     (1 << 20)
+
+// the number of permutations the cache holds
+#define   PERMUTATION_CACHE_SIZE    8
+
+// an index permutation for one transposition of one text length: character j of the
+// output is character index[j] of the input
+struct permutation {
+    enum cipher_kind kind;
+    size_t size;            // rails or columns
+    size_t len;
+    bool decrypt;
+    uint32_t *index;
+    size_t refs;            // users, plus one while the permutation is cached
+    unsigned long long used;    // when it was last handed out, for eviction
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct permutation *entries[PERMUTATION_CACHE_SIZE];
+    unsigned long long clock;
+} permutation_cache = { PTHREAD_MUTEX_INITIALIZER, {NULL}, 0 };
+
+// the input position of each output position of a rail fence with `rails` rails
+static void rail_fence_order(size_t rails, size_t len, uint32_t *index)
+{
+    size_t period = 2 * (rails - 1);
+    size_t j = 0;
+
+    for (size_t rail = 0; rail < rails; rail++) {
+        for (size_t base = 0; base < len; base += period) {
+            if (base + rail < len) {
+                index[j++] = (uint32_t)(base + rail);
+            }
+            // the middle rails are visited twice per period, going down and coming up
+            if (rail != 0 && rail != rails - 1 && base + period - rail < len) {
+                index[j++] = (uint32_t)(base + period - rail);
+            }
+        }
+    }
+}
+
+// the input position of each output position of a clockwise spiral, starting at the top
+// left, through the text written row by row into a grid `columns` wide; the cells of an
+// incomplete last row are skipped
+static void route_order(size_t columns, size_t len, uint32_t *index)
+{
+    size_t rows = (len + columns - 1) / columns;
+    size_t top = 0, bottom = rows, left = 0, right = columns;
+    size_t j = 0;
+
+    while (top < bottom && left < right) {
+        for (size_t c = left; c < right; c++) {
+            if (top * columns + c < len) {
+                index[j++] = (uint32_t)(top * columns + c);
+            }
+        }
+        for (size_t r = top + 1; r < bottom; r++) {
+            if (r * columns + right - 1 < len) {
+                index[j++] = (uint32_t)(r * columns + right - 1);
+            }
+        }
+        if (bottom - 1 > top) {
+            for (size_t c = right - 1; c-- > left; ) {
+                if ((bottom - 1) * columns + c < len) {
+                    index[j++] = (uint32_t)((bottom - 1) * columns + c);
+                }
+            }
+        }
+        if (right - 1 > left) {
+            for (size_t r = bottom - 1; r-- > top + 1; ) {
+                if (r * columns + left < len) {
+                    index[j++] = (uint32_t)(r * columns + left);
+                }
+            }
+        }
+        top++;
+        bottom--;
+        left++;
+        right--;
+    }
+}
+
+// computes the permutation for a transposition step, or returns null if memory could not
+// be allocated
+static struct permutation *permutation_create(enum cipher_kind kind, size_t size, size_t len,
+                                              bool decrypt)
+{
+    struct permutation *p = mem_malloc(sizeof(*p));
+    uint32_t *order = mem_malloc((len + 1) * sizeof(uint32_t));
+    uint32_t *index = decrypt ? mem_malloc((len + 1) * sizeof(uint32_t)) : order;
+
+    if (p == NULL || order == NULL || index == NULL) {
+        free(p);
+        free(order);
+        if (decrypt) {
+            free(index);
+        }
+        return NULL;
+    }
+    if (kind == CIPHER_RAIL_FENCE) {
+        rail_fence_order(size, len, order);
+    } else {
+        route_order(size, len, order);
+    }
+    if (decrypt) {
+        // decryption puts character j back where encryption took it from
+        for (size_t j = 0; j < len; j++) {
+            index[order[j]] = (uint32_t)j;
+        }
+        free(order);
+    }
+    p->kind = kind;
+    p->size = size;
+    p->len = len;
+    p->decrypt = decrypt;
+    p->index = index;
+    p->refs = 1;
+    p->used = 0;
+    return p;
+}
+
+static void permutation_release(struct permutation *p)
+{
+    pthread_mutex_lock(&permutation_cache.lock);
+    bool last = --p->refs == 0;
+    pthread_mutex_unlock(&permutation_cache.lock);
+    if (last) {
+        free(p->index);
+        free(p);
+    }
+}
+
+// returns the permutation for a transposition step, from the cache if a text of the same
+// length was transposed the same way recently; release it with `permutation_release`
+static struct permutation *permutation_get(enum cipher_kind kind, size_t size, size_t len,
+                                           bool decrypt)
+{
+    if (len > PERMUTATION_CACHE_MAX) {
+        return permutation_create(kind, size, len, decrypt);
+    }
+
+    pthread_mutex_lock(&permutation_cache.lock);
+    for (size_t i = 0; i < PERMUTATION_CACHE_SIZE; i++) {
+        struct permutation *p = permutation_cache.entries[i];
+        if (p != NULL && p->kind == kind && p->size == size && p->len == len
+            && p->decrypt == decrypt) {
+            p->refs++;
+            p->used = ++permutation_cache.clock;
+            pthread_mutex_unlock(&permutation_cache.lock);
+            return p;
+        }
+    }
+    pthread_mutex_unlock(&permutation_cache.lock);
+
+    struct permutation *p = permutation_create(kind, size, len, decrypt);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    // replace the least recently used entry (another thread may have added the same
+    // permutation meanwhile, which only costs a duplicate entry)
+    struct permutation *evicted;
+    size_t victim = 0;
+    pthread_mutex_lock(&permutation_cache.lock);
+    for (size_t i = 0; i < PERMUTATION_CACHE_SIZE; i++) {
+        struct permutation *e = permutation_cache.entries[i];
+        if (e == NULL) {
+            victim = i;
+            break;
+        }
+        if (e->used < permutation_cache.entries[victim]->used) {
+            victim = i;
+        }
+    }
+    evicted = permutation_cache.entries[victim];
+    permutation_cache.entries[victim] = p;
+    p->refs++;
+    p->used = ++permutation_cache.clock;
+    pthread_mutex_unlock(&permutation_cache.lock);
+    if (evicted != NULL) {
+        permutation_release(evicted);
+    }
+    return p;
+}
+
+#ifdef SAFECIPHER_X86
+
+// `dst[j] = src[index[j]]`, sixteen characters per pair of gathers; `src` must have
+// three readable bytes past its end
+__attribute__((target("avx2")))
+static void permute_avx2(const uint32_t *index, const char *src, char *dst, size_t len)
+{
+    __m256i low_byte = _mm256_set1_epi32(0xFF);
+    size_t j = 0;
+
+    for (; j + 16 <= len; j += 16) {
+        __m256i a = _mm256_i32gather_epi32((const int *)(const void *)src,
+                                           _mm256_loadu_si256((const __m256i *)(const void *)(index + j)), 1);
+        __m256i b = _mm256_i32gather_epi32((const int *)(const void *)src,
+                                           _mm256_loadu_si256((const __m256i *)(const void *)(index + j + 8)), 1);
+        // 32-bit lanes a0-7, b0-7 -> 16-bit a0-3 b0-3 | a4-7 b4-7 -> a0-7 | b0-7 -> bytes
+        __m256i words = _mm256_packus_epi32(_mm256_and_si256(a, low_byte), _mm256_and_si256(b, low_byte));
+        words = _mm256_permute4x64_epi64(words, 0xD8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                         _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128((__m128i *)(void *)(dst + j), bytes);
+    }
+    for (; j < len; j++) {
+        dst[j] = src[index[j]];
+    }
+}
+
+#endif
+
+static void permute(const uint32_t *index, const char *src, char *dst, size_t len)
+{
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_AVX2)) {
+        permute_avx2(index, src, dst, len);
+        return;
+    }
+#endif
+    for (size_t j = 0; j < len; j++) {
+        dst[j] = src[index[j]];
+    }
+}
+
+// the rail fence without a permutation, for texts too long to cache one: the input is
+// walked in order while each rail's output (or input, when decrypting) advances as a
+// separate sequential stream, so every access stays cache-friendly however long the text
+static bool rail_fence_stream(size_t rails, bool decrypt, const char *src, char *dst, size_t len)
+{
+    size_t period = 2 * (rails - 1);
+    size_t *next = mem_calloc(rails, sizeof(size_t));
+    size_t *rail_of = mem_malloc(period * sizeof(size_t));
+
+    if (next == NULL || rail_of == NULL) {
+        free(next);
+        free(rail_of);
+        return false;
+    }
+    for (size_t r = 0; r < period; r++) {
+        rail_of[r] = r < rails ? r : period - r;
+    }
+    // each rail starts where the ones above it end
+    for (size_t i = 0, phase = 0; i < len; i++) {
+        if (rail_of[phase] + 1 < rails) {
+            next[rail_of[phase] + 1]++;
+        }
+        phase = phase + 1 == period ? 0 : phase + 1;
+    }
+    for (size_t r = 1; r < rails; r++) {
+        next[r] += next[r - 1];
+    }
+    for (size_t i = 0, phase = 0; i < len; i++) {
+        size_t slot = next[rail_of[phase]]++;
+        if (decrypt) {
+            dst[i] = src[slot];
+        } else {
+            dst[slot] = src[i];
+        }
+        phase = phase + 1 == period ? 0 : phase + 1;
+    }
+    free(next);
+    free(rail_of);
+    return true;
+}
+
+// applies one transposition step to the `len` characters of `src`, writing `dst`
+static bool transpose(enum cipher_kind kind, size_t size, bool decrypt,
+                      const char *src, char *dst, size_t len)
+{
+    if (size == 1 || len == 0 || (kind == CIPHER_RAIL_FENCE && size >= len)) {
+        // a single rail or column, or more rails than characters, changes nothing
+        memcpy(dst, src, len);
+        return true;
+    }
+    if (kind == CIPHER_RAIL_FENCE && len > PERMUTATION_CACHE_MAX) {
+        return rail_fence_stream(size, decrypt, src, dst, len);
+    }
+
+    struct permutation *p = permutation_get(kind, size, len, decrypt);
+    if (p == NULL) {
+        return false;
+    }
+    permute(p->index, src, dst, len);
+    permutation_release(p);
+    return true;
+}
+
+/* Pipelines */
+
+// checks that a step can be applied over the given range
+static bool cipher_step_valid(char range_low, char range_high, const struct cipher_step *step)
+{
+    switch (step->kind) {
+    case CIPHER_CAESAR:
+        return true;
+    case CIPHER_VIGENERE:
+        if (step->key == NULL || step->key[0] == '\0') {
+            return false;
+        }
+        for (const char *c = step->key; *c != '\0'; c++) {
+            if (*c < range_low || *c > range_high) {
+                return false;
+            }
+        }
+        return true;
+    case CIPHER_HILL:
+        return step->key != NULL;
+    case CIPHER_RAIL_FENCE:
+    case CIPHER_ROUTE:
+        return step->size >= 1 && step->size <= UINT32_MAX;
+    }
+    return false;
+}
+
+// pipeline of ciphers over the in-range characters
+bool cipher_pipeline(char range_low, char range_high, const struct cipher_step *steps,
+                     size_t count, bool decrypt, const char *in, char *out)
+{
+    size_t len = strlen(in);
+
+    out[0] = '\0';
+    // permutation indices are 32-bit, and signed for the gathers
+    if (range_low >= range_high || len > INT32_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!cipher_step_valid(range_low, range_high, &steps[i])) {
+            return false;
+        }
+    }
+
+    // the in-range characters are gathered once, every step runs over them as one
+    // contiguous buffer, and they are scattered back once; padded for vector loads
+    char *text = mem_malloc(len + 16);
+    char *spare = mem_malloc(len + 16);
+    bool ok = text != NULL && spare != NULL;
+    size_t pos = 0, n = 0;
+
+    if (ok) {
+        n = range_gather(range_low, range_high, in, len, &pos, (uint8_t *)text, len);
+        memset(text + n, 0, 16);
+        memset(spare + n, 0, 16);
+        for (size_t i = 0; i < n; i++) {
+            text[i] = (char)(range_low + (unsigned char)text[i]);
+        }
+    }
+    for (size_t s = 0; ok && s < count; s++) {
+        // decryption undoes the steps in reverse order
+        const struct cipher_step *step = &steps[decrypt ? count - 1 - s : s];
+        struct hill_key k;
+        switch (step->kind) {
+        case CIPHER_CAESAR: {
+            // reduced before negating, so INT_MIN cannot overflow
+            int shift = step->shift % (range_high - range_low + 1);
+            caesar_transform(range_low, range_high, decrypt ? -shift : shift, text, text, n);
+            break;
+        }
+        case CIPHER_VIGENERE:
+            vigenere_transform(range_low, range_high, step->key, strlen(step->key), 0,
+                               decrypt, text, text, n);
+            break;
+        case CIPHER_HILL:
+            ok = hill_prepare(range_low, range_high, step->key, decrypt, &k);
+            if (ok) {
+                hill_transform(range_low, range_high, &k, text, text, n);
+            }
+            break;
+        case CIPHER_RAIL_FENCE:
+        case CIPHER_ROUTE:
+            ok = transpose(step->kind, step->size, decrypt, text, spare, n);
+            if (ok) {
+                char *t = text;
+                text = spare;
+                spare = t;
+            }
+            break;
+        }
+    }
+    if (ok) {
+        for (size_t i = 0; i < n; i++) {
+            text[i] = (char)(text[i] - range_low);
+        }
+        range_scatter(range_low, range_high, in, out, 0, len, (const uint8_t *)text, n);
+        out[len] = '\0';
+    }
+    free(text);
+    free(spare);
+    return ok;
+}
+
+// rail fence cipher encryption
+bool rail_fence_encrypt(char range_low, char range_high, size_t rails,
+                        const char *plain_text, char *cipher_text)
+{
+    struct cipher_step step = { .kind = CIPHER_RAIL_FENCE, .size = rails };
+    return cipher_pipeline(range_low, range_high, &step, 1, false, plain_text, cipher_text);
+}
+
+// rail fence cipher decryption
+bool rail_fence_decrypt(char range_low, char range_high, size_t rails,
+                        const char *cipher_text, char *plain_text)
+{
+    struct cipher_step step = { .kind = CIPHER_RAIL_FENCE, .size = rails };
+    return cipher_pipeline(range_low, range_high, &step, 1, true, cipher_text, plain_text);
+}
+
+// route cipher encryption
+bool route_encrypt(char range_low, char range_high, size_t columns,
+                   const char *plain_text, char *cipher_text)
+{
+    struct cipher_step step = { .kind = CIPHER_ROUTE, .size = columns };
+    return cipher_pipeline(range_low, range_high, &step, 1, false, plain_text, cipher_text);
+}
+
+// route cipher decryption
+bool route_decrypt(char range_low, char range_high, size_t columns,
+                   const char *cipher_text, char *plain_text)
+{
+    struct cipher_step step = { .kind = CIPHER_ROUTE, .size = columns };
+    return cipher_pipeline(range_low, range_high, &step, 1, true, cipher_text, plain_text);
+}
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "crypto.h"
 
 #include <stdio.h>
@@ -6,51 +8,353 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
 
+// the range without --range, and the only one Playfair and Enigma work in
 #define   RANGE_LOW   'A'
 #define   RANGE_HIGH  'Z'
 
+// the most crib matches printed by vigenere-crib
+#define   CRIB_PRINT_MAX  64
+
+// the number of candidate keys printed by vigenere-brute
+#define   BRUTE_FORCE_PRINT_MAX  10
+
+// requests read and run together in batch mode, and the size of its arena's blocks
+#define   BATCH_REQUESTS  256
+#define   BATCH_BLOCK     (1 << 20)
+
+// the most requests one batch-mode client may have running, and the bytes each client
+// runs per scheduling turn
+#define   BATCH_CLIENT_LIMIT  64
+#define   BATCH_QUANTUM       (64 << 10)
+
+// options given before the operation
+struct options {
+    bool utf8;      // validate the message as UTF-8, passing non-ASCII characters through
+    size_t rails;   // if non-zero, follow the substitution with a rail fence of this many rails
+    size_t route;   // if non-zero, follow it with a route cipher this many columns wide
+    bool encoded;   // ciphertext is written and read in `encoding`
+    enum text_encoding encoding;
+    bool checksum;  // report the CRC-32C of the input and output
+    bool stream;    // transform standard input instead of a message argument
+    bool splice;    // with `stream`, splice the output into a pipe instead of copying it
+    bool gzip;      // with `stream`, the input and output are gzip
+    size_t shard;   // with `shards` non-zero, transform this shard of the message file
+    size_t shards;
+    const char *index;  // the rank index of the message file for `shard`, if any
+    bool batch;     // run requests read from standard input, one per line
+    bool stats;     // report memory (and batch allocation) statistics on standard error
+    size_t timeout; // if non-zero, the milliseconds a batch request may take
+    const char *trace;  // if not NULL, where trace events are dumped on SIGUSR1 and at exit
+    const char *range;  // the --range given, if any
+    char range_low;     // the characters substitutions and transpositions act on
+    char range_high;
+};
+
+// the alphabets --range accepts by name
+static const struct {
+    const char *name;
+    char low, high;
+} named_ranges[] = {
+    { "upper", 'A', 'Z' },
+    { "lower", 'a', 'z' },
+    { "digits", '0', '9' },
+    { "printable", ' ', '~' },
+    { "rot47", '!', '~' },
+};
 
 
 // checks if a string contains any whitespace
 bool containsWhitespace(const char *str) {
-    while (*str) {
-        if (isspace((unsigned char)*str)) {
+    size_t len = strlen(str);
+    return whitespace_check(str, len) < len;
+}
+
+// checks that characters in a string are within the required range; if not, and `what`
+// is not NULL, reports the first that is not, as a character of `what`
+bool validate_key_characters(char range_low, char range_high, const char *what,
+                             const char *str) {
+    size_t len = strlen(str);
+    size_t invalid = range_check(range_low, range_high, str, len);
+    if (invalid < len && what != NULL) {
+        fprintf(stderr, "%s characters must be in the range '%c'->'%c' (character %zu is not)\n",
+                what, range_low, range_high, invalid + 1);
+    }
+    return invalid == len;
+}
+
+// parses a positive integer that fits in 32 bits
+// returns false if the string is anything else
+bool parse_size(const char *str, size_t *value) {
+    char *endptr;
+    long num = strtol(str, &endptr, 10);
+
+    if (*endptr != '\0' || containsWhitespace(str) || num < 1 || num > INT32_MAX) {
+        return false;
+    }
+    *value = (size_t)num;
+    return true;
+}
+
+// parses a shard as "i/N", with i from 0 to N - 1
+// returns false if the string is anything else
+bool parse_shard(const char *str, size_t *shard, size_t *shards) {
+    char *endptr;
+    long num = strtol(str, &endptr, 10);
+
+    if (endptr == str || *endptr != '/' || num < 0 || !parse_size(endptr + 1, shards)
+        || (size_t)num >= *shards || containsWhitespace(str)) {
+        return false;
+    }
+    *shard = (size_t)num;
+    return true;
+}
+
+// parses one end of a range: a printable ASCII character, bare or in single quotes,
+// advancing `*str` past it
+// returns false if there is no such character
+bool parse_range_end(const char **str, char *c) {
+    const char *p = *str;
+    bool quoted = p[0] == '\'' && p[1] != '\0' && p[2] == '\'';
+    char end = quoted ? p[1] : p[0];
+
+    if (end < ' ' || end > '~') {
+        return false;
+    }
+    *c = end;
+    *str = p + (quoted ? 3 : 1);
+    return true;
+}
+
+// parses a range as one of named_ranges, or as "<low>-<high>" (such as "a-z" or
+// "' '-'~'"), with low before high
+// returns false if the string is anything else
+bool parse_range(const char *str, char *low, char *high) {
+    for (size_t i = 0; i < sizeof(named_ranges) / sizeof(named_ranges[0]); i++) {
+        if (strcmp(str, named_ranges[i].name) == 0) {
+            *low = named_ranges[i].low;
+            *high = named_ranges[i].high;
             return true;
         }
-        str++;
     }
-    return false;
+    return parse_range_end(&str, low) && *str++ == '-' && parse_range_end(&str, high)
+           && *str == '\0' && *low < *high;
 }
 
-// checks that characters in a string are within the required range
-bool validate_key_characters(const char *str) {
-    while (*str) {
-        if (*str < RANGE_LOW || *str > RANGE_HIGH) {
-            return false;
+// whether `operation` is a Caesar or Vigenere encryption or decryption, the only
+// operations --stream, --shard, --encoding and --checksum apply to
+bool is_substitution(const char *operation) {
+    return strcmp(operation, "caesar-encrypt") == 0 || strcmp(operation, "caesar-decrypt") == 0
+           || strcmp(operation, "vigenere-encrypt") == 0
+           || strcmp(operation, "vigenere-decrypt") == 0;
+}
+
+// returns the first option given that batch mode does not take, or NULL if there is none
+const char *batch_rejected_option(const struct options *opts) {
+    const struct {
+        bool given;
+        const char *name;
+    } options[] = {
+        { opts->utf8, "--utf8" },         { opts->rails != 0, "--rails" },
+        { opts->route != 0, "--route" },  { opts->encoded, "--encoding" },
+        { opts->checksum, "--checksum" }, { opts->stream, "--stream" },
+        { opts->shards != 0, "--shard" }, { opts->splice, "--splice" },
+        { opts->gzip, "--gzip" },         { opts->index != NULL, "--index" },
+    };
+
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        if (options[i].given) {
+            return options[i].name;
         }
-        str++;
     }
-    return true;
+    return NULL;
+}
+
+// reports a Hill key that is not a matrix of the range's characters invertible modulo
+// the range's size
+void report_hill_key(const struct options *opts) {
+    fprintf(stderr, "Key must be n * n characters (n at most %d) forming a matrix "
+            "invertible mod %d\n", HILL_MAX_ORDER, opts->range_high - opts->range_low + 1);
+}
+
+// runs a substitution step followed by the transpositions given as options through a
+// single cipher pipeline (undoing them in reverse order when decrypting)
+// prints the resulting text
+int run_pipeline(const struct options *opts, struct cipher_step substitution, bool encrypt,
+                 const char *message) {
+    struct cipher_step steps[3] = { substitution };
+    size_t count = 1;
+
+    if (opts->utf8 && !utf8_validate(message, strlen(message))) {
+        fprintf(stderr, "Message is not valid UTF-8\n");
+        return 1;
+    }
+    if (opts->rails != 0) {
+        steps[count++] = (struct cipher_step){ .kind = CIPHER_RAIL_FENCE, .size = opts->rails };
+    }
+    if (opts->route != 0) {
+        steps[count++] = (struct cipher_step){ .kind = CIPHER_ROUTE, .size = opts->route };
+    }
+
+    char result_text[strlen(message) + 1];
+    if (!cipher_pipeline(opts->range_low, opts->range_high, steps, count, !encrypt, message, result_text)) {
+        // the pipeline checks a Hill key as it reaches the step
+        if (substitution.kind == CIPHER_HILL) {
+            report_hill_key(opts);
+        } else {
+            fprintf(stderr, "Cipher pipeline failed\n");
+        }
+        return 1;
+    }
+
+    printf("%s\n", result_text);
+
+    return 0;
+}
+
+// prints the checksums of a substitution on standard error, after its output
+void print_checksums(const struct cipher_checksums *checksums) {
+    fflush(stdout);
+    fprintf(stderr, "crc32c input %08" PRIx32 " output %08" PRIx32 "\n",
+            checksums->input, checksums->output);
+}
+
+// transforms shard `opts->shard` of the file `path` to standard output (using the rank
+// index `opts->index` if given)
+int run_shard(const struct options *opts, struct cipher_step step, bool encrypt,
+              const char *path) {
+    struct cipher_checksums checksums;
+    int in_fd = open(path, O_RDONLY);
+    int index_fd = opts->index != NULL ? open(opts->index, O_RDONLY) : -1;
+
+    if (in_fd < 0 || (opts->index != NULL && index_fd < 0)) {
+        fprintf(stderr, "Cannot open %s: %s\n", in_fd < 0 ? path : opts->index, strerror(errno));
+        if (in_fd >= 0) {
+            close(in_fd);
+        }
+        return 1;
+    }
+    fflush(stdout);
+    errno = 0;
+    bool ok = cipher_shard(opts->range_low, opts->range_high, &step, !encrypt, in_fd, opts->shard,
+                           opts->shards, index_fd, STDOUT_FILENO, &checksums);
+    if (!ok) {
+        fprintf(stderr, "Shard failed: %s\n",
+                errno != 0 ? strerror(errno) : "not a regular file, or the index does not match it");
+    } else if (opts->checksum) {
+        print_checksums(&checksums);
+    }
+    close(in_fd);
+    if (index_fd >= 0) {
+        close(index_fd);
+    }
+    return ok ? 0 : 1;
+}
+
+// runs a Caesar or Vigenere step through cipher_substitute or cipher_stream, for the
+// options they support: with --stream, standard input is transformed to standard output;
+// (with --gzip, decompressing it and compressing the result);
+// with --shard, the message names a file, one shard of which is transformed to standard
+// output;
+// with an encoding, encryption prints the ciphertext encoded and decryption decodes the
+// message and prints the plaintext as raw bytes; with checksums, the CRC-32C of the
+// input and output follow on standard error
+int run_substitution(const struct options *opts, struct cipher_step step, bool encrypt,
+                     const char *message) {
+    struct cipher_checksums checksums;
+
+    if (opts->stream) {
+        fflush(stdout);
+        if (opts->gzip) {
+            if (!cipher_stream_gzip(opts->range_low, opts->range_high, &step, !encrypt, STDIN_FILENO,
+                                    STDOUT_FILENO, -1, &checksums)) {
+                fprintf(stderr, "Stream failed: the input is not valid gzip, or a read or "
+                        "write failed\n");
+                return 1;
+            }
+        } else if (!cipher_stream(opts->range_low, opts->range_high, &step, !encrypt, STDIN_FILENO,
+                                  STDOUT_FILENO, opts->splice, &checksums)) {
+            fprintf(stderr, "Stream failed: %s\n", strerror(errno));
+            return 1;
+        }
+        if (opts->checksum) {
+            print_checksums(&checksums);
+        }
+        return 0;
+    }
+    if (opts->shards != 0) {
+        return run_shard(opts, step, encrypt, message);
+    }
+
+    enum text_encoding encoding = opts->encoded ? opts->encoding : ENCODING_NONE;
+    size_t len = strlen(message);
+    size_t result_size = (encrypt ? encoded_length(encoding, len)
+                                  : decoded_length(encoding, len)) + 1;
+    char *result_text = malloc(result_size);
+
+    if (result_text == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    size_t written = cipher_substitute(opts->range_low, opts->range_high, &step, !encrypt, message, len,
+                                       encoding, result_text, &checksums);
+    if (written == SIZE_MAX) {
+        fprintf(stderr, "Message is not valid %s\n",
+                opts->encoding == ENCODING_HEX ? "hex" : "base64");
+        free(result_text);
+        return 1;
+    }
+
+    fwrite(result_text, 1, written, stdout);
+    putchar('\n');
+    if (opts->checksum) {
+        print_checksums(&checksums);
+    }
+    free(result_text);
+
+    return 0;
 }
 
 // handles case where a vigenere encryption/decryption is required
 // validates that all characters in key are within range
 // calls the vigenere encrypt/decrypt function as needed
 // prints the resulting text
-int handle_vigenere(const char *operation, const char *key_str, const char *message) {
-    // rejects any key with characters out of the range 'A'->'Z'
-    if (!validate_key_characters(key_str)) {
-        fprintf(stderr, "Key characters must be in the range 'A'->'Z'\n");
+int handle_vigenere(const struct options *opts, const char *operation, const char *key_str,
+                    const char *message) {
+    // rejects any key with characters out of the range
+    if (!validate_key_characters(opts->range_low, opts->range_high, "Key", key_str)) {
         return 1;
     }
 
+    bool encrypt = strcmp(operation, "vigenere-encrypt") == 0;
+    if (opts->stream || opts->shards != 0 || opts->encoded || opts->checksum) {
+        struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = key_str };
+        return run_substitution(opts, step, encrypt, message);
+    }
+    if (opts->rails != 0 || opts->route != 0) {
+        struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = key_str };
+        return run_pipeline(opts, step, encrypt, message);
+    }
+
     char result_text[strlen(message) + 1];
 
-    if (strcmp(operation, "vigenere-encrypt") == 0) {
-        vigenere_encrypt(RANGE_LOW, RANGE_HIGH, key_str, message, result_text);
+    if (opts->utf8) {
+        bool valid = encrypt
+            ? vigenere_encrypt_utf8(opts->range_low, opts->range_high, key_str, message, result_text)
+            : vigenere_decrypt_utf8(opts->range_low, opts->range_high, key_str, message, result_text);
+        if (!valid) {
+            fprintf(stderr, "Message is not valid UTF-8\n");
+            return 1;
+        }
+    } else if (encrypt) {
+        vigenere_encrypt(opts->range_low, opts->range_high, key_str, message, result_text);
     } else {
-        vigenere_decrypt(RANGE_LOW, RANGE_HIGH, key_str, message, result_text);
+        vigenere_decrypt(opts->range_low, opts->range_high, key_str, message, result_text);
     }
 
     printf("%s\n", result_text);
@@ -62,7 +366,8 @@ int handle_vigenere(const char *operation, const char *key_str, const char *mess
 // validates that key is an appropriate integer
 // calls the caesar encrypt/decrypt function as needed
 // prints the resulting text
-int handle_caesar(const char *operation, const char *key_str, const char *message) {
+int handle_caesar(const struct options *opts, const char *operation, const char *key_str,
+                  const char *message) {
     char *endptr;
     long int num = strtol(key_str, &endptr, 10);
 
@@ -75,14 +380,67 @@ int handle_caesar(const char *operation, const char *key_str, const char *messag
     }
 
     // allows key to wrap if it is outside required range
-    int key_int = ((int)num) % (RANGE_HIGH - RANGE_LOW + 1);
+    int key_int = ((int)num) % (opts->range_high - opts->range_low + 1);
+
+    bool encrypt = strcmp(operation, "caesar-encrypt") == 0;
+    if (opts->stream || opts->shards != 0 || opts->encoded || opts->checksum) {
+        struct cipher_step step = { .kind = CIPHER_CAESAR, .shift = key_int };
+        return run_substitution(opts, step, encrypt, message);
+    }
+    if (opts->rails != 0 || opts->route != 0) {
+        struct cipher_step step = { .kind = CIPHER_CAESAR, .shift = key_int };
+        return run_pipeline(opts, step, encrypt, message);
+    }
 
     char result_text[strlen(message) + 1];
 
-    if (strcmp(operation, "caesar-encrypt") == 0) {
-        caesar_encrypt(RANGE_LOW, RANGE_HIGH, key_int, message, result_text);
+    if (opts->utf8) {
+        bool valid = encrypt
+            ? caesar_encrypt_utf8(opts->range_low, opts->range_high, key_int, message, result_text)
+            : caesar_decrypt_utf8(opts->range_low, opts->range_high, key_int, message, result_text);
+        if (!valid) {
+            fprintf(stderr, "Message is not valid UTF-8\n");
+            return 1;
+        }
+    } else if (encrypt) {
+        caesar_encrypt(opts->range_low, opts->range_high, key_int, message, result_text);
     } else {
-        caesar_decrypt(RANGE_LOW, RANGE_HIGH, key_int, message, result_text);
+        caesar_decrypt(opts->range_low, opts->range_high, key_int, message, result_text);
+    }
+
+    printf("%s\n", result_text);
+
+    return 0;
+}
+
+// handles case where a hill encryption/decryption is required
+// the key is the matrix as n * n in-range characters, row by row, and must be invertible
+// modulo the range's size
+// prints the resulting text
+int handle_hill(const struct options *opts, const char *operation, const char *key_str,
+                const char *message) {
+    if (!validate_key_characters(opts->range_low, opts->range_high, "Key", key_str)) {
+        return 1;
+    }
+
+    bool encrypt = strcmp(operation, "hill-encrypt") == 0;
+    if (opts->rails != 0 || opts->route != 0) {
+        struct cipher_step step = { .kind = CIPHER_HILL, .key = key_str };
+        return run_pipeline(opts, step, encrypt, message);
+    }
+    if (opts->utf8 && !utf8_validate(message, strlen(message))) {
+        fprintf(stderr, "Message is not valid UTF-8\n");
+        return 1;
+    }
+
+    char result_text[strlen(message) + 1];
+    bool valid = encrypt
+        ? hill_encrypt(opts->range_low, opts->range_high, key_str, message, result_text)
+        : hill_decrypt(opts->range_low, opts->range_high, key_str, message, result_text);
+
+    if (!valid) {
+        report_hill_key(opts);
+        return 1;
     }
 
     printf("%s\n", result_text);
@@ -90,10 +448,544 @@ int handle_caesar(const char *operation, const char *key_str, const char *messag
     return 0;
 }
 
+// handles case where a playfair encryption/decryption is required
+// encryption may insert filler letters, so its result can be up to twice as long
+// prints the resulting text
+int handle_playfair(const char *operation, const char *key_str, const char *message) {
+    if (!validate_key_characters(RANGE_LOW, RANGE_HIGH, "Key", key_str)) {
+        return 1;
+    }
+
+    size_t result_size = 2 * strlen(message) + 2;
+    char result_text[result_size];
+
+    if (strcmp(operation, "playfair-encrypt") == 0) {
+        playfair_encrypt(key_str, message, result_text, result_size);
+    } else if (!playfair_decrypt(key_str, message, result_text)) {
+        fprintf(stderr, "Message is not a Playfair ciphertext (it needs an even number of "
+                "letters, no J and no doubled pairs)\n");
+        return 1;
+    }
+
+    printf("%s\n", result_text);
+
+    return 0;
+}
+
+// parses an Enigma key of the form "I-II-III:RINGS:POSITIONS" with an optional
+// ":PLUGBOARD" (letter pairs) appended; the reflector is always B
+// the plugboard points into the key string
+bool parse_enigma_key(const char *key_str, struct enigma_settings *settings) {
+    static const char *const numerals[ENIGMA_ROTOR_TYPES] = { "I", "II", "III", "IV", "V" };
+    const char *p = key_str;
+
+    for (int i = 0; i < 3; i++) {
+        size_t len = strcspn(p, i < 2 ? "-" : ":");
+        settings->rotors[i] = 0;
+        for (int r = 0; r < ENIGMA_ROTOR_TYPES; r++) {
+            if (strlen(numerals[r]) == len && strncmp(p, numerals[r], len) == 0) {
+                settings->rotors[i] = (unsigned char)(r + 1);
+            }
+        }
+        if (settings->rotors[i] == 0 || p[len] != (i < 2 ? '-' : ':')) {
+            return false;
+        }
+        p += len + 1;
+    }
+    for (int field = 0; field < 2; field++) {
+        char *letters = field == 0 ? settings->rings : settings->positions;
+        if (strcspn(p, ":") != 3) {
+            return false;
+        }
+        memcpy(letters, p, 3);
+        p += 3;
+        if (field == 0 && *p++ != ':') {
+            return false;
+        }
+    }
+    if (*p != '\0' && *p++ != ':') {
+        return false;
+    }
+    settings->reflector = 'B';
+    settings->plugboard = p;
+    return true;
+}
+
+// handles the shard-index operation, which takes the file to index in place of the key
+// and the path to write its rank index to in place of the message
+int handle_shard_index(const struct options *opts, const char *path, const char *index_path) {
+    int in_fd = open(path, O_RDONLY);
+    int out_fd = in_fd >= 0 ? open(index_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+
+    if (in_fd < 0 || out_fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", in_fd < 0 ? path : index_path, strerror(errno));
+        if (in_fd >= 0) {
+            close(in_fd);
+        }
+        return 1;
+    }
+    errno = 0;
+    bool ok = shard_index_build(opts->range_low, opts->range_high, in_fd, out_fd);
+    if (!ok) {
+        fprintf(stderr, "Index failed: %s\n", errno != 0 ? strerror(errno) : "not a regular file");
+    }
+    close(in_fd);
+    ok = close(out_fd) == 0 && ok;
+    return ok ? 0 : 1;
+}
+
+// handles the enigma operation, which both encrypts and decrypts
+// prints the resulting text
+int handle_enigma(const char *key_str, const char *message) {
+    struct enigma_settings settings;
+    char result_text[strlen(message) + 1];
+
+    if (!parse_enigma_key(key_str, &settings) || !enigma_crypt(&settings, message, result_text)) {
+        fprintf(stderr, "Key must be rotors, rings and positions such as I-II-III:AAA:AAA, "
+                "optionally followed by plugboard pairs such as :AB CD\n");
+        return 1;
+    }
+
+    printf("%s\n", result_text);
+
+    return 0;
+}
+
+// handles the rail fence and route transpositions
+// the key is the number of rails or columns
+// prints the resulting text
+int handle_transposition(const struct options *opts, const char *operation, const char *key_str,
+                         const char *message) {
+    size_t size;
+
+    if (!parse_size(key_str, &size)) {
+        fprintf(stderr, "Key must be a positive integer\n");
+        return 1;
+    }
+
+    char result_text[strlen(message) + 1];
+    bool valid;
+
+    if (strcmp(operation, "rail-encrypt") == 0) {
+        valid = rail_fence_encrypt(opts->range_low, opts->range_high, size, message, result_text);
+    } else if (strcmp(operation, "rail-decrypt") == 0) {
+        valid = rail_fence_decrypt(opts->range_low, opts->range_high, size, message, result_text);
+    } else if (strcmp(operation, "route-encrypt") == 0) {
+        valid = route_encrypt(opts->range_low, opts->range_high, size, message, result_text);
+    } else {
+        valid = route_decrypt(opts->range_low, opts->range_high, size, message, result_text);
+    }
+    if (!valid) {
+        fprintf(stderr, "Transposition failed\n");
+        return 1;
+    }
+
+    printf("%s\n", result_text);
+
+    return 0;
+}
+
+// handles the vigenere-crib operation
+// validates the crib, then prints the byte offset and implied key of every position at
+// which the crib is consistent with a periodic key
+int handle_crib(const struct options *opts, const char *crib, const char *message) {
+    struct crib_match matches[CRIB_PRINT_MAX];
+
+    if (!validate_key_characters(opts->range_low, opts->range_high, "Crib", crib)) {
+        return 1;
+    }
+
+    size_t found = vigenere_crib_drag(opts->range_low, opts->range_high, crib, message, 0,
+                                      matches, CRIB_PRINT_MAX);
+    if (found == SIZE_MAX) {
+        fprintf(stderr, "Crib must be between 2 and %d characters long\n", CRIB_MAX_LENGTH);
+        return 1;
+    }
+
+    for (size_t i = 0; i < found && i < CRIB_PRINT_MAX; i++) {
+        printf("%zu %s\n", matches[i].offset, matches[i].key);
+    }
+    if (found > CRIB_PRINT_MAX) {
+        fprintf(stderr, "%zu further matches not shown\n", found - CRIB_PRINT_MAX);
+    }
+
+    return 0;
+}
+
+// handles the vigenere-brute operation
+// validates the key length, then prints the best keys of that length with their scores
+// and reports the search speed
+int handle_brute_force(const struct options *opts, const char *key_len_str, const char *message) {
+    char *endptr;
+    long key_len = strtol(key_len_str, &endptr, 10);
+    struct key_candidate best[BRUTE_FORCE_PRINT_MAX];
+    struct brute_force_stats stats;
+
+    if (*endptr != '\0' || containsWhitespace(key_len_str)
+        || key_len < 1 || key_len > BRUTE_FORCE_MAX_KEY) {
+        fprintf(stderr, "Key length must be an integer from 1 to %d\n", BRUTE_FORCE_MAX_KEY);
+        return 1;
+    }
+
+    // candidate decryptions are scored as English, letter by letter
+    if (opts->range_high - opts->range_low + 1 != 26) {
+        fprintf(stderr, "vigenere-brute needs a 26-character range, such as upper or lower\n");
+        return 1;
+    }
+
+    size_t found = vigenere_brute_force(opts->range_low, opts->range_high, message, (size_t)key_len,
+                                        best, BRUTE_FORCE_PRINT_MAX, &stats);
+    if (found == SIZE_MAX) {
+        fprintf(stderr, "Brute force search failed\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < found; i++) {
+        printf("%s %d\n", best[i].key, best[i].score);
+    }
+    fprintf(stderr, "%llu keys in %.3f s (%.0f keys/s)\n", stats.keys, stats.seconds,
+            stats.seconds > 0 ? (double)stats.keys / stats.seconds : 0.0);
+
+    return 0;
+}
+
+// one line of batch input, split in place, and its result
+struct batch_request {
+    unsigned client;
+    const char *operation, *key, *message;
+    size_t len;
+    char *output;
+    struct scheduler_job *job;  // while the request is running
+    struct cancel_token token;  // its deadline, with --timeout
+    const char *error;          // if not NULL, why there is no output
+};
+
+// splits a line of batch input into its client (an optional "@<number>" first field,
+// 0 without one), operation, key and message (the rest of the line, which may contain
+// spaces)
+// returns false if it has fewer than three fields after the client
+bool batch_parse(char *line, struct batch_request *request) {
+    if (line[0] == '@') {
+        char *endptr;
+        unsigned long client = strtoul(line + 1, &endptr, 10);
+        if (endptr == line + 1 || *endptr != ' ' || client > UINT_MAX || !isdigit((unsigned char)line[1])) {
+            return false;
+        }
+        request->client = (unsigned)client;
+        line = endptr + 1;
+    }
+
+    char *key = strchr(line, ' ');
+    char *message = key != NULL ? strchr(key + 1, ' ') : NULL;
+
+    if (message == NULL || key == line || message == key + 1) {
+        return false;
+    }
+    *key++ = '\0';
+    *message++ = '\0';
+    request->operation = line;
+    request->key = key;
+    request->message = message;
+    return true;
+}
+
+// waits for a submitted request, which fails if it runs out of time
+void batch_wait(struct scheduler *scheduler, struct batch_request *request) {
+    if (!scheduler_wait(scheduler, request->job)) {
+        request->error = "timed out";
+    }
+    request->job = NULL;
+}
+
+// submits one Caesar or Vigenere request to the scheduler, with its output allocated
+// from the arena and its time (with --timeout) counted from now; while the scheduler is
+// full, waits for the oldest running request of the batch (`*waited` is the index of
+// the first request not yet waited for)
+void batch_submit(const struct options *opts, struct arena *arena, struct scheduler *scheduler,
+                  struct batch_request *batch, size_t index, size_t *waited) {
+    struct batch_request *request = &batch[index];
+    bool caesar = strncmp(request->operation, "caesar-", 7) == 0;
+    bool encrypt = strcmp(request->operation, caesar ? "caesar-encrypt" : "vigenere-encrypt") == 0;
+
+    if (!caesar && strcmp(request->operation, "vigenere-encrypt") != 0
+        && strcmp(request->operation, "vigenere-decrypt") != 0) {
+        request->error = "batch mode only runs the Caesar and Vigenere ciphers";
+        return;
+    }
+    if (caesar && !encrypt && strcmp(request->operation, "caesar-decrypt") != 0) {
+        request->error = "invalid operation";
+        return;
+    }
+
+    long num = 0;
+    if (caesar) {
+        char *endptr;
+        num = strtol(request->key, &endptr, 10);
+        if (*endptr != '\0' || num < INT_MIN || num > INT_MAX || containsWhitespace(request->key)) {
+            request->error = "key is not a valid integer";
+            return;
+        }
+    } else if (!validate_key_characters(opts->range_low, opts->range_high, NULL, request->key)) {
+        request->error = "key has characters out of range";
+        return;
+    }
+
+    request->len = strlen(request->message);
+    request->output = arena_alloc(arena, request->len + 1);
+    if (request->output == NULL) {
+        request->error = "out of memory";
+        return;
+    }
+    request->output[request->len] = '\0';
+
+    struct cipher_step step = { .kind = caesar ? CIPHER_CAESAR : CIPHER_VIGENERE,
+                                .shift = (int)num % (opts->range_high - opts->range_low + 1),
+                                .key = request->key };
+    cancel_token_init(&request->token, opts->timeout);
+    enum scheduler_status status;
+    while ((status = scheduler_submit(scheduler, request->client, opts->range_low, opts->range_high, &step,
+                                      !encrypt, request->message, request->len, request->output,
+                                      opts->timeout != 0 ? &request->token : NULL,
+                                      &request->job)) == SCHEDULER_BUSY) {
+        while (batch[*waited].job == NULL) {
+            ++*waited;
+        }
+        batch_wait(scheduler, &batch[(*waited)++]);
+    }
+    if (status != SCHEDULER_OK) {
+        request->job = NULL;
+        request->error = "invalid key";
+    }
+}
+
+// runs "[@<client>] <operation> <key> <message>" requests read from standard input,
+// printing one line of output per line of input (an empty one for a failed request,
+// whose error goes to standard error). Requests are read, run and printed a batch at a
+// time, with every buffer a batch needs (the staged input lines, the requests and their
+// outputs) taken from one arena that is reset between batches. The requests of a batch
+// run concurrently on a scheduler that shares the threads fairly between clients
+int run_batch(const struct options *opts) {
+    struct arena *arena = arena_create(BATCH_BLOCK);
+    struct scheduler *scheduler = scheduler_create(0, BATCH_REQUESTS, BATCH_CLIENT_LIMIT,
+                                                   BATCH_QUANTUM);
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t line_number = 0;
+    size_t requests = 0, batches = 0, first_batch_mallocs = 0;
+    bool more = true;
+    int status = 0;
+
+    if (arena == NULL || scheduler == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        arena_destroy(arena);
+        scheduler_destroy(scheduler);
+        return 1;
+    }
+    while (more) {
+        struct batch_request *batch = arena_alloc(arena, BATCH_REQUESTS * sizeof(*batch));
+        size_t count = 0;
+        ssize_t len = 0;
+
+        // stages the batch's lines in the arena, so the line buffer is reused throughout
+        while (batch != NULL && count < BATCH_REQUESTS
+               && (len = getline(&line, &line_size, stdin)) >= 0) {
+            if (len > 0 && line[len - 1] == '\n') {
+                line[--len] = '\0';
+            }
+            struct batch_request *request = &batch[count++];
+            char *staged = arena_alloc(arena, (size_t)len + 1);
+            *request = (struct batch_request){ .error = "out of memory" };
+            if (staged != NULL) {
+                memcpy(staged, line, (size_t)len + 1);
+                request->error = batch_parse(staged, request) ? NULL
+                                 : "expected <operation> <key> <message>";
+            }
+        }
+        more = batch != NULL && len >= 0;
+        if (batch == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            status = 1;
+            break;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        size_t waited = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (batch[i].error == NULL) {
+                batch_submit(opts, arena, scheduler, batch, i, &waited);
+            }
+        }
+        for (size_t i = waited; i < count; i++) {
+            if (batch[i].job != NULL) {
+                batch_wait(scheduler, &batch[i]);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            line_number++;
+            if (batch[i].error != NULL) {
+                fprintf(stderr, "line %zu: %s\n", line_number, batch[i].error);
+                status = 1;
+            }
+            printf("%s\n", batch[i].error == NULL ? batch[i].output : "");
+        }
+
+        requests += count;
+        if (batches++ == 0) {
+            first_batch_mallocs = arena_mallocs(arena);
+        }
+        arena_reset(arena);
+    }
+
+    if (opts->stats) {
+        fflush(stdout);
+        fprintf(stderr, "batch: %zu requests in %zu batches; arena: %zu bytes, %zu mallocs "
+                "(%zu after the first batch)\n", requests, batches, arena_bytes(arena),
+                arena_mallocs(arena), arena_mallocs(arena) - first_batch_mallocs);
+    }
+    free(line);
+    scheduler_destroy(scheduler);
+    arena_destroy(arena);
+    return status;
+}
+
 // prints instructions for using program
 void print_usage(const char *prog_name) {
-    fprintf(stderr, "Usage: %s <operation> <key> <message>\n", prog_name);
-    fprintf(stderr, "Valid operations: vigenere-encrypt, vigenere-decrypt, caesar-encrypt, caesar-decrypt\n");
+    fprintf(stderr, "Usage: %s [options] <operation> <key> <message>\n", prog_name);
+    fprintf(stderr, "Valid operations: vigenere-encrypt, vigenere-decrypt, caesar-encrypt, caesar-decrypt, hill-encrypt, hill-decrypt,\n"
+                    "                  playfair-encrypt, playfair-decrypt, rail-encrypt, rail-decrypt,\n"
+                    "                  route-encrypt, route-decrypt, enigma\n");
+    fprintf(stderr, "Analysis: vigenere-crib <crib> <ciphertext>, vigenere-brute <key length> <ciphertext>\n");
+    fprintf(stderr, "Sharding: shard-index <file> <index file>\n");
+    fprintf(stderr, "Batch:    %s --batch [--stats] [--timeout <ms>] [--trace <file>] [--range <range>]\n"
+                    "          < requests (one \"[@<client>] <operation> <key> <message>\" per line)\n",
+            prog_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --range <low>-<high>|upper|lower|digits|printable|rot47\n"
+                    "                 the characters to encrypt (default A-Z; e.g. a-z, or ' '-'~' "
+                    "for printable ASCII)\n");
+    fprintf(stderr, "  --utf8         reject Caesar, Vigenere or Hill messages that are not valid UTF-8\n");
+    fprintf(stderr, "  --rails <n>    follow a Caesar, Vigenere or Hill cipher with a rail fence\n");
+    fprintf(stderr, "  --route <n>    follow it with a route cipher n columns wide\n");
+    fprintf(stderr, "  --encoding hex|base64\n"
+                    "                 write (or read, when decrypting) Caesar or Vigenere "
+                    "ciphertext encoded\n");
+    fprintf(stderr, "  --stream       Caesar or Vigenere from standard input to standard output "
+                    "(no message)\n");
+    fprintf(stderr, "  --splice       with --stream, hand the output pages to a pipe instead "
+                    "of copying them\n"
+                    "                 (only if the next program reads the pipe, not splices it)\n");
+    fprintf(stderr, "  --gzip         with --stream, decompress the input and compress the output "
+                    "(gzip) on the fly\n");
+    fprintf(stderr, "  --shard <i/N>  Caesar or Vigenere over shard i of N of the file named by "
+                    "the message\n"
+                    "                 (concatenating the N outputs gives the whole file's)\n");
+    fprintf(stderr, "  --index <file> with --shard, the file's index from shard-index\n");
+    fprintf(stderr, "  --checksum     also print the CRC-32C of a Caesar or Vigenere input and "
+                    "output\n");
+    fprintf(stderr, "  --stats        print the peak RSS and the bytes allocated at exit (and "
+                    "arena statistics with --batch)\n");
+    fprintf(stderr, "  --trace <file> write a Chrome trace of the run to the file on SIGUSR1 and "
+                    "at exit\n");
+}
+
+// prints the memory the run used, for --stats
+static void print_memory_stats(void)
+{
+    struct memory_stats stats;
+
+    memory_stats(&stats);
+    fflush(stdout);
+    fprintf(stderr, "memory: peak RSS %zu KiB; %" PRIu64 " allocations, %" PRIu64 " bytes, "
+            "largest %zu bytes\n", stats.peak_rss / 1024, stats.allocations, stats.allocated,
+            stats.largest);
+}
+
+// the --trace file, for dump_trace
+static const char *trace_file;
+
+// writes the events traced so far to the --trace file
+static void dump_trace(void)
+{
+    int fd = open(trace_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0 || !trace_dump(fd)) {
+        fprintf(stderr, "Could not write the trace to %s\n", trace_file);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// parses the options preceding the operation into `opts`
+// returns the index of the first non-option argument, or -1 on an unknown option
+int parse_options(int argc, char **argv, struct options *opts) {
+    int i = 1;
+
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--utf8") == 0) {
+            opts->utf8 = true;
+        } else if ((strcmp(argv[i], "--rails") == 0 || strcmp(argv[i], "--route") == 0)
+                   && i + 1 < argc) {
+            size_t *size = strcmp(argv[i], "--rails") == 0 ? &opts->rails : &opts->route;
+            if (!parse_size(argv[i + 1], size)) {
+                fprintf(stderr, "%s needs a positive integer\n", argv[i]);
+                return -1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--checksum") == 0) {
+            opts->checksum = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            opts->stream = true;
+        } else if (strcmp(argv[i], "--splice") == 0) {
+            opts->splice = true;
+        } else if (strcmp(argv[i], "--gzip") == 0) {
+            opts->gzip = true;
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            if (!parse_shard(argv[i + 1], &opts->shard, &opts->shards)) {
+                fprintf(stderr, "--shard needs i/N, with i from 0 to N - 1\n");
+                return -1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            opts->batch = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            opts->stats = true;
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            if (!parse_size(argv[i + 1], &opts->timeout)) {
+                fprintf(stderr, "--timeout needs a positive number of milliseconds\n");
+                return -1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            opts->trace = argv[++i];
+        } else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc) {
+            if (!parse_range(argv[i + 1], &opts->range_low, &opts->range_high)) {
+                fprintf(stderr, "--range needs <low>-<high> (printable ASCII characters, "
+                        "such as a-z or ' '-'~') or upper, lower, digits, printable or rot47\n");
+                return -1;
+            }
+            opts->range = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            opts->index = argv[++i];
+        } else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "hex") == 0) {
+                opts->encoding = ENCODING_HEX;
+            } else if (strcmp(argv[i + 1], "base64") == 0) {
+                opts->encoding = ENCODING_BASE64;
+            } else {
+                fprintf(stderr, "--encoding must be hex or base64\n");
+                return -1;
+            }
+            opts->encoded = true;
+            i++;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    return i;
 }
 
 /** This function handles various encryption and decryption operations based on user input. The function expects 
@@ -104,6 +996,16 @@ void print_usage(const char *prog_name) {
   * - vigenere-decrypt: Decrypts the given message using \ref vigenere_decrypt with the specified key.
   * - caesar-encrypt: Encrypts the given message using \ref caesar_encrypt with the specified key.
   * - caesar-decrypt: Decrypts the given message using \ref  caesar_decrypt with the specified key.
+  * - hill-encrypt: Encrypts the given message using \ref hill_encrypt with the specified key matrix.
+  * - hill-decrypt: Decrypts the given message using \ref hill_decrypt with the specified key matrix.
+  * - playfair-encrypt: Encrypts the given message using \ref playfair_encrypt with the specified key.
+  * - playfair-decrypt: Decrypts the given message using \ref playfair_decrypt with the specified key.
+  * - rail-encrypt, rail-decrypt: Transposes the given message using \ref rail_fence_encrypt or
+  *   \ref rail_fence_decrypt with the specified number of rails.
+  * - route-encrypt, route-decrypt: Transposes the given message using \ref route_encrypt or
+  *   \ref route_decrypt with the specified number of columns.
+  * - enigma: Encrypts or decrypts the given message using \ref enigma_crypt with the rotors,
+  *   rings, positions and plugboard given as the key (e.g., "I-II-III:AAA:AAA:AB CD").
   *
   * The function performs the following steps:
   * - Validates the number of arguments.
@@ -114,30 +1016,61 @@ void print_usage(const char *prog_name) {
   * \param argc The number of command-line arguments.
   * \param argv An array of strings representing the command-line arguments.
   *             - argv[0]: The name of the program.
-  *             - argv[1]: The operation to perform (e.g., "vigenere-encrypt").
-  *             - argv[2]: The key for the encryption/decryption.
-  *             - argv[3]: The message to be encrypted or decrypted.
+  *             - argv[1..]: Options, each starting with "--" (e.g., "--utf8", or "--rails 3"
+  *               and "--encoding hex" followed by their values).
+  *             - then the operation to perform (e.g., "vigenere-encrypt"),
+  *             - the key for the encryption/decryption,
+  *             - and the message to be encrypted or decrypted.
   * \return An integer status code.
   *         - Returns 0 on successful execution of the specified operation.
   *         - Returns 1 on error (e.g., invalid usage, invalid operation, invalid key).
   *
-  * \pre `argc` must be 4.
+  * \pre `argc` must be 4 plus the number of options.
   * \pre `argv` must be a valid array of strings.
-  * \pre `argv[1]` must be one of the supported operations.
-  * \pre `argv[2]` must be a valid key string for Vigenere operations, or a valid integer for Caesar operations.
-  * \pre `argv[3]` must be a valid null-terminated C string representing the message.
+  * \pre The operation must be one of the supported operations.
+  * \pre The key must be a valid key string for Vigenere operations, or a valid integer for Caesar operations.
+  * \pre The message must be a valid null-terminated C string.
   *
   * \post The specified operation is performed and the result is printed to the standard output.
   */
 int main(int argc, char **argv) {
-    if (argc != 4) {
+    struct options opts = { .range_low = RANGE_LOW, .range_high = RANGE_HIGH };
+    int first = parse_options(argc, argv, &opts);
+
+    // tracing starts before any thread does, so they all leave SIGUSR1 to the dump thread
+    if (first >= 0 && opts.trace != NULL) {
+        if (!trace_enable(opts.trace)) {
+            fprintf(stderr, "Could not start tracing\n");
+            return 1;
+        }
+        trace_file = opts.trace;
+        atexit(dump_trace);
+    }
+    if (first >= 0 && opts.stats) {
+        atexit(print_memory_stats);
+    }
+
+    // batch mode reads its requests from standard input and takes only the options in its usage
+    if (opts.batch || opts.timeout != 0) {
+        if (first != argc || !opts.batch) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        const char *rejected = batch_rejected_option(&opts);
+        if (rejected != NULL) {
+            fprintf(stderr, "%s does not apply to --batch\n", rejected);
+            return 1;
+        }
+        return run_batch(&opts);
+    }
+    if (first < 0 || argc - first != (opts.stream ? 2 : 3)) {
         print_usage(argv[0]);
         return 1;
     }
 
-    const char *operation = argv[1];
-    const char *key_str = argv[2];
-    const char *message = argv[3];
+    const char *operation = argv[first];
+    const char *key_str = argv[first + 1];
+    const char *message = opts.stream ? NULL : argv[first + 2];
 
     // ensure that a key was provided
     if (key_str[0] == '\0') {
@@ -145,12 +1078,69 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (((opts.splice || opts.gzip) && !opts.stream) || (opts.splice && opts.gzip)
+        || (opts.index != NULL && opts.shards == 0)) {
+        fprintf(stderr, "--splice and --gzip only apply with --stream (and not together), "
+                "and --index with --shard\n");
+        return 1;
+    }
+#ifndef SAFECIPHER_ZLIB
+    if (opts.gzip) {
+        fprintf(stderr, "--gzip needs safecipher built with zlib (make ZLIB=1)\n");
+        return 1;
+    }
+#endif
+
+    if ((opts.encoded || opts.checksum || opts.stream || opts.shards != 0)
+        && (opts.utf8 || opts.rails != 0 || opts.route != 0
+            || (opts.encoded + opts.stream + (opts.shards != 0) > 1)
+            || !is_substitution(operation))) {
+        fprintf(stderr, "--stream, --shard, --encoding and --checksum only apply to Caesar and "
+                "Vigenere encryption and decryption, without other options (or each other, except for "
+                "--checksum)\n");
+        return 1;
+    }
+
+    if (opts.utf8 && !is_substitution(operation) && strcmp(operation, "hill-encrypt") != 0
+        && strcmp(operation, "hill-decrypt") != 0) {
+        fprintf(stderr, "--utf8 only applies to Caesar, Vigenere and Hill encryption and "
+                "decryption\n");
+        return 1;
+    }
+    if ((opts.rails != 0 || opts.route != 0) && !is_substitution(operation)
+        && strcmp(operation, "hill-encrypt") != 0 && strcmp(operation, "hill-decrypt") != 0) {
+        fprintf(stderr, "--rails and --route only apply to Caesar, Vigenere and Hill encryption "
+                "and decryption\n");
+        return 1;
+    }
+
+    if ((opts.range_low != RANGE_LOW || opts.range_high != RANGE_HIGH)
+        && (strncmp(operation, "playfair-", 9) == 0 || strcmp(operation, "enigma") == 0)) {
+        fprintf(stderr, "Playfair and Enigma only work in the range 'A'->'Z'\n");
+        return 1;
+    }
+
     int flag = 0;
 
     if (strcmp(operation, "vigenere-encrypt") == 0 || strcmp(operation, "vigenere-decrypt") == 0) {
-        flag = handle_vigenere(operation, key_str, message);
+        flag = handle_vigenere(&opts, operation, key_str, message);
     } else if (strcmp(operation, "caesar-encrypt") == 0 || strcmp(operation, "caesar-decrypt") == 0) {
-        flag = handle_caesar(operation, key_str, message);
+        flag = handle_caesar(&opts, operation, key_str, message);
+    } else if (strcmp(operation, "hill-encrypt") == 0 || strcmp(operation, "hill-decrypt") == 0) {
+        flag = handle_hill(&opts, operation, key_str, message);
+    } else if (strcmp(operation, "playfair-encrypt") == 0 || strcmp(operation, "playfair-decrypt") == 0) {
+        flag = handle_playfair(operation, key_str, message);
+    } else if (strcmp(operation, "rail-encrypt") == 0 || strcmp(operation, "rail-decrypt") == 0
+               || strcmp(operation, "route-encrypt") == 0 || strcmp(operation, "route-decrypt") == 0) {
+        flag = handle_transposition(&opts, operation, key_str, message);
+    } else if (strcmp(operation, "shard-index") == 0) {
+        flag = handle_shard_index(&opts, key_str, message);
+    } else if (strcmp(operation, "enigma") == 0) {
+        flag = handle_enigma(key_str, message);
+    } else if (strcmp(operation, "vigenere-crib") == 0) {
+        flag = handle_crib(&opts, key_str, message);
+    } else if (strcmp(operation, "vigenere-brute") == 0) {
+        flag = handle_brute_force(&opts, key_str, message);
     } else {
         fprintf(stderr, "Invalid operation: %s\n", operation);
         print_usage(argv[0]);
@@ -1,4 +1,5 @@
 #include "crypto.h"
+#include "internal.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -7,24 +8,555 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <errno.h>
+#include <stdint.h>
+
+#ifdef SAFECIPHER_X86
+#include <cpuid.h>
+#endif
 
 #define   RANGE_LOW   'A'
 #define   RANGE_HIGH  'Z'
 
-// caesar cipher encryption
-void caesar_encrypt(char range_low, char range_high, int key, const char * plain_text, char * cipher_text)
+// keys up to this length are expanded into a stack buffer so that every 16-byte
+// window of the key schedule can be loaded without checking for wrap-around
+#define   KEY_SCHEDULE_INLINE   240
+
+// shifts a single character by `key` positions, where `key` is already reduced
+// to the range [0, range_size), so one subtraction wraps it rather than a division
+static char shift_char(char range_low, char range_high, int key, char c)
 {
-    size_t plain_text_len = strlen(plain_text);
     int range_size = range_high - range_low + 1;
-    key = (key % range_size + range_size) % range_size;
+    if (range_low <= c && c <= range_high) {
+        int offset = c - range_low + key;
+        c = (char)(range_low + (offset >= range_size ? offset - range_size : offset));
+    }
+    return c;
+}
+
+// reduces a key character to the (encryption or decryption) shift it represents
+static int key_shift(char range_low, char range_high, char key_char, bool decrypt)
+{
+    int range_size = range_high - range_low + 1;
+    int shift = key_char - range_low;
+    return decrypt && shift != 0 ? range_size - shift : shift;
+}
+
+#ifndef SAFECIPHER_X86
+// a Caesar shift is a fixed map of the 256 byte values whatever the range, so it is
+// tabulated once per call and applied with one load per byte
+static void caesar_scalar(char range_low, char range_high, int key,
+                          const char *in, char *out, size_t len)
+{
+    char table[256];
+
+    for (int c = CHAR_MIN; c <= CHAR_MAX; c++) {
+        table[(unsigned char)c] = shift_char(range_low, range_high, key, (char)c);
+    }
+    for (size_t i = 0; i < len; i++) {
+        out[i] = table[(unsigned char)in[i]];
+    }
+}
+#endif
 
-    for (size_t i = 0; i < plain_text_len; i++) {
-        char c = plain_text[i];
+static size_t vigenere_scalar(char range_low, char range_high, const char *key,
+                              size_t key_len, size_t phase, bool decrypt,
+                              const char *in, char *out, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char c = in[i];
         if (range_low <= c && c <= range_high) {
-            c = (char)(range_low + abs((c - range_low + key) % range_size));
+            int shift = key_shift(range_low, range_high, key[phase], decrypt);
+            c = shift_char(range_low, range_high, shift, c);
+            phase = phase + 1 == key_len ? 0 : phase + 1;
+        }
+        out[i] = c;
+    }
+    return phase;
+}
+
+// returns true if the sequence starting at `s` (with `len` bytes available) is a
+// well-formed multibyte UTF-8 sequence, storing its length in `seq_len`
+static bool utf8_sequence(const unsigned char *s, size_t len, size_t *seq_len)
+{
+    unsigned char lead = s[0];
+    unsigned char min = 0x80;
+    unsigned char max = 0xBF;
+    size_t n;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        n = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        n = 3;
+        if (lead == 0xE0) {
+            min = 0xA0;     // overlong
+        } else if (lead == 0xED) {
+            max = 0x9F;     // surrogates
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        n = 4;
+        if (lead == 0xF0) {
+            min = 0x90;     // overlong
+        } else if (lead == 0xF4) {
+            max = 0x8F;     // above U+10FFFF
+        }
+    } else {
+        return false;
+    }
+
+    if (len < n || s[1] < min || s[1] > max) {
+        return false;
+    }
+    for (size_t i = 2; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return false;
         }
-        cipher_text[i] = c;
     }
+    *seq_len = n;
+    return true;
+}
+
+// validates UTF-8 eight bytes at a time over ASCII runs, and a whole sequence at a
+// time otherwise
+static bool utf8_validate_scalar(const char *text, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)text;
+    size_t i = 0;
+
+    while (i < len) {
+        if (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, s + i, sizeof(word));
+            if ((word & UINT64_C(0x8080808080808080)) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        if (s[i] < 0x80) {
+            i++;
+            continue;
+        }
+        size_t seq_len;
+        if (!utf8_sequence(s + i, len - i, &seq_len)) {
+            return false;
+        }
+        i += seq_len;
+    }
+    return true;
+}
+
+#ifdef SAFECIPHER_X86
+
+// parameters for shifting all in-range bytes of a vector
+struct shift_vec {
+    __m128i low;
+    __m128i high;
+    __m128i size;
+};
+
+static inline struct shift_vec shift_vec_init(char range_low, char range_high)
+{
+    struct shift_vec p;
+    p.low = _mm_set1_epi8(range_low);
+    p.high = _mm_set1_epi8(range_high);
+    // a 256-character range wraps to 0, which the modular arithmetic below relies on
+    p.size = _mm_set1_epi8((char)(unsigned char)(range_high - range_low + 1));
+    return p;
+}
+
+// shifts every in-range byte of `v` by the corresponding lane of `key` (each lane in
+// [0, range_size)); out-of-range bytes are returned unchanged
+static inline __m128i shift_vec_apply(const struct shift_vec *p, __m128i v, __m128i key)
+{
+    __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi8(v, p->low), _mm_cmpgt_epi8(v, p->high));
+    __m128i offset = _mm_sub_epi8(v, p->low);
+    __m128i threshold = _mm_sub_epi8(p->size, key);
+    // offset + key wraps past the end of the range exactly when offset >= size - key,
+    // in which case the shift becomes key - size (== -threshold)
+    __m128i wrap = _mm_cmpeq_epi8(_mm_max_epu8(offset, threshold), offset);
+    __m128i shift = _mm_or_si128(_mm_and_si128(wrap, _mm_sub_epi8(_mm_setzero_si128(), threshold)),
+                                 _mm_andnot_si128(wrap, key));
+    return _mm_add_epi8(v, _mm_andnot_si128(out_of_range, shift));
+}
+
+static void caesar_sse2(char range_low, char range_high, int key,
+                        const char *in, char *out, size_t len)
+{
+    struct shift_vec p = shift_vec_init(range_low, range_high);
+    __m128i k = _mm_set1_epi8((char)(unsigned char)key);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(in + i));
+        _mm_storeu_si128((__m128i *)(void *)(out + i), shift_vec_apply(&p, v, k));
+    }
+    if (i < len) {
+        char tail[16] = {0};
+        memcpy(tail, in + i, len - i);
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)tail);
+        _mm_storeu_si128((__m128i *)(void *)tail, shift_vec_apply(&p, v, k));
+        memcpy(out + i, tail, len - i);
+    }
+}
+
+/* UTF-8 validation after Keiser and Lemire, "Validating UTF-8 in less than one
+ * instruction per byte": every byte is classified by three 16-entry nibble tables
+ * whose intersection flags the error (if any) that the byte pair forms. */
+
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+struct utf8_checker {
+    __m128i error;
+    __m128i prev_input;
+    __m128i prev_incomplete;
+};
+
+static inline void utf8_checker_init(struct utf8_checker *c)
+{
+    c->error = _mm_setzero_si128();
+    c->prev_input = _mm_setzero_si128();
+    c->prev_incomplete = _mm_setzero_si128();
+}
+
+#define U8(x) ((char)(unsigned char)(x))
+
+__attribute__((target("ssse3")))
+static inline __m128i utf8_special_cases(__m128i input, __m128i prev1)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        U8(UTF8_TWO_CONTS), U8(UTF8_TWO_CONTS), U8(UTF8_TWO_CONTS), U8(UTF8_TWO_CONTS),
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        U8(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),
+        U8(UTF8_CARRY | UTF8_OVERLONG_2),
+        U8(UTF8_CARRY),
+        U8(UTF8_CARRY),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        U8(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000));
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        U8(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3
+           | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+        U8(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+        U8(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+        U8(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+    __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    return _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+}
+
+__attribute__((target("ssse3")))
+static inline void utf8_check_vec(struct utf8_checker *c, __m128i input)
+{
+    if (_mm_movemask_epi8(input) == 0) {
+        // pure ASCII: only an incomplete sequence from the previous block can be wrong
+        c->error = _mm_or_si128(c->error, c->prev_incomplete);
+        c->prev_input = input;
+        c->prev_incomplete = _mm_setzero_si128();
+        return;
+    }
+
+    __m128i prev1 = _mm_alignr_epi8(input, c->prev_input, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, c->prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, c->prev_input, 13);
+    __m128i special = utf8_special_cases(input, prev1);
+    // bytes two or three positions after a 3- or 4-byte lead must be continuations
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(U8(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(U8(0xF0 - 0x80)));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(U8(0x80)));
+    c->error = _mm_or_si128(c->error, _mm_xor_si128(must23, special));
+
+    // a lead byte in the last three positions needs bytes from the next block
+    const __m128i max_complete = _mm_setr_epi8(
+        U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF),
+        U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF), U8(0xFF), U8(0xF0 - 1), U8(0xE0 - 1), U8(0xC0 - 1));
+    c->prev_incomplete = _mm_subs_epu8(input, max_complete);
+    c->prev_input = input;
+}
+
+static inline bool utf8_checker_ok(const struct utf8_checker *c)
+{
+    __m128i error = _mm_or_si128(c->error, c->prev_incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+__attribute__((target("ssse3")))
+static bool utf8_validate_ssse3(const char *text, size_t len)
+{
+    struct utf8_checker checker;
+    utf8_checker_init(&checker);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        utf8_check_vec(&checker, _mm_loadu_si128((const __m128i *)(const void *)(text + i)));
+    }
+    if (i < len) {
+        char tail[16] = {0};
+        memcpy(tail, text + i, len - i);
+        utf8_check_vec(&checker, _mm_loadu_si128((const __m128i *)(const void *)tail));
+    }
+    return utf8_checker_ok(&checker);
+}
+
+__attribute__((target("ssse3")))
+static bool caesar_utf8_ssse3(char range_low, char range_high, int key,
+                              const char *in, char *out, size_t len)
+{
+    struct shift_vec p = shift_vec_init(range_low, range_high);
+    __m128i k = _mm_set1_epi8((char)(unsigned char)key);
+    struct utf8_checker checker;
+    utf8_checker_init(&checker);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(in + i));
+        utf8_check_vec(&checker, v);
+        _mm_storeu_si128((__m128i *)(void *)(out + i), shift_vec_apply(&p, v, k));
+    }
+    if (i < len) {
+        char tail[16] = {0};
+        memcpy(tail, in + i, len - i);
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)tail);
+        utf8_check_vec(&checker, v);
+        _mm_storeu_si128((__m128i *)(void *)tail, shift_vec_apply(&p, v, k));
+        memcpy(out + i, tail, len - i);
+    }
+    return utf8_checker_ok(&checker);
+}
+
+// the key as seen by the vector kernel: short keys are repeated into `buffer` so that
+// no 16-byte window ever needs to wrap around the end of the key, and so that the
+// phase (kept modulo `len`, a multiple of the key length of at least 16) can be
+// advanced by one vector's worth of characters with a single subtraction
+struct key_schedule {
+    const char *key;
+    size_t len;
+    bool padded;
+    char buffer[KEY_SCHEDULE_INLINE + 32];
+};
+
+static void key_schedule_init(struct key_schedule *s, const char *key, size_t key_len)
+{
+    s->padded = key_len <= KEY_SCHEDULE_INLINE;
+    if (s->padded) {
+        s->len = (16 + key_len - 1) / key_len * key_len;
+        for (size_t i = 0; i < s->len + 16; i++) {
+            s->buffer[i] = key[i % key_len];
+        }
+        s->key = s->buffer;
+    } else {
+        s->len = key_len;
+        s->key = key;
+    }
+}
+
+// loads the 16 key characters starting at `phase`, wrapping around the end of the key
+static inline __m128i key_window(const struct key_schedule *s, size_t phase)
+{
+    if (s->padded || phase + 16 <= s->len) {
+        return _mm_loadu_si128((const __m128i *)(const void *)(s->key + phase));
+    }
+    char window[16];
+    for (size_t i = 0; i < 16; i++) {
+        window[i] = s->key[(phase + i) % s->len];
+    }
+    return _mm_loadu_si128((const __m128i *)(const void *)window);
+}
+
+// encrypts (or decrypts) one vector, advancing the key phase by the number of
+// in-range bytes among its first `lanes` bytes
+__attribute__((target("ssse3")))
+static inline __m128i vigenere_vec(const struct shift_vec *p, const struct key_schedule *s,
+                                   size_t *phase, bool decrypt, __m128i v, unsigned lanes)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi8(v, p->low), _mm_cmpgt_epi8(v, p->high));
+    __m128i in_range = _mm_andnot_si128(out_of_range, one);
+
+    // exclusive prefix count of in-range bytes gives each lane its key offset
+    __m128i prefix = _mm_add_epi8(in_range, _mm_slli_si128(in_range, 1));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 2));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 4));
+    prefix = _mm_add_epi8(prefix, _mm_slli_si128(prefix, 8));
+    prefix = _mm_sub_epi8(prefix, in_range);
+
+    __m128i shifts = _mm_sub_epi8(key_window(s, *phase), p->low);
+    if (decrypt) {
+        __m128i zero = _mm_cmpeq_epi8(shifts, _mm_setzero_si128());
+        shifts = _mm_andnot_si128(zero, _mm_sub_epi8(p->size, shifts));
+    }
+    __m128i lane_key = _mm_shuffle_epi8(shifts, prefix);
+
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(in_range, one));
+    if (lanes < 16) {
+        mask &= (1u << lanes) - 1;
+    }
+    *phase += (size_t)__builtin_popcount(mask);
+    if (*phase >= s->len) {
+        *phase -= s->len;
+    }
+    return shift_vec_apply(p, v, lane_key);
+}
+
+// the vigenere kernel; if `checker` is non-null the input is also validated as UTF-8
+// in the same pass
+__attribute__((target("ssse3")))
+static size_t vigenere_ssse3(char range_low, char range_high, const char *key,
+                             size_t key_len, size_t phase, bool decrypt,
+                             const char *in, char *out, size_t len,
+                             struct utf8_checker *checker)
+{
+    struct shift_vec p = shift_vec_init(range_low, range_high);
+    struct key_schedule schedule;
+    key_schedule_init(&schedule, key, key_len);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(in + i));
+        if (checker) {
+            utf8_check_vec(checker, v);
+        }
+        __m128i r = vigenere_vec(&p, &schedule, &phase, decrypt, v, 16);
+        _mm_storeu_si128((__m128i *)(void *)(out + i), r);
+    }
+    if (i < len) {
+        char tail[16] = {0};
+        memcpy(tail, in + i, len - i);
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)tail);
+        if (checker) {
+            utf8_check_vec(checker, v);
+        }
+        __m128i r = vigenere_vec(&p, &schedule, &phase, decrypt, v, (unsigned)(len - i));
+        _mm_storeu_si128((__m128i *)(void *)tail, r);
+        memcpy(out + i, tail, len - i);
+    }
+    return phase % key_len;
+}
+
+#endif
+
+#ifdef SAFECIPHER_X86
+
+unsigned cpu_features;
+
+// the OS must save the AVX registers (XCR0 bits 1 and 2) as well as the CPU having AVX2;
+// racing callers detect the same features, so the store needs no lock
+unsigned cpu_detect(void)
+{
+    unsigned a, b, c, d;
+    unsigned features = CPU_DETECTED;
+
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        features |= (c & bit_SSSE3 ? CPU_SSSE3 : 0u) | (c & bit_SSE4_2 ? CPU_SSE42 : 0u);
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            unsigned xcr0, xcr0_high;
+            __asm__ volatile ("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+            if ((xcr0 & 6) == 6 && __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2)) {
+                features |= CPU_AVX2;
+            }
+        }
+    }
+    __atomic_store_n(&cpu_features, features, __ATOMIC_RELAXED);
+    return features;
+}
+
+#endif
+
+// shifts all in-range characters of `in[0..len)` by `key` into `out`, using the
+// fastest kernel the CPU supports
+void caesar_transform(char range_low, char range_high, int key,
+                      const char *in, char *out, size_t len)
+{
+    int range_size = range_high - range_low + 1;
+    key = (key % range_size + range_size) % range_size;
+#ifdef SAFECIPHER_X86
+    TRACE_INSTANT(caesar_sse2, len);
+    caesar_sse2(range_low, range_high, key, in, out, len);
+#else
+    TRACE_INSTANT(caesar_scalar, len);
+    caesar_scalar(range_low, range_high, key, in, out, len);
+#endif
+}
+
+// applies the vigenere cipher to `in[0..len)` starting at key position `phase`, and
+// returns the key position following the last in-range character
+size_t vigenere_transform(char range_low, char range_high, const char *key,
+                          size_t key_len, size_t phase, bool decrypt,
+                          const char *in, char *out, size_t len)
+{
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        TRACE_INSTANT(vigenere_ssse3, len);
+        return vigenere_ssse3(range_low, range_high, key, key_len, phase, decrypt,
+                              in, out, len, NULL);
+    }
+#endif
+    TRACE_INSTANT(vigenere_scalar, len);
+    return vigenere_scalar(range_low, range_high, key, key_len, phase, decrypt, in, out, len);
+}
+
+// counts the in-range bytes of `text[0..len)`
+size_t range_count(char range_low, char range_high, const char *text, size_t len)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef SAFECIPHER_X86
+    const __m128i low = _mm_set1_epi8(range_low);
+    const __m128i high = _mm_set1_epi8(range_high);
+    while (i + 16 <= len) {
+        // byte counters take up to 255 vectors before they are summed
+        __m128i counts = _mm_setzero_si128();
+        for (int n = 0; n < 255 && i + 16 <= len; n++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(text + i));
+            __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpgt_epi8(v, high));
+            counts = _mm_add_epi8(counts, _mm_andnot_si128(out_of_range, _mm_set1_epi8(1)));
+        }
+        __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_extract_epi16(sums, 4);
+    }
+#endif
+    for (; i < len; i++) {
+        count += range_low <= text[i] && text[i] <= range_high;
+    }
+    return count;
+}
+
+// caesar cipher encryption
+void caesar_encrypt(char range_low, char range_high, int key, const char * plain_text, char * cipher_text)
+{
+    size_t plain_text_len = strlen(plain_text);
+    caesar_transform(range_low, range_high, key, plain_text, cipher_text, plain_text_len);
     cipher_text[plain_text_len] = '\0';
 }
 
@@ -38,20 +570,8 @@ void caesar_decrypt(char range_low, char range_high, int key, const char * ciphe
 void vigenere_encrypt(char range_low, char range_high, const char *key,
                       const char *plain_text, char *cipher_text) {
     size_t plain_text_len = strlen(plain_text);
-    size_t key_length = strlen(key);
-    size_t index = 0;
-
-    for (size_t i = 0; i < plain_text_len; i++) {
-        char c = plain_text[i];
-
-        if (range_low <= c && c <= range_high) {
-            int caesar_key = key[index] - range_low;
-            caesar_encrypt(range_low, range_high, caesar_key, &plain_text[i], &cipher_text[i]);
-            index = (index + 1) % key_length;
-        } else {
-            cipher_text[i] = c;
-        }
-    }
+    vigenere_transform(range_low, range_high, key, strlen(key), 0, false,
+                       plain_text, cipher_text, plain_text_len);
     cipher_text[plain_text_len] = '\0';
 }
 
@@ -59,22 +579,603 @@ void vigenere_encrypt(char range_low, char range_high, const char *key,
 void vigenere_decrypt(char range_low, char range_high, const char *key,
                       const char *cipher_text, char *plain_text) {
     size_t cipher_text_len = strlen(cipher_text);
-    size_t key_length = strlen(key);
-    size_t index = 0;
+    vigenere_transform(range_low, range_high, key, strlen(key), 0, true,
+                       cipher_text, plain_text, cipher_text_len);
+    plain_text[cipher_text_len] = '\0';
+}
 
-    for (size_t i = 0; i < cipher_text_len; i++) {
-        char c = cipher_text[i];
-        if (range_low <= c && c <= range_high) {
-            int caesar_key = key[index] - range_low;
-            caesar_decrypt(range_low, range_high, caesar_key, &cipher_text[i], &plain_text[i]);
-            index = (index + 1) % key_length;
+// UTF-8 validation
+bool utf8_validate(const char *text, size_t len)
+{
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        return utf8_validate_ssse3(text, len);
+    }
+#endif
+    return utf8_validate_scalar(text, len);
+}
+
+#ifdef SAFECIPHER_X86
+
+// the position of the first flagged byte of four consecutive 16-byte compare results
+static inline size_t first_flagged(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    uint64_t bits = (uint64_t)(unsigned)_mm_movemask_epi8(a)
+                  | (uint64_t)(unsigned)_mm_movemask_epi8(b) << 16
+                  | (uint64_t)(unsigned)_mm_movemask_epi8(c) << 32
+                  | (uint64_t)(unsigned)_mm_movemask_epi8(d) << 48;
+    return bits == 0 ? 64 : (size_t)__builtin_ctzll(bits);
+}
+
+static inline __m128i flag_out_of_range(__m128i v, __m128i low, __m128i high)
+{
+    return _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpgt_epi8(v, high));
+}
+
+// a space, or 0x09 to 0x0d: less 9, the latter wrap to unsigned 0 to 4
+static inline __m128i flag_space(__m128i v)
+{
+    __m128i control = _mm_sub_epi8(v, _mm_set1_epi8(9));
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                        _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control));
+}
+
+static inline __m128i load16(const char *p)
+{
+    return _mm_loadu_si128((const __m128i *)(const void *)p);
+}
+
+#endif
+
+// first out-of-range position; four vectors per step keep the loads ahead of the
+// compares, and one branch tests all four
+size_t range_check(char range_low, char range_high, const char *text, size_t len)
+{
+    size_t i = 0;
+
+#ifdef SAFECIPHER_X86
+    const __m128i low = _mm_set1_epi8(range_low);
+    const __m128i high = _mm_set1_epi8(range_high);
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = flag_out_of_range(load16(text + i), low, high);
+        __m128i b = flag_out_of_range(load16(text + i + 16), low, high);
+        __m128i c = flag_out_of_range(load16(text + i + 32), low, high);
+        __m128i d = flag_out_of_range(load16(text + i + 48), low, high);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) {
+            return i + first_flagged(a, b, c, d);
+        }
+    }
+    for (; i + 16 <= len; i += 16) {
+        int m = _mm_movemask_epi8(flag_out_of_range(load16(text + i), low, high));
+        if (m != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)m);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (text[i] < range_low || text[i] > range_high) {
+            break;
+        }
+    }
+    return i;
+}
+
+// first whitespace position, as range_check
+size_t whitespace_check(const char *text, size_t len)
+{
+    size_t i = 0;
+
+#ifdef SAFECIPHER_X86
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = flag_space(load16(text + i));
+        __m128i b = flag_space(load16(text + i + 16));
+        __m128i c = flag_space(load16(text + i + 32));
+        __m128i d = flag_space(load16(text + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) {
+            return i + first_flagged(a, b, c, d);
+        }
+    }
+    for (; i + 16 <= len; i += 16) {
+        int m = _mm_movemask_epi8(flag_space(load16(text + i)));
+        if (m != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)m);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (text[i] == ' ' || (text[i] >= '\t' && text[i] <= '\r')) {
+            break;
+        }
+    }
+    return i;
+}
+
+// caesar cipher encryption of UTF-8 text
+bool caesar_encrypt_utf8(char range_low, char range_high, int key, const char *plain_text,
+                         char *cipher_text)
+{
+    size_t plain_text_len = strlen(plain_text);
+    bool valid;
+
+    // bytes of multibyte sequences are all negative, so an ASCII range never
+    // matches them and they pass through the kernel untouched
+    if (range_low < 0) {
+        cipher_text[0] = '\0';
+        return false;
+    }
+
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        int range_size = range_high - range_low + 1;
+        key = (key % range_size + range_size) % range_size;
+        valid = caesar_utf8_ssse3(range_low, range_high, key, plain_text, cipher_text,
+                                  plain_text_len);
+    } else
+#endif
+    {
+        valid = utf8_validate_scalar(plain_text, plain_text_len);
+        if (valid) {
+            caesar_transform(range_low, range_high, key, plain_text, cipher_text, plain_text_len);
+        }
+    }
+
+    if (!valid) {
+        cipher_text[0] = '\0';
+        return false;
+    }
+    cipher_text[plain_text_len] = '\0';
+    return true;
+}
+
+// caesar cipher decryption of UTF-8 text
+bool caesar_decrypt_utf8(char range_low, char range_high, int key, const char *cipher_text,
+                         char *plain_text)
+{
+    return caesar_encrypt_utf8(range_low, range_high, -key, cipher_text, plain_text);
+}
+
+// shared implementation of vigenere_encrypt_utf8 and vigenere_decrypt_utf8
+static bool vigenere_utf8(char range_low, char range_high, const char *key, bool decrypt,
+                          const char *in, char *out)
+{
+    size_t len = strlen(in);
+    bool valid;
+
+    if (range_low < 0) {
+        out[0] = '\0';
+        return false;
+    }
+
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        struct utf8_checker checker;
+        utf8_checker_init(&checker);
+        vigenere_ssse3(range_low, range_high, key, strlen(key), 0, decrypt, in, out, len,
+                       &checker);
+        valid = utf8_checker_ok(&checker);
+    } else
+#endif
+    {
+        valid = utf8_validate_scalar(in, len);
+        if (valid) {
+            vigenere_scalar(range_low, range_high, key, strlen(key), 0, decrypt, in, out, len);
+        }
+    }
+
+    if (!valid) {
+        out[0] = '\0';
+        return false;
+    }
+    out[len] = '\0';
+    return true;
+}
+
+// vigenere cipher encryption of UTF-8 text
+bool vigenere_encrypt_utf8(char range_low, char range_high, const char *key,
+                           const char *plain_text, char *cipher_text)
+{
+    return vigenere_utf8(range_low, range_high, key, false, plain_text, cipher_text);
+}
+
+// vigenere cipher decryption of UTF-8 text
+bool vigenere_decrypt_utf8(char range_low, char range_high, const char *key,
+                           const char *cipher_text, char *plain_text)
+{
+    return vigenere_utf8(range_low, range_high, key, true, cipher_text, plain_text);
+}
+
+/* Code-point ciphers: UTF-8 is decoded into 32-bit code points a chunk at a time,
+ * shifted four lanes per vector, and encoded back. */
+
+// code points decoded per chunk; small enough to stay on the stack and in L1
+#define   CODEPOINT_CHUNK   512
+
+#define   CODEPOINT_MAX     0x10FFFFu
+
+// true if [low, high] is a usable alphabet: non-empty, excluding NUL and never
+// reaching into the surrogates (which would encrypt into invalid UTF-8)
+static bool codepoint_range_valid(uint32_t low, uint32_t high)
+{
+    return 0 < low && low < high && high <= CODEPOINT_MAX && (high < 0xD800 || low > 0xDFFF);
+}
+
+// decodes a well-formed sequence of `n` bytes (as checked by utf8_sequence)
+static uint32_t utf8_decode_sequence(const unsigned char *s, size_t n)
+{
+    uint32_t cp = s[0] & (0x7Fu >> n);
+    for (size_t i = 1; i < n; i++) {
+        cp = (cp << 6) | (s[i] & 0x3Fu);
+    }
+    return cp;
+}
+
+// decodes up to `max` code points from `text[*pos..len)`, advancing `*pos`
+// returns the number of code points decoded, or SIZE_MAX if the input is not UTF-8
+static size_t utf8_decode(const char *text, size_t len, size_t *pos, uint32_t *cps, size_t max)
+{
+    const unsigned char *s = (const unsigned char *)text;
+    size_t i = *pos;
+    size_t n = 0;
+
+    while (n < max && i < len) {
+#ifdef SAFECIPHER_X86
+        if (n + 16 <= max && i + 16 <= len) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(s + i));
+            if (_mm_movemask_epi8(v) == 0) {
+                // sixteen ASCII bytes widen straight into sixteen code points
+                __m128i zero = _mm_setzero_si128();
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+                _mm_storeu_si128((__m128i *)(void *)(cps + n), _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128((__m128i *)(void *)(cps + n + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128((__m128i *)(void *)(cps + n + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128((__m128i *)(void *)(cps + n + 12), _mm_unpackhi_epi16(hi, zero));
+                n += 16;
+                i += 16;
+                continue;
+            }
+            // eight two-byte sequences (Greek, Cyrillic, ...) decode as 16-bit lanes
+            __m128i lead = _mm_and_si128(v, _mm_set1_epi16(0x00E0));
+            __m128i cont = _mm_and_si128(v, _mm_set1_epi16((short)0xC000));
+            __m128i ok = _mm_and_si128(_mm_cmpeq_epi16(lead, _mm_set1_epi16(0x00C0)),
+                                       _mm_cmpeq_epi16(cont, _mm_set1_epi16((short)0x8000)));
+            // 0xC0 and 0xC1 would be overlong
+            __m128i overlong = _mm_cmplt_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)),
+                                               _mm_set1_epi16(0x00C2));
+            if (_mm_movemask_epi8(_mm_andnot_si128(overlong, ok)) == 0xFFFF) {
+                __m128i high = _mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x001F)), 6);
+                __m128i low = _mm_and_si128(_mm_srli_epi16(v, 8), _mm_set1_epi16(0x003F));
+                __m128i cp = _mm_or_si128(high, low);
+                __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128((__m128i *)(void *)(cps + n), _mm_unpacklo_epi16(cp, zero));
+                _mm_storeu_si128((__m128i *)(void *)(cps + n + 4), _mm_unpackhi_epi16(cp, zero));
+                n += 8;
+                i += 16;
+                continue;
+            }
+        }
+#endif
+        if (s[i] < 0x80) {
+            cps[n++] = s[i++];
+            continue;
+        }
+        size_t seq_len;
+        if (!utf8_sequence(s + i, len - i, &seq_len)) {
+            return SIZE_MAX;
+        }
+        cps[n++] = utf8_decode_sequence(s + i, seq_len);
+        i += seq_len;
+    }
+    *pos = i;
+    return n;
+}
+
+// encodes `n` code points into `out[*pos..size)`, advancing `*pos`
+// returns false if the output buffer is too small
+static bool utf8_encode(const uint32_t *cps, size_t n, char *out, size_t size, size_t *pos)
+{
+    unsigned char *o = (unsigned char *)out;
+    size_t j = *pos;
+    size_t i = 0;
+
+    while (i < n) {
+#ifdef SAFECIPHER_X86
+        if (i + 8 <= n && size - j >= 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(const void *)(cps + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(const void *)(cps + i + 4));
+            __m128i cp = _mm_packs_epi32(a, b);   // exact, as code points are < 2^21
+            __m128i wide = _mm_or_si128(_mm_srli_epi32(a, 11), _mm_srli_epi32(b, 11));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(wide, _mm_setzero_si128())) == 0xFFFF) {
+                __m128i ascii = _mm_cmplt_epi16(cp, _mm_set1_epi16(0x80));
+                if (_mm_movemask_epi8(ascii) == 0xFFFF) {
+                    _mm_storel_epi64((__m128i *)(void *)(o + j), _mm_packus_epi16(cp, cp));
+                    i += 8;
+                    j += 8;
+                    continue;
+                }
+                if (_mm_movemask_epi8(ascii) == 0) {
+                    // eight code points in [0x80, 0x800) become eight two-byte sequences
+                    __m128i lead = _mm_or_si128(_mm_srli_epi16(cp, 6), _mm_set1_epi16(0x00C0));
+                    __m128i cont = _mm_or_si128(_mm_and_si128(cp, _mm_set1_epi16(0x003F)),
+                                                _mm_set1_epi16(0x0080));
+                    _mm_storeu_si128((__m128i *)(void *)(o + j),
+                                     _mm_or_si128(lead, _mm_slli_epi16(cont, 8)));
+                    i += 8;
+                    j += 16;
+                    continue;
+                }
+            }
+        }
+#endif
+        uint32_t c = cps[i++];
+        size_t n_bytes = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+        if (size - j < n_bytes) {
+            return false;
+        }
+        if (n_bytes == 1) {
+            o[j++] = (unsigned char)c;
+            continue;
+        }
+        static const unsigned char lead_bits[5] = {0, 0, 0xC0, 0xE0, 0xF0};
+        o[j] = (unsigned char)(lead_bits[n_bytes] | (c >> (6 * (n_bytes - 1))));
+        for (size_t k = 1; k < n_bytes; k++) {
+            o[j + k] = (unsigned char)(0x80 | ((c >> (6 * (n_bytes - 1 - k))) & 0x3F));
+        }
+        j += n_bytes;
+    }
+    *pos = j;
+    return true;
+}
+
+// shifts an in-range code point by `key` positions, where `key` is in [0, size)
+static uint32_t codepoint_shift(uint32_t low, uint32_t high, uint32_t key, uint32_t c)
+{
+    if (low <= c && c <= high) {
+        uint32_t size = high - low + 1;
+        uint32_t offset = c - low;
+        c = offset >= size - key ? c + key - size : c + key;
+    }
+    return c;
+}
+
+#ifdef SAFECIPHER_X86
+
+// parameters for shifting all in-range code points of a vector
+struct codepoint_vec {
+    __m128i low_minus_one;
+    __m128i high_plus_one;
+    __m128i low;
+    __m128i size;
+};
+
+static inline struct codepoint_vec codepoint_vec_init(uint32_t low, uint32_t high)
+{
+    struct codepoint_vec p;
+    // code points are below 2^21, so signed 32-bit compares are exact
+    p.low_minus_one = _mm_set1_epi32((int)low - 1);
+    p.high_plus_one = _mm_set1_epi32((int)high + 1);
+    p.low = _mm_set1_epi32((int)low);
+    p.size = _mm_set1_epi32((int)(high - low + 1));
+    return p;
+}
+
+static inline __m128i codepoint_in_range(const struct codepoint_vec *p, __m128i v)
+{
+    return _mm_and_si128(_mm_cmpgt_epi32(v, p->low_minus_one), _mm_cmplt_epi32(v, p->high_plus_one));
+}
+
+// the 32-bit lane analogue of shift_vec_apply
+static inline __m128i codepoint_vec_apply(const struct codepoint_vec *p, __m128i v, __m128i key,
+                                          __m128i in_range)
+{
+    __m128i offset = _mm_sub_epi32(v, p->low);
+    __m128i threshold = _mm_sub_epi32(p->size, key);
+    __m128i no_wrap = _mm_cmplt_epi32(offset, threshold);
+    __m128i shift = _mm_sub_epi32(key, _mm_andnot_si128(no_wrap, p->size));
+    return _mm_add_epi32(v, _mm_and_si128(in_range, shift));
+}
+
+static void codepoint_caesar_sse2(uint32_t low, uint32_t high, uint32_t key, uint32_t *cps, size_t n)
+{
+    struct codepoint_vec p = codepoint_vec_init(low, high);
+    __m128i k = _mm_set1_epi32((int)key);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(cps + i));
+        v = codepoint_vec_apply(&p, v, k, codepoint_in_range(&p, v));
+        _mm_storeu_si128((__m128i *)(void *)(cps + i), v);
+    }
+    for (; i < n; i++) {
+        cps[i] = codepoint_shift(low, high, key, cps[i]);
+    }
+}
+
+// the 32-bit lane analogue of vigenere_vec over a schedule of (already inverted, for
+// decryption) shifts that is padded by four entries so windows never wrap
+__attribute__((target("ssse3")))
+static size_t codepoint_vigenere_ssse3(uint32_t low, uint32_t high, const uint32_t *schedule,
+                                       size_t key_len, size_t phase, uint32_t *cps, size_t n)
+{
+    struct codepoint_vec p = codepoint_vec_init(low, high);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i byte_index = _mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(cps + i));
+        __m128i in_range = codepoint_in_range(&p, v);
+        __m128i ones = _mm_and_si128(in_range, one);
+        __m128i prefix = _mm_add_epi32(ones, _mm_slli_si128(ones, 4));
+        prefix = _mm_add_epi32(prefix, _mm_slli_si128(prefix, 8));
+        prefix = _mm_sub_epi32(prefix, ones);
+        // lane j takes the 32-bit window entry at its exclusive prefix count
+        __m128i lane = _mm_slli_epi32(prefix, 2);
+        lane = _mm_or_si128(_mm_or_si128(lane, _mm_slli_epi32(lane, 8)),
+                            _mm_or_si128(_mm_slli_epi32(lane, 16), _mm_slli_epi32(lane, 24)));
+        __m128i window = _mm_loadu_si128((const __m128i *)(const void *)(schedule + phase));
+        __m128i key = _mm_shuffle_epi8(window, _mm_add_epi8(lane, byte_index));
+        v = codepoint_vec_apply(&p, v, key, in_range);
+        _mm_storeu_si128((__m128i *)(void *)(cps + i), v);
+        phase = (phase + (size_t)__builtin_popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(in_range))))
+                % key_len;
+    }
+    for (; i < n; i++) {
+        if (low <= cps[i] && cps[i] <= high) {
+            cps[i] = codepoint_shift(low, high, schedule[phase], cps[i]);
+            phase = (phase + 1) % key_len;
+        }
+    }
+    return phase;
+}
+
+#endif
+
+static size_t codepoint_vigenere(uint32_t low, uint32_t high, const uint32_t *schedule,
+                                 size_t key_len, size_t phase, uint32_t *cps, size_t n)
+{
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        return codepoint_vigenere_ssse3(low, high, schedule, key_len, phase, cps, n);
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        if (low <= cps[i] && cps[i] <= high) {
+            cps[i] = codepoint_shift(low, high, schedule[phase], cps[i]);
+            phase = (phase + 1) % key_len;
+        }
+    }
+    return phase;
+}
+
+// runs either cipher over UTF-8 text: caesar with `key` if `schedule` is null,
+// otherwise vigenere with the `key_len` shifts in `schedule`
+static bool codepoint_cipher(uint32_t low, uint32_t high, uint32_t key,
+                             const uint32_t *schedule, size_t key_len,
+                             const char *in, char *out, size_t out_size)
+{
+    uint32_t cps[CODEPOINT_CHUNK];
+    size_t len = strlen(in);
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    size_t phase = 0;
+
+    if (out_size == 0) {
+        return false;
+    }
+    while (in_pos < len) {
+        size_t n = utf8_decode(in, len, &in_pos, cps, CODEPOINT_CHUNK);
+        if (n == SIZE_MAX) {
+            out[0] = '\0';
+            return false;
+        }
+        if (schedule) {
+            phase = codepoint_vigenere(low, high, schedule, key_len, phase, cps, n);
         } else {
-            plain_text[i] = c;
+#ifdef SAFECIPHER_X86
+            codepoint_caesar_sse2(low, high, key, cps, n);
+#else
+            for (size_t i = 0; i < n; i++) {
+                cps[i] = codepoint_shift(low, high, key, cps[i]);
+            }
+#endif
+        }
+        // keep one byte for the terminating null character
+        if (!utf8_encode(cps, n, out, out_size - 1, &out_pos)) {
+            out[0] = '\0';
+            return false;
         }
     }
-    plain_text[cipher_text_len] = '\0';
+    out[out_pos] = '\0';
+    return true;
 }
 
+// shared implementation of caesar_encrypt_codepoints and caesar_decrypt_codepoints
+static bool caesar_codepoints(uint32_t range_low, uint32_t range_high, int key, bool decrypt,
+                              const char *in, char *out, size_t out_size)
+{
+    if (!codepoint_range_valid(range_low, range_high)) {
+        if (out_size > 0) {
+            out[0] = '\0';
+        }
+        return false;
+    }
+    int range_size = (int)(range_high - range_low + 1);
+    int shift = (key % range_size + range_size) % range_size;
+    if (decrypt) {
+        shift = (range_size - shift) % range_size;
+    }
+    return codepoint_cipher(range_low, range_high, (uint32_t)shift, NULL, 0, in, out, out_size);
+}
 
+// caesar cipher encryption over a range of code points
+bool caesar_encrypt_codepoints(uint32_t range_low, uint32_t range_high, int key,
+                               const char *plain_text, char *cipher_text, size_t cipher_size)
+{
+    return caesar_codepoints(range_low, range_high, key, false, plain_text, cipher_text,
+                             cipher_size);
+}
+
+// caesar cipher decryption over a range of code points
+bool caesar_decrypt_codepoints(uint32_t range_low, uint32_t range_high, int key,
+                               const char *cipher_text, char *plain_text, size_t plain_size)
+{
+    return caesar_codepoints(range_low, range_high, key, true, cipher_text, plain_text,
+                             plain_size);
+}
 
+// shared implementation of vigenere_encrypt_codepoints and vigenere_decrypt_codepoints
+static bool vigenere_codepoints(uint32_t range_low, uint32_t range_high, const char *key,
+                                bool decrypt, const char *in, char *out, size_t out_size)
+{
+    size_t key_bytes = strlen(key);
+    // one code point per key byte at most, plus the padding read by the vector kernel
+    uint32_t *schedule = NULL;
+    size_t key_len = 0;
+    size_t pos = 0;
+    bool ok = codepoint_range_valid(range_low, range_high) && key_bytes > 0;
 
+    if (ok) {
+        schedule = mem_malloc((key_bytes + 4) * sizeof(*schedule));
+        ok = schedule != NULL;
+    }
+    if (ok) {
+        key_len = utf8_decode(key, key_bytes, &pos, schedule, key_bytes);
+        ok = key_len != SIZE_MAX;
+    }
+    for (size_t i = 0; ok && i < key_len; i++) {
+        uint32_t c = schedule[i];
+        if (c < range_low || c > range_high) {
+            ok = false;
+            break;
+        }
+        uint32_t range_size = range_high - range_low + 1;
+        schedule[i] = decrypt ? (range_size - (c - range_low)) % range_size : c - range_low;
+    }
+    if (ok) {
+        for (size_t i = 0; i < 4; i++) {
+            schedule[key_len + i] = schedule[i % key_len];
+        }
+        ok = codepoint_cipher(range_low, range_high, 0, schedule, key_len, in, out, out_size);
+    } else if (out_size > 0) {
+        out[0] = '\0';
+    }
+    free(schedule);
+    return ok;
+}
+
+// vigenere cipher encryption over a range of code points
+bool vigenere_encrypt_codepoints(uint32_t range_low, uint32_t range_high, const char *key,
+                                 const char *plain_text, char *cipher_text, size_t cipher_size)
+{
+    return vigenere_codepoints(range_low, range_high, key, false, plain_text, cipher_text,
+                               cipher_size);
+}
+
+// vigenere cipher decryption over a range of code points
+bool vigenere_decrypt_codepoints(uint32_t range_low, uint32_t range_high, const char *key,
+                                 const char *cipher_text, char *plain_text, size_t plain_size)
+{
+    return vigenere_codepoints(range_low, range_high, key, true, cipher_text, plain_text,
+                               plain_size);
+}
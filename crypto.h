@@ -7,6 +7,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /** Encrypt a given plaintext using the Caesar cipher, using a specified key, where the
   * characters to encrypt fall within a given range (and all other characters are copied
@@ -140,6 +145,1053 @@ void vigenere_decrypt(char range_low, char range_high, const char *key,
                       const char *cipher_text, char *plain_text
 );
 
+/** Check whether a buffer holds well-formed UTF-8.
+  *
+  * Rejects overlong encodings, surrogates (U+D800 to U+DFFF), code points above
+  * U+10FFFF, stray continuation bytes and sequences truncated by the end of the buffer.
+  * On CPUs with SSSE3 the check runs sixteen bytes at a time; pure ASCII blocks cost a
+  * single compare.
+  *
+  * \param text A pointer to the bytes to validate (need not be null-terminated)
+  * \param len The number of bytes to validate
+  * \return `true` if the `len` bytes at `text` are valid UTF-8, `false` otherwise.
+  */
+bool utf8_validate(const char *text, size_t len);
+
+/** Find the first character of a buffer outside a range.
+  *
+  * Checks sixteen bytes per compare, four compares per step, so a key of many megabytes
+  * is checked about as fast as it can be read.
+  *
+  * \param range_low The lowest character allowed
+  * \param range_high The highest character allowed
+  * \param text A pointer to the bytes to check (need not be null-terminated)
+  * \param len The number of bytes to check
+  * \return The position of the first byte outside the range from `range_low` to
+  *         `range_high` (inclusive), or `len` if every byte is within it.
+  */
+size_t range_check(char range_low, char range_high, const char *text, size_t len);
+
+/** Find the first whitespace character of a buffer.
+  *
+  * Whitespace is what `isspace` accepts in the "C" locale: space, tab, newline, vertical
+  * tab, form feed and carriage return. Checks sixteen bytes per compare, as
+  * `range_check` does.
+  *
+  * \param text A pointer to the bytes to check (need not be null-terminated)
+  * \param len The number of bytes to check
+  * \return The position of the first whitespace byte, or `len` if there is none.
+  */
+size_t whitespace_check(const char *text, size_t len);
+
+/** Encrypt a given UTF-8 plaintext using the Caesar cipher.
+  *
+  * Behaves exactly like `caesar_encrypt`, except that `plain_text` is validated as
+  * UTF-8 in the same pass as it is encrypted. Since every byte of a multibyte sequence
+  * is outside an ASCII range, non-ASCII characters are copied over unchanged.
+  *
+  * \param range_low A character representing the lower bound of the character range to be
+  *           encrypted
+  * \param range_high A character representing the upper bound of the character range
+  * \param key The encryption key
+  * \param plain_text A null-terminated UTF-8 string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored. The
+  *           buffer must be large enough to hold a C string of the same length as
+  *           plain_text (including the terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`,
+  *         if `plain_text` is not valid UTF-8 or the range is not within ASCII.
+  *
+  * \pre The same preconditions as `caesar_encrypt`.
+  */
+bool caesar_encrypt_utf8(char range_low, char range_high, int key, const char *plain_text,
+                         char *cipher_text);
+
+/** Decrypt a given UTF-8 ciphertext using the Caesar cipher.
+  *
+  * Calling `caesar_decrypt_utf8` with some key $n$ is exactly equivalent to calling
+  * `caesar_encrypt_utf8` with the key $-n$.
+  *
+  * \return `true` on success, `false` if `cipher_text` is not valid UTF-8 or the range
+  *         is not within ASCII.
+  *
+  * \pre The same preconditions as `caesar_decrypt`.
+  */
+bool caesar_decrypt_utf8(char range_low, char range_high, int key, const char *cipher_text,
+                         char *plain_text);
+
+/** Encrypt a given UTF-8 plaintext using the Vigenere cipher.
+  *
+  * Behaves exactly like `vigenere_encrypt`, except that `plain_text` is validated as
+  * UTF-8 in the same pass as it is encrypted. Non-ASCII characters are copied over
+  * unchanged and do not advance the key.
+  *
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`,
+  *         if `plain_text` is not valid UTF-8 or the range is not within ASCII.
+  *
+  * \pre The same preconditions as `vigenere_encrypt`.
+  */
+bool vigenere_encrypt_utf8(char range_low, char range_high, const char *key,
+                           const char *plain_text, char *cipher_text);
+
+/** Decrypt a given UTF-8 ciphertext using the Vigenere cipher.
+  *
+  * Calling `vigenere_decrypt_utf8` with some key $k$ exactly reverses the operation of
+  * `vigenere_encrypt_utf8` when called with the same key.
+  *
+  * \return `true` on success, `false` if `cipher_text` is not valid UTF-8 or the range
+  *         is not within ASCII.
+  *
+  * \pre The same preconditions as `vigenere_decrypt`.
+  */
+bool vigenere_decrypt_utf8(char range_low, char range_high, const char *key,
+                           const char *cipher_text, char *plain_text);
+
+/** Encrypt a given UTF-8 plaintext using the Caesar cipher over an arbitrary range of
+  * Unicode code points (for example U+0391 to U+03A9 for upper-case Greek).
+  *
+  * Each code point of `plain_text` within `range_low` to `range_high` is shifted by
+  * `key` positions (modulo the size of the range); all other code points are copied
+  * over unchanged. Internally the text is decoded into 32-bit code points a chunk at a
+  * time and shifted four per SIMD vector.
+  *
+  * Because a shifted code point may need a different number of bytes than the original
+  * one, the output length can differ from the input length; `4 * strlen(plain_text) + 1`
+  * bytes are always enough.
+  *
+  * \param range_low The lowest code point of the range to be encrypted
+  * \param range_high The highest code point of the range
+  * \param key The encryption key
+  * \param plain_text A null-terminated UTF-8 string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored.
+  * \param cipher_size The size of the `cipher_text` buffer in bytes
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`
+  *         (if it has room for one), if `plain_text` is not valid UTF-8, the range is not
+  *         valid or `cipher_text` is too small.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`, `range_low` must be
+  *      greater than zero, `range_high` must be at most U+10FFFF, and the range must not
+  *      include any surrogate code point (U+D800 to U+DFFF).
+  */
+bool caesar_encrypt_codepoints(uint32_t range_low, uint32_t range_high, int key,
+                               const char *plain_text, char *cipher_text, size_t cipher_size);
+
+/** Decrypt a given UTF-8 ciphertext using the Caesar cipher over an arbitrary range of
+  * Unicode code points.
+  *
+  * Calling `caesar_decrypt_codepoints` with some key $n$ is exactly equivalent to
+  * calling `caesar_encrypt_codepoints` with the key $-n$.
+  *
+  * \pre The same preconditions as `caesar_encrypt_codepoints`.
+  */
+bool caesar_decrypt_codepoints(uint32_t range_low, uint32_t range_high, int key,
+                               const char *cipher_text, char *plain_text, size_t plain_size);
+
+/** Encrypt a given UTF-8 plaintext using the Vigenere cipher over an arbitrary range of
+  * Unicode code points.
+  *
+  * The semantics are those of `vigenere_encrypt`, counted in code points rather than
+  * bytes: `key` is a UTF-8 string whose code points give the shifts, and the key
+  * position only advances on in-range code points.
+  *
+  * \param range_low The lowest code point of the range to be encrypted
+  * \param range_high The highest code point of the range
+  * \param key A null-terminated UTF-8 string containing the encryption key
+  * \param plain_text A null-terminated UTF-8 string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored.
+  * \param cipher_size The size of the `cipher_text` buffer in bytes
+  * \return `true` on success, `false` if either string is not valid UTF-8, the range
+  *         or key is not valid, `cipher_text` is too small or memory for the key
+  *         schedule could not be allocated.
+  *
+  * \pre The range preconditions of `caesar_encrypt_codepoints`.
+  * \pre `key` must not be an empty string, and all code points in `key` must be within
+  *        the range from `range_low` to `range_high` (inclusive).
+  */
+bool vigenere_encrypt_codepoints(uint32_t range_low, uint32_t range_high, const char *key,
+                                 const char *plain_text, char *cipher_text, size_t cipher_size);
+
+/** Decrypt a given UTF-8 ciphertext using the Vigenere cipher over an arbitrary range of
+  * Unicode code points.
+  *
+  * Calling `vigenere_decrypt_codepoints` with some key $k$ exactly reverses the
+  * operation of `vigenere_encrypt_codepoints` when called with the same key.
+  *
+  * \pre The same preconditions as `vigenere_encrypt_codepoints`.
+  */
+bool vigenere_decrypt_codepoints(uint32_t range_low, uint32_t range_high, const char *key,
+                                 const char *cipher_text, char *plain_text, size_t plain_size);
+
+/** Text encodings for ciphertext that may hold arbitrary bytes. */
+enum text_encoding {
+    ENCODING_HEX,       /**< two lower-case hex digits per byte (either case is decoded) */
+    ENCODING_BASE64,    /**< standard base64 (RFC 4648), padded with '=' */
+    ENCODING_NONE       /**< the bytes themselves */
+};
+
+/** The number of characters `text_encode` produces for `len` bytes, not counting the
+  * terminating null character.
+  */
+size_t encoded_length(enum text_encoding encoding, size_t len);
+
+/** The most bytes `text_decode` can produce from `len` characters, not counting the
+  * terminating null character (base64 padding may make the actual number smaller).
+  */
+size_t decoded_length(enum text_encoding encoding, size_t len);
+
+/** Encode `len` bytes as hex or base64.
+  *
+  * Hex is encoded sixteen bytes per SSE2 vector, and base64 twelve bytes per SSSE3
+  * vector on CPUs that have it.
+  *
+  * \param encoding The encoding to produce
+  * \param in A pointer to the bytes to encode (need not be null-terminated)
+  * \param len The number of bytes to encode
+  * \param out A pointer to a buffer of at least `encoded_length(encoding, len) + 1` bytes,
+  *           where the encoded text and a terminating null character will be stored
+  * \return The number of characters written, not counting the terminating null character.
+  */
+size_t text_encode(enum text_encoding encoding, const char *in, size_t len, char *out);
+
+/** Decode `len` characters of hex or base64 back into bytes.
+  *
+  * \param encoding The encoding of `in`
+  * \param in A pointer to the encoded text (need not be null-terminated)
+  * \param len The number of characters to decode
+  * \param out A pointer to a buffer of at least `decoded_length(encoding, len) + 1` bytes,
+  *           where the decoded bytes and a terminating null character will be stored
+  * \return The number of bytes written, not counting the terminating null character, or
+  *         `SIZE_MAX`, leaving an empty string in `out`, if `in` is not valid in the
+  *         encoding (a character outside it, an incomplete digit pair or base64 group, or
+  *         padding anywhere but the end).
+  */
+size_t text_decode(enum text_encoding encoding, const char *in, size_t len, char *out);
+
+/** Encrypt `len` bytes with the Caesar cipher and encode the ciphertext as hex or base64
+  * in the same pass.
+  *
+  * The semantics are those of `caesar_encrypt` followed by `text_encode`, but the text
+  * is enciphered a few kilobytes at a time into a small scratch buffer that is encoded
+  * while still in cache, so the raw ciphertext is never held in full. Because the
+  * length is given, `plain_text` may contain null characters, as may the ciphertext
+  * (with a range covering every byte value, for instance).
+  *
+  * \param range_low A character representing the lower bound of the character range to be
+  *           encrypted
+  * \param range_high A character representing the upper bound of the character range
+  * \param key The Caesar key (any integer)
+  * \param plain_text A pointer to the plaintext (need not be null-terminated)
+  * \param len The number of bytes of plaintext
+  * \param encoding The encoding of the ciphertext
+  * \param cipher_text A pointer to a buffer of at least `encoded_length(encoding, len) + 1`
+  *           bytes, where the encoded ciphertext and a terminating null character will be
+  *           stored
+  * \return The number of characters written, not counting the terminating null character.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+size_t caesar_encrypt_encoded(char range_low, char range_high, int key, const char *plain_text,
+                              size_t len, enum text_encoding encoding, char *cipher_text);
+
+/** Decode a hex or base64 ciphertext and decrypt it with the Caesar cipher in the same
+  * pass, each block being deciphered in place right after it is decoded.
+  *
+  * Calling `caesar_decrypt_encoded` with some key exactly reverses the operation of
+  * `caesar_encrypt_encoded` when called with the same key and encoding.
+  *
+  * \param cipher_text A pointer to the encoded ciphertext (need not be null-terminated)
+  * \param len The number of characters of encoded ciphertext
+  * \param plain_text A pointer to a buffer of at least `decoded_length(encoding, len) + 1`
+  *           bytes, where the plaintext and a terminating null character will be stored
+  * \return The number of bytes of plaintext, not counting the terminating null character,
+  *         or `SIZE_MAX`, leaving an empty string in `plain_text`, if `cipher_text` is not
+  *         valid in the encoding.
+  *
+  * \pre The same preconditions as `caesar_encrypt_encoded`.
+  */
+size_t caesar_decrypt_encoded(char range_low, char range_high, int key, const char *cipher_text,
+                              size_t len, enum text_encoding encoding, char *plain_text);
+
+/** Encrypt `len` bytes with the Vigenere cipher and encode the ciphertext as hex or
+  * base64 in the same pass, as `caesar_encrypt_encoded` does for the Caesar cipher.
+  *
+  * \return The number of characters written, not counting the terminating null character,
+  *         or `SIZE_MAX`, leaving an empty string in `cipher_text`, if `key` is empty or
+  *         has characters outside the range.
+  */
+size_t vigenere_encrypt_encoded(char range_low, char range_high, const char *key,
+                                const char *plain_text, size_t len, enum text_encoding encoding,
+                                char *cipher_text);
+
+/** Decode a hex or base64 ciphertext and decrypt it with the Vigenere cipher in the same
+  * pass, reversing `vigenere_encrypt_encoded`.
+  *
+  * \return The number of bytes of plaintext, not counting the terminating null character,
+  *         or `SIZE_MAX`, leaving an empty string in `plain_text`, if `key` is not valid or
+  *         `cipher_text` is not valid in the encoding.
+  */
+size_t vigenere_decrypt_encoded(char range_low, char range_high, const char *key,
+                                const char *cipher_text, size_t len, enum text_encoding encoding,
+                                char *plain_text);
+
+/** The largest key matrix `hill_encrypt` accepts is `HILL_MAX_ORDER` by `HILL_MAX_ORDER`. */
+#define HILL_MAX_ORDER 8
+
+/** Encrypt a given plaintext using the Hill cipher, where the characters to encrypt fall
+  * within a given range (and all other characters are copied over unchanged).
+  *
+  * The key is a string of n * n in-range characters giving an n by n matrix, row by row,
+  * whose entries are the characters' offsets from `range_low`. The in-range characters of
+  * `plain_text` are taken n at a time (skipping out-of-range characters, which are copied
+  * over in place) and each block, as a column vector of offsets, is multiplied by the
+  * matrix modulo the size of the range. If the number of in-range characters is not a
+  * multiple of n, the final partial block is copied over unchanged.
+  *
+  * Blocks are transformed in batches: eight at a time are multiplied with SIMD
+  * multiply-accumulate instructions and reduced together.
+  *
+  * ## Example usage
+  *
+  * ```c
+  *   char cipher_text[4];
+  *   hill_encrypt('A', 'Z', "GYBNQKURP", "ACT", cipher_text);
+  *   assert(strcmp(cipher_text, "POH") == 0);
+  * ```
+  *
+  * \param range_low A character representing the lower bound of the character range to be
+  *           encrypted
+  * \param range_high A character representing the upper bound of the character range
+  * \param key A null-terminated string of n * n in-range characters (the key matrix)
+  * \param plain_text A null-terminated string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored. The
+  *           buffer must be large enough to hold a C string of the same length as
+  *           plain_text (including the terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`,
+  *         if the key is not a square number of in-range characters, is larger than
+  *         `HILL_MAX_ORDER` by `HILL_MAX_ORDER`, or is not invertible modulo the size of
+  *         the range (so that the text could not be decrypted again).
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool hill_encrypt(char range_low, char range_high, const char *key,
+                  const char *plain_text, char *cipher_text);
+
+/** Decrypt a given ciphertext using the Hill cipher.
+  *
+  * Calling `hill_decrypt` with some key exactly reverses the operation of `hill_encrypt`
+  * when called with the same key: the blocks are multiplied by the inverse of the key
+  * matrix modulo the size of the range.
+  *
+  * \return `true` on success, `false` if the key is not valid (as for `hill_encrypt`).
+  *
+  * \pre The same preconditions as `hill_encrypt`.
+  */
+bool hill_decrypt(char range_low, char range_high, const char *key,
+                  const char *cipher_text, char *plain_text);
+
+/** Encrypt a given plaintext using the Playfair cipher.
+  *
+  * The key is written into a 5x5 grid (dropping repeated letters and reading J as I),
+  * followed by the rest of the alphabet. The letters 'A' to 'Z' of `plain_text` are then
+  * taken two at a time and each digraph is replaced as the grid dictates; all other
+  * characters are copied over unchanged, in place. As usual, J is read as I, an 'X' is
+  * inserted between the letters of a doubled digraph (a 'Q' between two 'X's), and a
+  * final single letter is completed by an 'X' (or 'Q'). These steps happen in the same
+  * pass as the encryption, which translates every digraph with a lookup in a 26x26
+  * table built for the key (with AVX2, eight digraphs per gather instruction).
+  *
+  * Because of the inserted letters, the ciphertext can be longer than the plaintext;
+  * `2 * strlen(plain_text) + 2` bytes are always enough.
+  *
+  * ## Example usage
+  *
+  * ```c
+  *   char cipher_text[64];
+  *   playfair_encrypt("PLAYFAIREXAMPLE", "HIDETHEGOLDINTHETREESTUMP", cipher_text,
+  *                    sizeof(cipher_text));
+  *   assert(strcmp(cipher_text, "BMODZBXDNABEKUDMUIXMMOUVIF") == 0);
+  * ```
+  *
+  * \param key A null-terminated string of upper-case letters
+  * \param plain_text A null-terminated string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored.
+  * \param cipher_size The size of the `cipher_text` buffer in bytes
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`
+  *         (if it has room for one), if the key is empty or contains anything but
+  *         upper-case letters, or `cipher_text` is too small.
+  */
+bool playfair_encrypt(const char *key, const char *plain_text, char *cipher_text,
+                      size_t cipher_size);
+
+/** Decrypt a given ciphertext using the Playfair cipher.
+  *
+  * Reverses `playfair_encrypt` with the same key, except that inserted and trailing
+  * filler letters are left in place (and I cannot be told apart from J).
+  *
+  * \param key A null-terminated string of upper-case letters
+  * \param cipher_text A null-terminated string containing the ciphertext to be decrypted
+  * \param plain_text A pointer to a buffer where the decrypted text will be stored. The
+  *           buffer must be large enough to hold a C string of the same length as
+  *           cipher_text (including the terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `plain_text`,
+  *         if the key is not valid or `cipher_text` could not have been produced by
+  *         `playfair_encrypt` (an odd number of letters, a J, or a doubled digraph).
+  */
+bool playfair_decrypt(const char *key, const char *cipher_text, char *plain_text);
+
+/** Encrypt a given plaintext using the rail fence cipher, where the characters to
+  * encrypt fall within a given range (and all other characters stay in place).
+  *
+  * The in-range characters are written in a zigzag down and up `rails` rails and read
+  * off rail by rail; the out-of-range characters keep their positions, and the
+  * transposed characters fill the remaining positions in order. For example, with three
+  * rails "WEAREDISCOVERED" becomes "WECRERDSOEEAIVD".
+  *
+  * The permutation for a given text length and number of rails is computed once and
+  * applied with SIMD gathers; the most recently used permutations are cached, so
+  * transposing many texts of the same length costs no more than copying them. Texts too
+  * long to cache (over a million characters) are transposed by streaming each rail
+  * separately instead.
+  *
+  * \param range_low A character representing the lower bound of the character range to be
+  *           encrypted
+  * \param range_high A character representing the upper bound of the character range
+  * \param rails The number of rails
+  * \param plain_text A null-terminated string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored. The
+  *           buffer must be large enough to hold a C string of the same length as
+  *           plain_text (including the terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`,
+  *         if `rails` is zero or memory could not be allocated.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool rail_fence_encrypt(char range_low, char range_high, size_t rails,
+                        const char *plain_text, char *cipher_text);
+
+/** Decrypt a given ciphertext using the rail fence cipher.
+  *
+  * Calling `rail_fence_decrypt` with some number of rails exactly reverses the operation
+  * of `rail_fence_encrypt` when called with the same number.
+  *
+  * \pre The same preconditions as `rail_fence_encrypt`.
+  */
+bool rail_fence_decrypt(char range_low, char range_high, size_t rails,
+                        const char *cipher_text, char *plain_text);
+
+/** Encrypt a given plaintext using a route cipher, where the characters to encrypt fall
+  * within a given range (and all other characters stay in place).
+  *
+  * The in-range characters are written row by row into a grid `columns` wide and read
+  * off along a clockwise spiral starting at the top left corner (skipping the empty
+  * cells of an incomplete last row). Permutations are computed, applied and cached as
+  * for `rail_fence_encrypt`.
+  *
+  * \param range_low A character representing the lower bound of the character range to be
+  *           encrypted
+  * \param range_high A character representing the upper bound of the character range
+  * \param columns The width of the grid
+  * \param plain_text A null-terminated string containing the plaintext to be encrypted
+  * \param cipher_text A pointer to a buffer where the encrypted text will be stored. The
+  *           buffer must be large enough to hold a C string of the same length as
+  *           plain_text (including the terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `cipher_text`,
+  *         if `columns` is zero or memory could not be allocated.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool route_encrypt(char range_low, char range_high, size_t columns,
+                   const char *plain_text, char *cipher_text);
+
+/** Decrypt a given ciphertext using a route cipher.
+  *
+  * Calling `route_decrypt` with some number of columns exactly reverses the operation of
+  * `route_encrypt` when called with the same number.
+  *
+  * \pre The same preconditions as `route_encrypt`.
+  */
+bool route_decrypt(char range_low, char range_high, size_t columns,
+                   const char *cipher_text, char *plain_text);
+
+/** The ciphers a `cipher_pipeline` step can apply. */
+enum cipher_kind {
+    CIPHER_CAESAR,      /**< `caesar_encrypt` with the key `shift` */
+    CIPHER_VIGENERE,    /**< `vigenere_encrypt` with the key `key` */
+    CIPHER_HILL,        /**< `hill_encrypt` with the key matrix `key` */
+    CIPHER_RAIL_FENCE,  /**< `rail_fence_encrypt` with `size` rails */
+    CIPHER_ROUTE        /**< `route_encrypt` with a grid `size` columns wide */
+};
+
+/** One step of a `cipher_pipeline`; only the fields its kind uses need be set. */
+struct cipher_step {
+    enum cipher_kind kind;
+    int shift;          /**< the Caesar key */
+    const char *key;    /**< the Vigenere key, or the Hill key matrix */
+    size_t size;        /**< the number of rails or columns */
+};
+
+/** Encrypt or decrypt a text with a sequence of ciphers in a single pass.
+  *
+  * Encryption applies `steps[0]` to `count - 1` in turn, exactly as if each cipher's
+  * encryption function had been called on the output of the previous one, and
+  * decryption undoes them in reverse order. The in-range characters are gathered into a
+  * contiguous buffer once, every step runs over that buffer, and the results are
+  * scattered back into place once, so combining substitutions with transpositions costs
+  * little more than the steps themselves.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param steps A pointer to an array of `count` steps
+  * \param count The number of steps
+  * \param decrypt `false` to encrypt, `true` to decrypt
+  * \param in A null-terminated string containing the text to be transformed
+  * \param out A pointer to a buffer where the transformed text will be stored. The
+  *           buffer must be large enough to hold a C string of the same length as `in`
+  *           (including the terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `out`, if a
+  *         step is not valid (as its cipher's function would reject it, or a Vigenere key
+  *         that is empty or has out-of-range characters) or memory could not be
+  *         allocated.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool cipher_pipeline(char range_low, char range_high, const struct cipher_step *steps,
+                     size_t count, bool decrypt, const char *in, char *out);
+
+/** Compute the CRC-32C (Castagnoli) checksum of `len` bytes, as used by iSCSI, ext4 and
+  * others; `crc32c(0, "123456789", 9)` is 0xe3069283.
+  *
+  * A checksum can be extended: `crc32c(crc32c(0, a, m), b, n)` is the checksum of the `m`
+  * bytes at `a` followed by the `n` bytes at `b`. On CPUs with SSE4.2 the CRC instruction
+  * runs over three interleaved lanes, which are then joined with precomputed tables.
+  *
+  * \param crc The checksum of the preceding bytes, or 0 to start
+  * \param data A pointer to the bytes (need not be null-terminated)
+  * \param len The number of bytes
+  * \return The checksum of the preceding bytes followed by these.
+  */
+uint32_t crc32c(uint32_t crc, const char *data, size_t len);
+
+/** The checksums `cipher_substitute` reports. */
+struct cipher_checksums {
+    uint32_t input;     /**< the CRC-32C of the input as given */
+    uint32_t output;    /**< the CRC-32C of the output as written (without the null) */
+};
+
+/** Encrypt or decrypt `len` bytes with a Caesar or Vigenere step, optionally encoding
+  * the ciphertext, and optionally checksum the input and output in the same pass.
+  *
+  * Encryption enciphers `in` and writes it in `encoding`; decryption reads `in` in
+  * `encoding` and deciphers it, exactly as the `*_encoded` functions do (with
+  * `ENCODING_NONE` the ciphertext is the raw bytes). Both work a few kilobytes at a time,
+  * and the checksums are computed over each block while it is still in cache rather than
+  * in separate passes over the buffers.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param step A `CIPHER_CAESAR` or `CIPHER_VIGENERE` step
+  * \param decrypt `false` to encrypt, `true` to decrypt
+  * \param in A pointer to the input (need not be null-terminated)
+  * \param len The number of bytes of input
+  * \param encoding The encoding of the ciphertext
+  * \param out A pointer to a buffer of at least `encoded_length(encoding, len) + 1` bytes
+  *           when encrypting, or `decoded_length(encoding, len) + 1` when decrypting,
+  *           where the output and a terminating null character will be stored
+  * \param checksums If not NULL, where the CRC-32C checksums of the input and output
+  *           are stored
+  * \return The number of bytes written, not counting the terminating null character, or
+  *         `SIZE_MAX`, leaving an empty string in `out`, if the step is not valid or the
+  *         input is not valid in the encoding.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+size_t cipher_substitute(char range_low, char range_high, const struct cipher_step *step,
+                         bool decrypt, const char *in, size_t len, enum text_encoding encoding,
+                         char *out, struct cipher_checksums *checksums);
+
+/** Encrypt or decrypt a stream (such as a pipe) with a Caesar or Vigenere step, from one
+  * file descriptor to another, until the end of the input.
+  *
+  * A reader thread slices the input into 1 MiB chunks, worker threads transform them in
+  * place concurrently, and the calling thread writes them out in order, so a single
+  * stream's throughput scales with the number of cores (`SAFECIPHER_THREADS` overrides
+  * the thread count). For the Vigenere cipher the reader counts each chunk's in-range
+  * bytes as it goes, which gives the next chunk its key position. At most a few chunks
+  * per worker are held at once, however long the stream. Output is written a chunk at a
+  * time, so this suits bulk data rather than interactive input.
+  *
+  * With `zero_copy`, if the output is a pipe, the chunks' pages are handed to it with
+  * vmsplice instead of being copied in by write(), and a chunk's memory is only reused
+  * once a pipe's worth of later output has gone in after it. That is safe as long as
+  * the program on the other end reads the pipe (as any ordinary program does), but not
+  * if it splices the pages on again without copying them (as `tee` or `pv` may), since
+  * they would then still refer to memory this function writes to later.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param step A `CIPHER_CAESAR` or `CIPHER_VIGENERE` step
+  * \param decrypt `false` to encrypt, `true` to decrypt
+  * \param in_fd The file descriptor to read from
+  * \param out_fd The file descriptor to write to
+  * \param zero_copy Whether to splice the output into `out_fd` if it is a pipe (falling
+  *           back to write() otherwise, or if the kernel does not allow it)
+  * \param checksums If not NULL, where the CRC-32C checksums of everything read and
+  *           everything written are stored
+  * \return `true` on success, `false` if the step is not valid, memory or threads could
+  *         not be allocated, or reading or writing failed (in which case part of the
+  *         output may already have been written).
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool cipher_stream(char range_low, char range_high, const struct cipher_step *step,
+                   bool decrypt, int in_fd, int out_fd, bool zero_copy,
+                   struct cipher_checksums *checksums);
+
+/** The key position following a chunk of text: for a Vigenere step, `position` advanced
+  * by the chunk's in-range characters, modulo the key length; for a Caesar step (which
+  * has no key position), `position`. It depends only on the input, so every chunk's
+  * starting position is known before any chunk has been transformed.
+  */
+size_t cipher_step_advance(char range_low, char range_high, const struct cipher_step *step,
+                           size_t position, const char *text, size_t len);
+
+/** `cipher_stream` between gzip files: decompress `in_fd` on the fly, transform it, and
+  * compress the result to `out_fd`, with no temporary files. Decompression and
+  * compression each run on a thread of their own, joined to the stream by pipes, so all
+  * the stages work at once.
+  *
+  * The input may hold several gzip (or zlib) members one after another, as `cat a.gz
+  * b.gz` does; the output is a single gzip member. The checksums are of the decompressed
+  * input and output.
+  *
+  * Only available if the library was built with zlib (`make ZLIB=1`, which defines
+  * `SAFECIPHER_ZLIB`); otherwise it always fails.
+  *
+  * \param level The zlib compression level, from 0 (none) to 9 (smallest), or -1 for
+  *        zlib's default
+  * \return `false` if the step is not valid, zlib is not available, the input is not
+  *         valid gzip (or ends part way through a member), or reading or writing fails.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool cipher_stream_gzip(char range_low, char range_high, const struct cipher_step *step,
+                        bool decrypt, int in_fd, int out_fd, int level,
+                        struct cipher_checksums *checksums);
+
+/** Encrypt or decrypt one shard of a file with a Caesar or Vigenere step, so that a file
+  * can be split across independent processes (on different machines, say): shard `shard`
+  * of `shards` is a contiguous byte range, the shards together cover the file in order,
+  * and concatenating their outputs gives exactly what one run over the whole file would.
+  *
+  * For the Vigenere cipher the key position at the start of the shard is the number of
+  * in-range bytes before it. With a rank index from `shard_index_build` that is one
+  * lookup plus a count over less than 1 MiB; without one, every byte before the shard
+  * is counted (a SIMD count across all cores, still much cheaper than enciphering them).
+  * The file is mapped into memory, so only the pages the shard needs are read.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param step A `CIPHER_CAESAR` or `CIPHER_VIGENERE` step
+  * \param decrypt `false` to encrypt, `true` to decrypt
+  * \param in_fd A regular file, open for reading
+  * \param shard Which shard to transform, from 0
+  * \param shards The number of shards the file is split into
+  * \param index_fd A rank index of the file for the same range, or -1 to count instead
+  * \param out_fd The file descriptor to write the shard's output to
+  * \param checksums If not NULL, where the CRC-32C checksums of the shard's input and
+  *           output are stored
+  * \return `true` on success, `false` if the step or shard is not valid, the input is
+  *         not a regular file, the index does not match it, or reading or writing failed.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool cipher_shard(char range_low, char range_high, const struct cipher_step *step,
+                  bool decrypt, int in_fd, size_t shard, size_t shards, int index_fd,
+                  int out_fd, struct cipher_checksums *checksums);
+
+/** Write the rank index `cipher_shard` uses to find a shard's Vigenere key position: a
+  * short header identifying the file size and range, then the number of in-range bytes
+  * before every 1 MiB boundary of the file (8 bytes per MiB, in the machine's byte
+  * order). It is built once, with one pass across all cores, and shared by every shard.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param in_fd A regular file, open for reading
+  * \param out_fd The file descriptor to write the index to
+  * \return `true` on success, `false` if the input is not a regular file, memory could
+  *         not be allocated, or reading or writing failed.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool shard_index_build(char range_low, char range_high, int in_fd, int out_fd);
+
+/** A region allocator for the temporary buffers of a batch of requests: allocations
+  * are carved from large blocks, freed all at once by `arena_reset`, and the blocks are
+  * kept for the next batch, so at steady state a batch makes no calls to malloc at all.
+  */
+struct arena;
+
+/** Create an empty arena that allocates blocks of `block_size` bytes (or larger, for
+  * allocations that do not fit in one).
+  *
+  * \return The arena, or NULL if memory could not be allocated.
+  */
+struct arena *arena_create(size_t block_size);
+
+/** Allocate `size` bytes from an arena, aligned for any type. The memory stays valid
+  * until the arena is reset or destroyed.
+  *
+  * \return The memory, or NULL if a new block was needed and could not be allocated.
+  */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/** Free everything allocated from an arena at once, in constant time, keeping its
+  * blocks for later allocations.
+  */
+void arena_reset(struct arena *arena);
+
+/** The number of blocks an arena has allocated with malloc since it was created. */
+size_t arena_mallocs(const struct arena *arena);
+
+/** The total size in bytes of an arena's blocks. */
+size_t arena_bytes(const struct arena *arena);
+
+/** Free an arena and all its blocks. `arena` may be NULL. */
+void arena_destroy(struct arena *arena);
+
+/** The memory a process has used, for fitting it into a container's limit. */
+struct memory_stats {
+    uint64_t allocations;   /**< heap allocations and mapped buffers the library has made */
+    uint64_t allocated;     /**< the bytes of all of them, freed or not */
+    size_t largest;         /**< the bytes of the largest one */
+    size_t peak_rss;        /**< the peak resident set size of the whole process, in bytes */
+};
+
+/** Report the memory used so far: the library's allocations since the process started,
+  * counted on every thread, and the process's peak resident set size.
+  */
+void memory_stats(struct memory_stats *stats);
+
+/** A pool of worker threads running Caesar and Vigenere jobs for many clients fairly.
+  *
+  * Jobs are run a chunk (of at most `quantum` bytes) at a time, and chunks are picked by
+  * deficit round-robin across clients: on its turn a client may run up to a quantum of
+  * bytes, so one client's huge job gets a chunk per turn while another client's small
+  * jobs finish within a turn or two instead of waiting behind it. The queue is bounded:
+  * when every job slot is taken, or a client already has its limit of jobs admitted,
+  * `scheduler_submit` refuses the job rather than queueing it, so the caller can wait for
+  * one of its jobs to finish (or push back on whoever sent it) before trying again.
+  */
+struct scheduler;
+
+/** A way to stop jobs early: cancelled explicitly, from any thread, or by a deadline.
+  * Jobs check their token every 256 KiB, so one that is abandoned stops within a
+  * fraction of a millisecond and frees its worker. A token may be shared by any number
+  * of jobs, and must stay valid until they have been waited for.
+  */
+struct cancel_token {
+    int cancelled;          /**< set by `cancel_token_cancel` */
+    uint64_t deadline_ns;   /**< the `CLOCK_MONOTONIC` time at which it expires, or 0 */
+};
+
+/** Initialise a token that expires `timeout_ms` milliseconds from now, or only when
+  * cancelled if `timeout_ms` is 0.
+  */
+void cancel_token_init(struct cancel_token *token, uint64_t timeout_ms);
+
+/** Cancel every job using a token. Safe to call from any thread at any time. */
+void cancel_token_cancel(struct cancel_token *token);
+
+/** Whether a token has been cancelled or its deadline has passed. */
+bool cancel_token_expired(const struct cancel_token *token);
+
+/** A job admitted by a scheduler, valid until `scheduler_wait` returns for it. */
+struct scheduler_job;
+
+/** The outcome of `scheduler_submit`. */
+enum scheduler_status {
+    SCHEDULER_OK,       /**< the job was admitted */
+    SCHEDULER_BUSY,     /**< the queue or the client is at its limit; wait for a job first */
+    SCHEDULER_INVALID   /**< the step is not a valid Caesar or Vigenere step */
+};
+
+/** Create a scheduler and start its worker threads.
+  *
+  * \param threads The number of worker threads, or 0 for one per core (or
+  *           `SAFECIPHER_THREADS`)
+  * \param queue_limit The most jobs admitted and not yet waited for, across all clients
+  * \param client_limit The most jobs one client may have admitted and unfinished, or 0
+  *           for no limit but `queue_limit`; that many of its jobs may run at once
+  * \param quantum The largest chunk, and the bytes a client may run each turn; SIZE_MAX
+  *           runs every job whole, first come first served
+  * \return The scheduler, or NULL if `queue_limit` is 0 or memory or threads could not
+  *         be allocated.
+  */
+struct scheduler *scheduler_create(size_t threads, size_t queue_limit, size_t client_limit,
+                                   size_t quantum);
+
+/** Submit a job: transform `in[0..len)` into `out` (which may equal `in`; it is not
+  * null-terminated) with a Caesar or Vigenere step, on behalf of client `client`. The
+  * buffers and the step's key must stay valid until the job has been waited for.
+  *
+  * \param token If not NULL, a token that stops the job where it is once it expires
+  * \param job Where the admitted job is stored, for `scheduler_wait`
+  * \return `SCHEDULER_OK` if the job was admitted, `SCHEDULER_BUSY` if it was refused for
+  *         now, or `SCHEDULER_INVALID` if the step is not valid.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+enum scheduler_status scheduler_submit(struct scheduler *scheduler, unsigned client,
+                                       char range_low, char range_high,
+                                       const struct cipher_step *step, bool decrypt,
+                                       const char *in, size_t len, char *out,
+                                       const struct cancel_token *token,
+                                       struct scheduler_job **job);
+
+/** `scheduler_submit` for a chunk of a longer text: the Vigenere key starts at key
+  * position `position` (the number of in-range characters before the chunk, or the
+  * value `cipher_step_advance` returned for the chunk before), rather than at 0.
+  */
+enum scheduler_status scheduler_submit_at(struct scheduler *scheduler, unsigned client,
+                                          char range_low, char range_high,
+                                          const struct cipher_step *step, bool decrypt,
+                                          size_t position, const char *in, size_t len,
+                                          char *out, const struct cancel_token *token,
+                                          struct scheduler_job **job);
+
+/** Have `notify(arg)` called once an admitted job is done, so a caller need not block in
+  * `scheduler_wait` (which it must still call, and which then returns at once). The call
+  * is made on the worker thread that finished the job, without the scheduler's lock held,
+  * so it may call `scheduler_wait` or submit jobs, but it delays that worker's next chunk
+  * while it runs.
+  *
+  * \return `true` if `notify` will be called, or `false` if the job is already done (it
+  *         is then not called).
+  */
+bool scheduler_notify(struct scheduler *scheduler, struct scheduler_job *job,
+                      void (*notify)(void *arg), void *arg);
+
+/** Wait for an admitted job to finish or stop, and return its slot to the scheduler.
+  * Each job is waited for exactly once.
+  *
+  * \return `true` if the job was finished, `false` if its token expired first (in which
+  *         case only part of the output has been written).
+  */
+bool scheduler_wait(struct scheduler *scheduler, struct scheduler_job *job);
+
+/** Let the admitted jobs finish, stop the worker threads and free a scheduler.
+  * `scheduler` may be NULL.
+  */
+void scheduler_destroy(struct scheduler *scheduler);
+
+/** Start recording trace events, and dump them to `path` whenever the process receives
+  * SIGUSR1.
+  *
+  * Each thread records the start and end of its jobs, chunks, reads and writes, and the
+  * kernel each transform picks, into a ring of its own holding its latest 4096 events;
+  * recording takes a few tens of nanoseconds and no locks. The dump is a Chrome trace
+  * (JSON, for chrome://tracing or Perfetto). SIGUSR1 is blocked in the calling thread and
+  * taken by a thread of its own, so call this before creating any other threads.
+  *
+  * Where the system has `<sys/sdt.h>`, the same points are also USDT probes (provider
+  * `safecipher`), which cost nothing until a tracer attaches, whether or not this is
+  * called.
+  *
+  * \return `false` if memory or the signal thread could not be allocated.
+  */
+bool trace_enable(const char *path);
+
+/** Write every thread's recorded trace events to `fd` as a Chrome trace.
+  *
+  * \return `false` if the trace could not be written.
+  */
+bool trace_dump(int fd);
+
+/** The number of rotors an Enigma machine can choose from (I to V). */
+#define ENIGMA_ROTOR_TYPES 5
+
+/** The settings of a three-rotor Enigma machine (the Wehrmacht Enigma I). */
+struct enigma_settings {
+    unsigned char rotors[3];    /**< the rotors from left to right, 1 (I) to 5 (V), all different */
+    char rings[3];              /**< the ring settings from left to right, 'A' to 'Z' */
+    char positions[3];          /**< the starting window letters from left to right */
+    char reflector;             /**< the reflector, 'B' or 'C' */
+    const char *plugboard;      /**< pairs of letters to swap, e.g. "AB CD" (spaces are
+                                     ignored), or NULL for none */
+};
+
+/** Encrypt or decrypt a message with an Enigma machine.
+  *
+  * Each letter from 'A' to 'Z' first steps the rotors (including the middle rotor's
+  * double step) and is then translated; all other characters are copied unchanged
+  * without stepping. As on the real machine, encryption and decryption are the same
+  * operation.
+  *
+  * Rather than tracing every letter through the rotors, the machine precomputes the
+  * complete substitution and the successor of each rotor position the first time the
+  * message reaches it, so that every letter costs two table lookups.
+  *
+  * \param settings The machine settings
+  * \param in A null-terminated string containing the message
+  * \param out A pointer to a buffer where the result will be stored. The buffer must be
+  *           large enough to hold a C string of the same length as `in` (including the
+  *           terminating null character).
+  * \return `true` on success. Returns `false`, leaving an empty string in `out`, if the
+  *         settings are invalid or memory could not be allocated.
+  */
+bool enigma_crypt(const struct enigma_settings *settings, const char *in, char *out);
+
+/** Encrypt or decrypt many independent messages with Enigma machines.
+  *
+  * Equivalent to calling `enigma_crypt(&settings[i], in[i], out[i])` for every `i` below
+  * `count`, but the messages are spread across all cores (`SAFECIPHER_THREADS` overrides
+  * the thread count), and the precomputed positions of a machine are kept from one
+  * message to the next as long as the rotors, rings, reflector and plugboard stay the
+  * same (the starting positions may differ). Batches sharing a configuration are
+  * therefore much faster than separate calls.
+  *
+  * \param settings A pointer to an array of `count` machine settings
+  * \param count The number of messages
+  * \param in A pointer to an array of `count` null-terminated messages
+  * \param out A pointer to an array of `count` buffers, each large enough for the
+  *           corresponding message
+  * \return `true` on success. Returns `false` if any settings are invalid, leaving every
+  *         output an empty string, or if memory could not be allocated, leaving the
+  *         messages that could not be processed empty.
+  */
+bool enigma_crypt_batch(const struct enigma_settings *settings, size_t count,
+                        const char *const *in, char *const *out);
+
+/** The longest crib accepted by `vigenere_crib_drag`. */
+#define CRIB_MAX_LENGTH 64
+
+/** A position at which a crib is consistent with a periodic Vigenere key. */
+struct crib_match {
+    size_t offset;      /**< byte offset in the ciphertext of the first crib character */
+    size_t period;      /**< the smallest key period consistent with the crib there */
+    char key[CRIB_MAX_LENGTH / 2 + 1];  /**< the implied key of length `period` */
+};
+
+/** Find every position at which a known plaintext word (the crib) may occur in a
+  * Vigenere ciphertext, assuming encryption started at the first key character.
+  *
+  * The crib is slid across every in-range character position of `cipher_text`. At each
+  * position the key fragment implied by subtracting the crib from the ciphertext is
+  * computed, and the position is reported if that fragment repeats with some period of
+  * at most `max_period` (which must leave at least as many comparisons as the period is
+  * long, so the period is capped at half the crib length). Sixteen positions are
+  * checked per SIMD vector, and the ciphertext is split across threads.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param crib A null-terminated string of in-range characters expected in the plaintext
+  * \param cipher_text A null-terminated string containing the ciphertext
+  * \param max_period The longest key period to test, or 0 for half the crib length
+  * \param matches A pointer to an array where the matches will be stored, in order of
+  *           increasing offset
+  * \param capacity The number of elements in `matches`
+  * \return The total number of matches found (which may exceed `capacity`, in which case
+  *         only the first `capacity` are stored), or `SIZE_MAX` if the crib is invalid or
+  *         memory could not be allocated.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  * \pre `crib` must be between 2 and `CRIB_MAX_LENGTH` characters long, all within the
+  *      range from `range_low` to `range_high` (inclusive).
+  */
+size_t vigenere_crib_drag(char range_low, char range_high, const char *crib,
+                          const char *cipher_text, size_t max_period,
+                          struct crib_match *matches, size_t capacity);
+
+/** The longest key `vigenere_brute_force` searches. */
+#define BRUTE_FORCE_MAX_KEY 8
+
+/** A candidate key found by `vigenere_brute_force`. */
+struct key_candidate {
+    char key[BRUTE_FORCE_MAX_KEY + 1];  /**< the key, null-terminated */
+    int score;          /**< English bigram log-likelihood of the decryption (higher is better) */
+};
+
+/** Throughput of a `vigenere_brute_force` search. */
+struct brute_force_stats {
+    unsigned long long keys;    /**< the number of keys tried */
+    double seconds;             /**< the wall-clock time taken */
+};
+
+/** Recover a short Vigenere key by trying every key of a given length.
+  *
+  * Every one of the 26^`key_len` keys is used to trial-decrypt the first 64 in-range
+  * characters of `cipher_text`. Keys are enumerated like an odometer, split across
+  * threads by their first two characters, so that moving to the next key only shifts
+  * the plaintext columns under the key characters that changed (sixteen characters per
+  * SIMD instruction). Each trial decryption is first given a cheap letter-frequency
+  * score; those scoring closer to English than to random text and passing
+  * `plaintext_plausible` are then scored by English bigram log-likelihood, and the best
+  * `k` are kept.
+  *
+  * Searches are practical up to about six characters.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param cipher_text A null-terminated string containing the ciphertext
+  * \param key_len The length of key to search
+  * \param best A pointer to an array of `k` elements where the best candidates will be
+  *           stored, best first
+  * \param k The number of candidates to keep (at most 256)
+  * \param stats If not null, receives the number of keys tried and the time taken
+  * \return The number of candidates stored in `best`, or `SIZE_MAX` if the arguments are
+  *         invalid or memory could not be allocated.
+  *
+  * \pre The range must contain exactly 26 characters (the scoring model is English).
+  * \pre `key_len` must be between 1 and `BRUTE_FORCE_MAX_KEY`.
+  */
+size_t vigenere_brute_force(char range_low, char range_high, const char *cipher_text,
+                            size_t key_len, struct key_candidate *best, size_t k,
+                            struct brute_force_stats *stats);
+
+/** Quickly judge whether a text could be English plaintext.
+  *
+  * This is the first-stage filter the cracking operations apply to every trial
+  * decryption before scoring it properly; it rejects almost all random-looking text in
+  * a few nanoseconds. Only the first 64 in-range characters are examined. The text
+  * passes if few of its adjacent letter pairs are ones English (almost) never produces,
+  * such as "QZ" or "VK" (checked sixteen pairs per SIMD vector against a bitmap), and
+  * if enough common words (looked up in a Bloom filter) occur in it, with or without
+  * spaces between the words.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param text A null-terminated string containing the candidate plaintext
+  * \return `true` if the text may be English, `false` if it almost certainly is not.
+  *
+  * \pre The range must contain exactly 26 characters.
+  */
+bool plaintext_plausible(char range_low, char range_high, const char *text);
+
+/** Count the in-range characters of a text, either overall or by key column.
+  *
+  * With a `period` of 0 or 1, `counts[i]` receives the number of occurrences of the
+  * character `range_low + i`. With a larger period, the in-range characters are dealt
+  * into `period` columns in turn (as a Vigenere key of that length would be applied to
+  * them), and `counts[column * range_size + i]` receives the occurrences of
+  * `range_low + i` in that column.
+  *
+  * Counting spreads each stretch of text over four sub-histograms, so that repeated
+  * letters do not stall on a single counter, and buffers over a megabyte are split
+  * across threads whose histograms are merged at the end.
+  *
+  * \param range_low A character representing the lower bound of the character range
+  * \param range_high A character representing the upper bound of the character range
+  * \param text A pointer to the text to count (need not be null-terminated)
+  * \param len The number of bytes of `text` to count
+  * \param period The number of key columns, or 0 for a single histogram
+  * \param counts A pointer to an array of at least `max(period, 1) * range_size`
+  *           elements, where `range_size` is `range_high - range_low + 1`
+  * \return `true` on success, `false` if memory could not be allocated.
+  *
+  * \pre `range_high` must be strictly greater than `range_low`.
+  */
+bool letter_histogram(char range_low, char range_high, const char *text, size_t len,
+                      size_t period, size_t *counts);
+
 /** This function serves as the entry point for the command-line application, handling 
   * various encryption and decryption operations based on user input. The function expects 
   * specific command-line arguments and performs validation to ensure correct usage.
@@ -177,6 +1229,10 @@ void vigenere_decrypt(char range_low, char range_high, const char *key,
 int cli(int argc, char ** argv);
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 // CRYPTO_H
 // vim: tw=90 :
@@ -0,0 +1,507 @@
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+// bytes enciphered per block before encoding; a multiple of three (whole base64 groups)
+// and of sixteen, small enough for the block to stay in L1 between the two passes
+#define   ENCODE_BLOCK   3072
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static const char base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// the value of a hex digit (either case), or -1
+static int hex_value(char c)
+{
+    if ('0' <= c && c <= '9') {
+        return c - '0';
+    }
+    if ('a' <= (c | 0x20) && (c | 0x20) <= 'f') {
+        return (c | 0x20) - 'a' + 10;
+    }
+    return -1;
+}
+
+// the value of a base64 digit, or -1
+static int base64_value(char c)
+{
+    if ('A' <= c && c <= 'Z') {
+        return c - 'A';
+    }
+    if ('a' <= c && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if ('0' <= c && c <= '9') {
+        return c - '0' + 52;
+    }
+    return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+// encodes `in[0..len)` as lower-case hex, returning the characters written
+static size_t hex_encode_scalar(const char *in, size_t len, char *out)
+{
+    for (size_t i = 0; i < len; i++) {
+        unsigned char b = (unsigned char)in[i];
+        out[2 * i] = hex_digits[b >> 4];
+        out[2 * i + 1] = hex_digits[b & 15];
+    }
+    return 2 * len;
+}
+
+// decodes `len` (even) hex digits, returning false at the first invalid one
+static bool hex_decode_scalar(const char *in, size_t len, char *out)
+{
+    for (size_t i = 0; i < len; i += 2) {
+        int high = hex_value(in[i]);
+        int low = hex_value(in[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i / 2] = (char)(high << 4 | low);
+    }
+    return true;
+}
+
+// encodes `in[0..len)` as padded base64, returning the characters written
+static size_t base64_encode_scalar(const char *in, size_t len, char *out)
+{
+    size_t o = 0;
+    size_t i = 0;
+
+    for (; i + 3 <= len; i += 3) {
+        uint32_t group = (uint32_t)(unsigned char)in[i] << 16
+                       | (uint32_t)(unsigned char)in[i + 1] << 8 | (unsigned char)in[i + 2];
+        out[o++] = base64_digits[group >> 18];
+        out[o++] = base64_digits[group >> 12 & 63];
+        out[o++] = base64_digits[group >> 6 & 63];
+        out[o++] = base64_digits[group & 63];
+    }
+    if (i < len) {
+        uint32_t group = (uint32_t)(unsigned char)in[i] << 16;
+        if (i + 1 < len) {
+            group |= (uint32_t)(unsigned char)in[i + 1] << 8;
+        }
+        out[o++] = base64_digits[group >> 18];
+        out[o++] = base64_digits[group >> 12 & 63];
+        out[o++] = i + 1 < len ? base64_digits[group >> 6 & 63] : '=';
+        out[o++] = '=';
+    }
+    return o;
+}
+
+// decodes `len` (a multiple of four) base64 characters, with padding allowed only at the
+// very end; returns the bytes written, or SIZE_MAX at the first invalid character
+static size_t base64_decode_scalar(const char *in, size_t len, char *out)
+{
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i += 4) {
+        bool last = i + 4 == len;
+        size_t pad = 0;
+        if (last && in[i + 3] == '=') {
+            pad = in[i + 2] == '=' ? 2 : 1;
+        }
+        uint32_t group = 0;
+        for (size_t j = 0; j < 4; j++) {
+            int v = j < 4 - pad ? base64_value(in[i + j]) : 0;
+            if (v < 0) {
+                return SIZE_MAX;
+            }
+            group = group << 6 | (uint32_t)v;
+        }
+        out[o++] = (char)(group >> 16);
+        if (pad < 2) {
+            out[o++] = (char)(group >> 8);
+        }
+        if (pad < 1) {
+            out[o++] = (char)group;
+        }
+    }
+    return o;
+}
+
+#ifdef SAFECIPHER_X86
+
+// encodes sixteen bytes at a time into 32 hex digits, returning the bytes done
+static size_t hex_encode_sse2(const char *in, size_t len, char *out)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i low = _mm_and_si128(v, mask);
+        high = _mm_add_epi8(_mm_add_epi8(high, zero),
+                            _mm_and_si128(_mm_cmpgt_epi8(high, nine), letters));
+        low = _mm_add_epi8(_mm_add_epi8(low, zero),
+                           _mm_and_si128(_mm_cmpgt_epi8(low, nine), letters));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    return i;
+}
+
+// the values of sixteen hex digits, setting `*bad` if any is not a digit
+static __m128i hex_values_sse2(__m128i v, __m128i *bad)
+{
+    __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(folded, _mm_set1_epi8('f' + 1)));
+    *bad = _mm_or_si128(*bad, _mm_andnot_si128(_mm_or_si128(digit, letter), _mm_set1_epi8(-1)));
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                        _mm_and_si128(letter, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+}
+
+// decodes 32 hex digits at a time into sixteen bytes, returning the digits done; stops
+// before the first block with an invalid digit, which the caller reports
+static size_t hex_decode_sse2(const char *in, size_t len, char *out)
+{
+    const __m128i low_byte = _mm_set1_epi16(0x00ff);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m128i bad = _mm_setzero_si128();
+        __m128i a = hex_values_sse2(_mm_loadu_si128((const __m128i *)(in + i)), &bad);
+        __m128i b = hex_values_sse2(_mm_loadu_si128((const __m128i *)(in + i + 16)), &bad);
+        if (_mm_movemask_epi8(bad) != 0) {
+            break;
+        }
+        // each 16-bit lane holds the high digit in its low byte and the low digit above
+        a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low_byte), 4), _mm_srli_epi16(a, 8));
+        b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low_byte), 4), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(out + i / 2), _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+// encodes twelve bytes at a time into sixteen base64 digits (reading sixteen), returning
+// the bytes done: a shuffle spreads each three bytes over four lanes, two multiplies
+// shift the 6-bit fields into place, and a second shuffle maps each value's range to
+// the offset that turns it into its digit
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(const char *in, size_t len, char *out)
+{
+    const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    size_t o = 0;
+
+    for (; i + 16 <= len; i += 12, o += 16) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i)), spread);
+        __m128i a = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)),
+                                    _mm_set1_epi32(0x04000040));
+        __m128i b = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)),
+                                    _mm_set1_epi32(0x01000010));
+        __m128i values = _mm_or_si128(a, b);
+        // 0-25 select entry 13, 26-51 entry 0, 52-63 entries 1-12
+        __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values),
+                                                  _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i *)(out + o), _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range)));
+    }
+    return i;
+}
+
+// decodes sixteen base64 digits at a time into twelve bytes, returning the digits done;
+// the nibbles of each character index two tables whose AND is non-zero for anything but
+// a digit, and a third table gives the offset back to its value. Stops before the first
+// block that is not all digits (padding included), which the caller handles
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(const char *in, size_t len, char *out)
+{
+    const __m128i lut_low = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_high = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i gather = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    size_t o = 0;
+
+    for (; i + 16 <= len; i += 16, o += 12) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi32(v, 4), mask);
+        __m128i low = _mm_and_si128(v, mask);
+        __m128i check = _mm_and_si128(_mm_shuffle_epi8(lut_low, low), _mm_shuffle_epi8(lut_high, high));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(check, _mm_setzero_si128())) != 0) {
+            break;
+        }
+        __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+        v = _mm_add_epi8(v, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(slash, high)));
+        // merge pairs of 6-bit values into 12 bits, then pairs of those into 24
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        v = _mm_shuffle_epi8(v, gather);
+        _mm_storel_epi64((__m128i *)(out + o), v);
+        int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+        memcpy(out + o + 8, &last, 4);
+    }
+    return i;
+}
+
+#endif
+
+size_t encoded_length(enum text_encoding encoding, size_t len)
+{
+    switch (encoding) {
+    case ENCODING_HEX:
+        return 2 * len;
+    case ENCODING_BASE64:
+        return (len + 2) / 3 * 4;
+    default:
+        return len;
+    }
+}
+
+size_t decoded_length(enum text_encoding encoding, size_t len)
+{
+    switch (encoding) {
+    case ENCODING_HEX:
+        return len / 2;
+    case ENCODING_BASE64:
+        return len / 4 * 3;
+    default:
+        return len;
+    }
+}
+
+// encodes without the terminating null
+static size_t encode(enum text_encoding encoding, const char *in, size_t len, char *out)
+{
+    size_t done = 0;
+
+    if (encoding == ENCODING_NONE) {
+        memmove(out, in, len);
+        return len;
+    }
+    if (encoding == ENCODING_HEX) {
+#ifdef SAFECIPHER_X86
+        done = hex_encode_sse2(in, len, out);
+#endif
+        return 2 * done + hex_encode_scalar(in + done, len - done, out + 2 * done);
+    }
+#ifdef SAFECIPHER_X86
+    if (cpu_supports(CPU_SSSE3)) {
+        done = base64_encode_ssse3(in, len, out);
+    }
+#endif
+    return done / 3 * 4 + base64_encode_scalar(in + done, len - done, out + done / 3 * 4);
+}
+
+// decodes without the terminating null, returning SIZE_MAX if the text is not valid
+static size_t decode(enum text_encoding encoding, const char *in, size_t len, char *out)
+{
+    size_t done = 0;
+
+    if (encoding == ENCODING_NONE) {
+        memmove(out, in, len);
+        return len;
+    }
+    if (encoding == ENCODING_HEX) {
+        if (len % 2 != 0) {
+            return SIZE_MAX;
+        }
+#ifdef SAFECIPHER_X86
+        done = hex_decode_sse2(in, len, out);
+#endif
+        return hex_decode_scalar(in + done, len - done, out + done / 2) ? len / 2 : SIZE_MAX;
+    }
+    if (len % 4 != 0) {
+        return SIZE_MAX;
+    }
+#ifdef SAFECIPHER_X86
+    // the last group, which may be padded, is left to the scalar code
+    if (cpu_supports(CPU_SSSE3) && len >= 4) {
+        done = base64_decode_ssse3(in, len - 4, out);
+    }
+#endif
+    size_t rest = base64_decode_scalar(in + done, len - done, out + done / 4 * 3);
+    return rest == SIZE_MAX ? SIZE_MAX : done / 4 * 3 + rest;
+}
+
+size_t text_encode(enum text_encoding encoding, const char *in, size_t len, char *out)
+{
+    size_t written = encode(encoding, in, len, out);
+    out[written] = '\0';
+    return written;
+}
+
+size_t text_decode(enum text_encoding encoding, const char *in, size_t len, char *out)
+{
+    size_t written = decode(encoding, in, len, out);
+    out[written == SIZE_MAX ? 0 : written] = '\0';
+    return written;
+}
+
+// a Caesar key, or a Vigenere key with its length (zero for Caesar)
+struct substitution {
+    int shift;
+    const char *key;
+    size_t key_len;
+};
+
+// applies the substitution to `in[0..len)` (`out` may equal `in`), with a Vigenere key
+// starting at `phase`; returns the key position after the block
+static size_t substitute(char range_low, char range_high, struct substitution sub, size_t phase,
+                         bool decrypt, const char *in, char *out, size_t len)
+{
+    if (sub.key_len != 0) {
+        return vigenere_transform(range_low, range_high, sub.key, sub.key_len, phase, decrypt,
+                                  in, out, len);
+    }
+    int shift = sub.shift % (range_high - range_low + 1);
+    caesar_transform(range_low, range_high, decrypt ? -shift : shift, in, out, len);
+    return phase;
+}
+
+// enciphers `plain[0..len)` a block at a time into a scratch buffer and encodes each
+// block while it is still in cache, so that the raw ciphertext is never held in full;
+// the checksums are taken over the same blocks while they are hot
+static size_t substitute_encode(char range_low, char range_high, struct substitution sub,
+                                const char *plain, size_t len, enum text_encoding encoding,
+                                char *out, struct cipher_checksums *checksums)
+{
+    char block[ENCODE_BLOCK];
+    uint32_t crc_in = 0, crc_out = 0;
+    size_t phase = 0;
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i += ENCODE_BLOCK) {
+        size_t n = len - i < ENCODE_BLOCK ? len - i : ENCODE_BLOCK;
+        bool raw = encoding == ENCODING_NONE;
+        phase = substitute(range_low, range_high, sub, phase, false, plain + i,
+                           raw ? out + o : block, n);
+        size_t written = raw ? n : encode(encoding, block, n, out + o);
+        if (checksums != NULL) {
+            crc_in = crc32c(crc_in, plain + i, n);
+            crc_out = crc32c(crc_out, out + o, written);
+        }
+        o += written;
+    }
+    out[o] = '\0';
+    if (checksums != NULL) {
+        checksums->input = crc_in;
+        checksums->output = crc_out;
+    }
+    return o;
+}
+
+// decodes `encoded[0..len)` straight into `plain` a block at a time and deciphers each
+// block in place while it is still in cache
+static size_t substitute_decode(char range_low, char range_high, struct substitution sub,
+                                const char *encoded, size_t len, enum text_encoding encoding,
+                                char *plain, struct cipher_checksums *checksums)
+{
+    // the encoded size of a block: whole base64 groups and hex pairs
+    size_t step = encoded_length(encoding, ENCODE_BLOCK);
+    uint32_t crc_in = 0, crc_out = 0;
+    size_t phase = 0;
+    size_t o = 0;
+
+    if (encoding != ENCODING_NONE && len % (encoding == ENCODING_HEX ? 2 : 4) != 0) {
+        plain[0] = '\0';
+        return SIZE_MAX;
+    }
+    for (size_t i = 0; i < len; i += step) {
+        size_t chunk = len - i < step ? len - i : step;
+        size_t n = chunk;
+        const char *src = encoded + i;
+        if (encoding != ENCODING_NONE) {
+            n = decode(encoding, encoded + i, chunk, plain + o);
+            // padding is only valid in the final group
+            if (n == SIZE_MAX || (n < ENCODE_BLOCK && i + step < len)) {
+                plain[0] = '\0';
+                return SIZE_MAX;
+            }
+            src = plain + o;
+        }
+        phase = substitute(range_low, range_high, sub, phase, true, src, plain + o, n);
+        if (checksums != NULL) {
+            crc_in = crc32c(crc_in, encoded + i, chunk);
+            crc_out = crc32c(crc_out, plain + o, n);
+        }
+        o += n;
+    }
+    plain[o] = '\0';
+    if (checksums != NULL) {
+        checksums->input = crc_in;
+        checksums->output = crc_out;
+    }
+    return o;
+}
+
+// checks a Vigenere key as the other length-based entry points do
+bool vigenere_key_valid(char range_low, char range_high, const char *key)
+{
+    size_t len = strlen(key);
+
+    return len > 0 && range_check(range_low, range_high, key, len) == len;
+}
+
+size_t cipher_substitute(char range_low, char range_high, const struct cipher_step *step,
+                         bool decrypt, const char *in, size_t len, enum text_encoding encoding,
+                         char *out, struct cipher_checksums *checksums)
+{
+    struct substitution sub = { 0, NULL, 0 };
+
+    if (step->kind == CIPHER_CAESAR) {
+        sub.shift = step->shift;
+    } else if (step->kind == CIPHER_VIGENERE && vigenere_key_valid(range_low, range_high, step->key)) {
+        sub.key = step->key;
+        sub.key_len = strlen(step->key);
+    } else {
+        out[0] = '\0';
+        return SIZE_MAX;
+    }
+    return decrypt
+        ? substitute_decode(range_low, range_high, sub, in, len, encoding, out, checksums)
+        : substitute_encode(range_low, range_high, sub, in, len, encoding, out, checksums);
+}
+
+size_t caesar_encrypt_encoded(char range_low, char range_high, int key, const char *plain_text,
+                              size_t len, enum text_encoding encoding, char *cipher_text)
+{
+    struct cipher_step step = { .kind = CIPHER_CAESAR, .shift = key };
+    return cipher_substitute(range_low, range_high, &step, false, plain_text, len, encoding,
+                             cipher_text, NULL);
+}
+
+size_t caesar_decrypt_encoded(char range_low, char range_high, int key, const char *cipher_text,
+                              size_t len, enum text_encoding encoding, char *plain_text)
+{
+    struct cipher_step step = { .kind = CIPHER_CAESAR, .shift = key };
+    return cipher_substitute(range_low, range_high, &step, true, cipher_text, len, encoding,
+                             plain_text, NULL);
+}
+
+size_t vigenere_encrypt_encoded(char range_low, char range_high, const char *key,
+                                const char *plain_text, size_t len, enum text_encoding encoding,
+                                char *cipher_text)
+{
+    struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = key };
+    return cipher_substitute(range_low, range_high, &step, false, plain_text, len, encoding,
+                             cipher_text, NULL);
+}
+
+size_t vigenere_decrypt_encoded(char range_low, char range_high, const char *key,
+                                const char *cipher_text, size_t len, enum text_encoding encoding,
+                                char *plain_text)
+{
+    struct cipher_step step = { .kind = CIPHER_VIGENERE, .key = key };
+    return cipher_substitute(range_low, range_high, &step, true, cipher_text, len, encoding,
+                             plain_text, NULL);
+}
@@ -0,0 +1,226 @@
+#define _GNU_SOURCE     // the pipe size fcntls
+
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+
+#ifdef SAFECIPHER_ZLIB
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+
+// bytes of compressed data per read or write, and of decompressed data per inflate call
+#define   GZIP_BUFFER   (256 << 10)
+
+// one end of the cipher stream: an inflate thread copies `from` (gzip) into `to` (the
+// pipe the stream reads), and a deflate thread copies `from` (the pipe the stream writes)
+// into `to` (gzip)
+struct gzip_stage {
+    int from, to;
+    int level;
+    bool ok;
+};
+
+// reads what is available, up to `len` bytes; returns the bytes read (0 at the end), or -1
+static ssize_t read_some(int fd, unsigned char *buf, size_t len)
+{
+    for (;;) {
+        ssize_t n = read(fd, buf, len);
+        if (n >= 0 || errno != EINTR) {
+            return n;
+        }
+    }
+}
+
+// a write to a pipe whose reader has gone fails with EPIPE in these threads rather than
+// killing the process; the signal stays pending on the thread, and goes with it
+static void block_sigpipe(void)
+{
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+// decompresses gzip (or zlib) members, one after another, and closes the pipe at the end
+// so the stream sees the end of its input
+static void *gzip_inflate(void *arg)
+{
+    struct gzip_stage *stage = arg;
+    unsigned char *in = mem_malloc(GZIP_BUFFER);
+    unsigned char *out = mem_malloc(GZIP_BUFFER);
+    z_stream z = { 0 };
+    bool member_done = false;   // the last member ended, and nothing has followed it
+    bool ok = in != NULL && out != NULL && inflateInit2(&z, 15 + 32) == Z_OK;
+    bool initialised = ok;
+
+    block_sigpipe();
+    while (ok) {
+        ssize_t n = read_some(stage->from, in, GZIP_BUFFER);
+        if (n <= 0) {
+            // the input must end at the end of a member, and not be empty
+            ok = n == 0 && member_done;
+            break;
+        }
+        z.next_in = in;
+        z.avail_in = (uInt)n;
+        // until the input is taken, and while a full output buffer may have left more
+        // output pending; bytes after the end of a member start another
+        do {
+            if (member_done) {
+                ok = inflateReset(&z) == Z_OK;
+                member_done = false;
+            }
+            z.next_out = out;
+            z.avail_out = GZIP_BUFFER;
+            int status = inflate(&z, Z_NO_FLUSH);
+            ok = ok && (status == Z_OK || status == Z_STREAM_END || status == Z_BUF_ERROR)
+                 && write_full(stage->to, (const char *)out, GZIP_BUFFER - z.avail_out);
+            member_done = status == Z_STREAM_END;
+        } while (ok && (z.avail_in > 0 || (z.avail_out == 0 && !member_done)));
+    }
+    if (initialised) {
+        inflateEnd(&z);
+    }
+    close(stage->to);
+    free(in);
+    free(out);
+    stage->ok = ok;
+    return NULL;
+}
+
+// compresses the stream's output into a single gzip member. After a failed write it keeps
+// reading the pipe to the end, so the stream's writer is never left blocked on it
+static void *gzip_deflate(void *arg)
+{
+    struct gzip_stage *stage = arg;
+    unsigned char *in = mem_malloc(GZIP_BUFFER);
+    unsigned char *out = mem_malloc(GZIP_BUFFER);
+    z_stream z = { 0 };
+    bool ok = in != NULL && out != NULL
+              && deflateInit2(&z, stage->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    bool initialised = ok;
+    unsigned char discard[4096];
+
+    block_sigpipe();
+    for (;;) {
+        ssize_t n = ok ? read_some(stage->from, in, GZIP_BUFFER)
+                       : read_some(stage->from, discard, sizeof(discard));
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+        if (!ok) {
+            if (n == 0) {
+                break;
+            }
+            continue;
+        }
+        int flush = n == 0 ? Z_FINISH : Z_NO_FLUSH;
+        int status = Z_OK;
+        z.next_in = in;
+        z.avail_in = (uInt)n;
+        // with Z_FINISH, until the trailer is out; otherwise until the input is taken
+        do {
+            z.next_out = out;
+            z.avail_out = GZIP_BUFFER;
+            status = deflate(&z, flush);
+            ok = status != Z_STREAM_ERROR
+                 && write_full(stage->to, (const char *)out, GZIP_BUFFER - z.avail_out);
+        } while (ok && (flush == Z_FINISH ? status != Z_STREAM_END : z.avail_out == 0));
+        if (n == 0) {
+            break;
+        }
+    }
+    if (initialised) {
+        deflateEnd(&z);
+    }
+    free(in);
+    free(out);
+    stage->ok = ok;
+    return NULL;
+}
+
+// a pipe between a gzip thread and the stream, grown to a stream chunk where allowed so
+// the threads hand over large pieces
+static bool gzip_pipe(int fds[2])
+{
+    if (pipe(fds) != 0) {
+        return false;
+    }
+#ifdef __linux__
+    fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+#endif
+    return true;
+}
+
+bool cipher_stream_gzip(char range_low, char range_high, const struct cipher_step *step,
+                        bool decrypt, int in_fd, int out_fd, int level,
+                        struct cipher_checksums *checksums)
+{
+    int inflated[2], deflated[2];
+    struct gzip_stage inflate_stage, deflate_stage;
+    pthread_t inflater, deflater;
+
+    if (level < -1 || level > 9 || !gzip_pipe(inflated)) {
+        return false;
+    }
+    if (!gzip_pipe(deflated)) {
+        close(inflated[0]);
+        close(inflated[1]);
+        return false;
+    }
+    inflate_stage = (struct gzip_stage){ in_fd, inflated[1], level, false };
+    deflate_stage = (struct gzip_stage){ deflated[0], out_fd, level, false };
+    bool inflating = pthread_create(&inflater, NULL, gzip_inflate, &inflate_stage) == 0;
+    if (!inflating) {
+        close(inflated[1]);
+    }
+    bool deflating = pthread_create(&deflater, NULL, gzip_deflate, &deflate_stage) == 0;
+
+    // decompression, the stream's reader, workers and writer, and compression each run on
+    // threads of their own, with a pipe between each stage and the next
+    bool ok = inflating && deflating
+              && cipher_stream(range_low, range_high, step, decrypt, inflated[0], deflated[1],
+                               false, checksums);
+
+    // closing the stream's ends lets both threads finish: the inflater's writes fail if
+    // the stream stopped reading early, and the deflater reaches the end of its input
+    close(inflated[0]);
+    close(deflated[1]);
+    if (inflating) {
+        pthread_join(inflater, NULL);
+    }
+    if (deflating) {
+        pthread_join(deflater, NULL);
+    }
+    close(deflated[0]);
+    return ok && inflate_stage.ok && deflate_stage.ok;
+}
+
+#else
+
+bool cipher_stream_gzip(char range_low, char range_high, const struct cipher_step *step,
+                        bool decrypt, int in_fd, int out_fd, int level,
+                        struct cipher_checksums *checksums)
+{
+    (void)range_low;
+    (void)range_high;
+    (void)step;
+    (void)decrypt;
+    (void)in_fd;
+    (void)out_fd;
+    (void)level;
+    (void)checksums;
+    return false;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef INTERNAL_H
+#define INTERNAL_H
+
+// declarations shared between the library's source files; not part of the public API
+
+#include "crypto.h"
+
+// the vector kernels rely on `char` being signed so that a signed byte compare
+// classifies characters exactly as the scalar `range_low <= c && c <= range_high` does
+#if defined(__GNUC__) && defined(__x86_64__) && CHAR_MIN < 0 && !defined(SAFECIPHER_NO_SIMD)
+#define SAFECIPHER_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef SAFECIPHER_X86
+
+/** Instruction set extensions the vector kernels may use. */
+enum cpu_feature {
+    CPU_SSSE3 = 1 << 0,
+    CPU_SSE42 = 1 << 1,
+    CPU_AVX2 = 1 << 2,
+    CPU_DETECTED = 1 << 3   /**< set once the others have been detected */
+};
+
+/** The `cpu_feature` flags of this CPU, or 0 until `cpu_detect` has run. */
+extern unsigned cpu_features;
+
+/** Detect the CPU's features with CPUID, store them in `cpu_features` and return them. */
+unsigned cpu_detect(void);
+
+/** Whether the CPU supports all of `features`. The features are detected on the first
+  * call rather than by a constructor (as `__builtin_cpu_supports` would), so a run that
+  * never reaches a vector kernel does not pay for CPUID, which traps in a virtual machine.
+  */
+static inline bool cpu_supports(unsigned features)
+{
+    unsigned f = __atomic_load_n(&cpu_features, __ATOMIC_RELAXED);
+    if (f == 0) {
+        f = cpu_detect();
+    }
+    return (f & features) == features;
+}
+
+#endif
+
+/** Shift every in-range character of `in[0..len)` by `key` (any integer) into `out`,
+  * which may equal `in`; the length-based core of `caesar_encrypt`.
+  */
+void caesar_transform(char range_low, char range_high, int key,
+                      const char *in, char *out, size_t len);
+
+/** Apply the Vigenere cipher to `in[0..len)`, writing `out` (which may equal `in`), with
+  * the key starting at position `phase`; the length-based core of `vigenere_encrypt`.
+  * Returns the key position following the last in-range character.
+  */
+size_t vigenere_transform(char range_low, char range_high, const char *key,
+                          size_t key_len, size_t phase, bool decrypt,
+                          const char *in, char *out, size_t len);
+
+/** The number of bytes of `text[0..len)` from `range_low` to `range_high` (inclusive). */
+size_t range_count(char range_low, char range_high, const char *text, size_t len);
+
+/** Whether `key` is a valid Vigenere key for the range: not empty, and every character
+  * in range.
+  */
+bool vigenere_key_valid(char range_low, char range_high, const char *key);
+
+/** Count an allocation of `size` bytes in the `memory_stats` totals. */
+void memory_note(size_t size);
+
+/** `malloc`, `calloc` and `realloc`, counting what they allocate in the `memory_stats`
+  * totals; the library allocates through these, and frees with `free`.
+  */
+static inline void *mem_malloc(size_t size)
+{
+    void *p = malloc(size);
+    if (p != NULL) {
+        memory_note(size);
+    }
+    return p;
+}
+
+static inline void *mem_calloc(size_t count, size_t size)
+{
+    void *p = calloc(count, size);
+    if (p != NULL) {
+        memory_note(count * size);
+    }
+    return p;
+}
+
+static inline void *mem_realloc(void *old, size_t size)
+{
+    void *p = realloc(old, size);
+    if (p != NULL) {
+        memory_note(size);
+    }
+    return p;
+}
+
+/** Write all of `buf[0..len)` to `fd`, retrying after partial writes and interruptions.
+  * Returns `false` if a write fails.
+  */
+bool write_full(int fd, const char *buf, size_t len);
+
+/** The number of worker threads parallel operations use: the number of online CPUs,
+  * or the value of the `SAFECIPHER_THREADS` environment variable if it is set.
+  */
+size_t parallel_threads(void);
+
+/** Call `task(arg, i)` for every `i` from 0 to `count - 1`, spread across up to
+  * `parallel_threads()` threads (including the calling thread), and return once all
+  * calls have finished. Tasks are handed out in increasing order of `i`.
+  *
+  * If threads cannot be created, the calling thread runs every task itself.
+  */
+void parallel_run(size_t count, void (*task)(void *arg, size_t index), void *arg);
+
+// USDT probes, for tools such as bpftrace and perf, where <sys/sdt.h> is available; each
+// is a single nop until a tracer attaches
+#if defined(__has_include) && !defined(SAFECIPHER_NO_SDT)
+#if __has_include(<sys/sdt.h>)
+#define SAFECIPHER_SDT 1
+#include <sys/sdt.h>
+#endif
+#endif
+
+/** Whether `trace_enable` has been called; the trace macros record nothing until then. */
+extern int trace_active;
+
+/** Append an event to the calling thread's trace ring: `phase` is the Chrome trace phase
+  * ('B' begin, 'E' end, 'i' instant) and `name` must be a string literal.
+  */
+void trace_record(char phase, const char *name, uint64_t arg);
+
+#ifdef SAFECIPHER_SDT
+#define TRACE_PROBE(name, arg) DTRACE_PROBE1(safecipher, name, arg)
+#else
+#define TRACE_PROBE(name, arg) ((void)0)
+#endif
+
+#define TRACE_EVENT(phase, probe, name, arg) \
+    do { \
+        TRACE_PROBE(probe, arg); \
+        if (__builtin_expect(__atomic_load_n(&trace_active, __ATOMIC_RELAXED), 0)) { \
+            trace_record(phase, name, (uint64_t)(arg)); \
+        } \
+    } while (0)
+
+/** Mark the start and end of a span on the calling thread, and a point in time. */
+#define TRACE_BEGIN(name, arg) TRACE_EVENT('B', name##__start, #name, arg)
+#define TRACE_END(name, arg) TRACE_EVENT('E', name##__done, #name, arg)
+#define TRACE_INSTANT(name, arg) TRACE_EVENT('i', name, #name, arg)
+
+#endif
+// INTERNAL_H
@@ -0,0 +1,53 @@
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+// counters of the library's allocations, updated with relaxed atomics from any thread
+static uint64_t memory_allocations;
+static uint64_t memory_allocated;
+static size_t memory_largest;
+
+void memory_note(size_t size)
+{
+    __atomic_add_fetch(&memory_allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&memory_allocated, size, __ATOMIC_RELAXED);
+    size_t largest = __atomic_load_n(&memory_largest, __ATOMIC_RELAXED);
+    while (size > largest
+           && !__atomic_compare_exchange_n(&memory_largest, &largest, size, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// the peak RSS in KiB. Linux's VmHWM belongs to the address space, where `ru_maxrss`
+// keeps the peak of whatever ran in the process before it was exec'ed (all of a parent's
+// memory, after a vfork-style spawn), so it is only the fallback
+static size_t peak_rss_kib(void)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    char line[128];
+    size_t kib = 0;
+    bool found = false;
+
+    while (status != NULL && !found && fgets(line, sizeof(line), status) != NULL) {
+        found = sscanf(line, "VmHWM: %zu kB", &kib) == 1;
+    }
+    if (status != NULL) {
+        fclose(status);
+    }
+    if (!found) {
+        struct rusage usage;
+        kib = getrusage(RUSAGE_SELF, &usage) == 0 ? (size_t)usage.ru_maxrss : 0;
+    }
+    return kib;
+}
+
+void memory_stats(struct memory_stats *stats)
+{
+    stats->allocations = __atomic_load_n(&memory_allocations, __ATOMIC_RELAXED);
+    stats->allocated = __atomic_load_n(&memory_allocated, __ATOMIC_RELAXED);
+    stats->largest = __atomic_load_n(&memory_largest, __ATOMIC_RELAXED);
+    stats->peak_rss = peak_rss_kib() * 1024;
+}
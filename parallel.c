@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define   PARALLEL_MAX_THREADS   64
+
+struct parallel_job {
+    void (*task)(void *arg, size_t index);
+    void *arg;
+    size_t count;
+    atomic_size_t next;
+};
+
+// number of worker threads to use
+size_t parallel_threads(void)
+{
+    const char *env = getenv("SAFECIPHER_THREADS");
+    long n = 0;
+
+    if (env != NULL) {
+        char *endptr;
+        n = strtol(env, &endptr, 10);
+        if (*endptr != '\0') {
+            n = 0;
+        }
+    }
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n <= 0) {
+        n = 1;
+    }
+    return n > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (size_t)n;
+}
+
+// takes tasks from the shared counter until none are left
+static void *parallel_worker(void *p)
+{
+    struct parallel_job *job = p;
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&job->next, 1);
+        if (i >= job->count) {
+            break;
+        }
+        job->task(job->arg, i);
+    }
+    return NULL;
+}
+
+// runs `count` tasks across the worker threads and the calling thread
+void parallel_run(size_t count, void (*task)(void *arg, size_t index), void *arg)
+{
+    struct parallel_job job = { task, arg, count, 0 };
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    size_t wanted = parallel_threads();
+    size_t started = 0;
+
+    if (wanted > count) {
+        wanted = count;
+    }
+    // the calling thread is one of the workers
+    while (started + 1 < wanted) {
+        if (pthread_create(&threads[started], NULL, parallel_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    parallel_worker(&job);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
@@ -0,0 +1,310 @@
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define   ENIGMA_LETTERS   26
+
+// machine states are the three window letters, indexed left * 676 + middle * 26 + right
+#define   ENIGMA_STATES    (ENIGMA_LETTERS * ENIGMA_LETTERS * ENIGMA_LETTERS)
+
+static const char *const rotor_wiring[ENIGMA_ROTOR_TYPES] = {
+    "EKMFLGDQVZNTOWYHXUSPAIBRCJ",   // I
+    "AJDKSIRUXBLHWTMCQGZNPYFVOE",   // II
+    "BDFHJLCPRTXVZNYEIWGAKMUSQO",   // III
+    "ESOVPZJAYQUIRHXLNFTGKDCMWB",   // IV
+    "VZBRGITYUPSDNHLMWCKXEQJFOA",   // V
+};
+
+// the window letter at which each rotor carries the one to its left along
+static const char rotor_notch[ENIGMA_ROTOR_TYPES] = { 'Q', 'E', 'V', 'J', 'Z' };
+
+static const char *const reflector_wiring[2] = {
+    "YRUHQSLDPXNGOKMIEBFZCWVJAT",   // B
+    "FVPJIAOYEDRZXWGCTKUQSBNMHL",   // C
+};
+
+// everything about a machine except its starting position, as letter offsets
+struct enigma_config {
+    uint8_t rotors[3];      // 0 to 4, left to right
+    uint8_t rings[3];
+    uint8_t reflector;      // 0 for B, 1 for C
+    uint8_t plugboard[ENIGMA_LETTERS];
+};
+
+// a configured machine with the stepping and the whole substitution of each state it has
+// visited precomputed; states are filled in the first time a message reaches them, so
+// a short message pays only for its own states and later messages on the same machine
+// mostly pay for none
+struct enigma_machine {
+    struct enigma_config config;
+    bool configured;
+    uint8_t forward[3][ENIGMA_LETTERS];
+    uint8_t backward[3][ENIGMA_LETTERS];
+    uint8_t reflector[ENIGMA_LETTERS];
+    uint32_t generation;                // states whose `built` entry matches are valid
+    uint32_t built[ENIGMA_STATES];
+    uint16_t next[ENIGMA_STATES];       // the state after a key press
+    uint8_t table[ENIGMA_STATES][ENIGMA_LETTERS];
+};
+
+// checks the settings and converts them to offsets
+static bool enigma_config_init(const struct enigma_settings *settings,
+                               struct enigma_config *config)
+{
+    for (int i = 0; i < 3; i++) {
+        unsigned rotor = settings->rotors[i];
+        if (rotor < 1 || rotor > ENIGMA_ROTOR_TYPES
+            || settings->rings[i] < 'A' || settings->rings[i] > 'Z') {
+            return false;
+        }
+        for (int j = 0; j < i; j++) {
+            if (settings->rotors[j] == rotor) {
+                return false;
+            }
+        }
+        config->rotors[i] = (uint8_t)(rotor - 1);
+        config->rings[i] = (uint8_t)(settings->rings[i] - 'A');
+    }
+    if (settings->reflector != 'B' && settings->reflector != 'C') {
+        return false;
+    }
+    config->reflector = (uint8_t)(settings->reflector - 'B');
+
+    for (int i = 0; i < ENIGMA_LETTERS; i++) {
+        config->plugboard[i] = (uint8_t)i;
+    }
+    int pending = -1;
+    for (const char *p = settings->plugboard != NULL ? settings->plugboard : ""; *p != '\0'; p++) {
+        if (*p == ' ') {
+            continue;
+        }
+        if (*p < 'A' || *p > 'Z' || config->plugboard[*p - 'A'] != *p - 'A' || *p - 'A' == pending) {
+            return false;
+        }
+        if (pending < 0) {
+            pending = *p - 'A';
+        } else {
+            config->plugboard[pending] = (uint8_t)(*p - 'A');
+            config->plugboard[*p - 'A'] = (uint8_t)pending;
+            pending = -1;
+        }
+    }
+    return pending < 0;
+}
+
+// checks the starting position and returns its state
+static bool enigma_start(const struct enigma_settings *settings, unsigned *state)
+{
+    unsigned s = 0;
+
+    for (int i = 0; i < 3; i++) {
+        if (settings->positions[i] < 'A' || settings->positions[i] > 'Z') {
+            return false;
+        }
+        s = s * ENIGMA_LETTERS + (unsigned)(settings->positions[i] - 'A');
+    }
+    *state = s;
+    return true;
+}
+
+// sets up a machine for a configuration, keeping its states if it already had it
+static void enigma_configure(struct enigma_machine *m, const struct enigma_config *config)
+{
+    if (m->configured && memcmp(&m->config, config, sizeof(*config)) == 0) {
+        return;
+    }
+    m->config = *config;
+    m->configured = true;
+    for (int i = 0; i < 3; i++) {
+        const char *wiring = rotor_wiring[config->rotors[i]];
+        for (int c = 0; c < ENIGMA_LETTERS; c++) {
+            m->forward[i][c] = (uint8_t)(wiring[c] - 'A');
+            m->backward[i][wiring[c] - 'A'] = (uint8_t)c;
+        }
+    }
+    for (int c = 0; c < ENIGMA_LETTERS; c++) {
+        m->reflector[c] = (uint8_t)(reflector_wiring[config->reflector][c] - 'A');
+    }
+    // invalidating every state at once; the counter wraps after four billion
+    // reconfigurations, when the marks have to be cleared for real
+    if (++m->generation == 0) {
+        memset(m->built, 0, sizeof(m->built));
+        m->generation = 1;
+    }
+}
+
+// passes `c` through a rotor wiring (or its inverse) turned by `offset`, the window
+// position less the ring setting
+static unsigned rotor_pass(const uint8_t *wiring, unsigned offset, unsigned c)
+{
+    return (wiring[(c + offset) % ENIGMA_LETTERS] + ENIGMA_LETTERS - offset) % ENIGMA_LETTERS;
+}
+
+// fills in the stepping and the substitution of state `s`
+static void enigma_build(struct enigma_machine *m, unsigned s)
+{
+    const struct enigma_config *config = &m->config;
+    unsigned position[3] = { s / (ENIGMA_LETTERS * ENIGMA_LETTERS),
+                             s / ENIGMA_LETTERS % ENIGMA_LETTERS, s % ENIGMA_LETTERS };
+    unsigned offset[3];
+
+    for (int i = 0; i < 3; i++) {
+        offset[i] = (position[i] + ENIGMA_LETTERS - config->rings[i]) % ENIGMA_LETTERS;
+    }
+    for (unsigned c = 0; c < ENIGMA_LETTERS; c++) {
+        unsigned x = config->plugboard[c];
+        for (int i = 2; i >= 0; i--) {
+            x = rotor_pass(m->forward[i], offset[i], x);
+        }
+        x = m->reflector[x];
+        for (int i = 0; i < 3; i++) {
+            x = rotor_pass(m->backward[i], offset[i], x);
+        }
+        m->table[s][c] = config->plugboard[x];
+    }
+
+    // the middle rotor at its notch steps itself and the left rotor (the double step);
+    // the right rotor at its notch steps the middle one; the right rotor always steps
+    unsigned left = position[0], middle = position[1], right = position[2];
+    if (middle == (unsigned)(rotor_notch[config->rotors[1]] - 'A')) {
+        middle++;
+        left++;
+    } else if (right == (unsigned)(rotor_notch[config->rotors[2]] - 'A')) {
+        middle++;
+    }
+    right++;
+    m->next[s] = (uint16_t)((left % ENIGMA_LETTERS * ENIGMA_LETTERS + middle % ENIGMA_LETTERS)
+                            * ENIGMA_LETTERS + right % ENIGMA_LETTERS);
+    m->built[s] = m->generation;
+}
+
+// enciphers `in` from state `s`; every letter steps the machine and is then translated
+// with one lookup in the new state's table
+static void enigma_run(struct enigma_machine *m, unsigned s, const char *in, char *out)
+{
+    size_t i;
+
+    if (m->built[s] != m->generation) {
+        enigma_build(m, s);
+    }
+    for (i = 0; in[i] != '\0'; i++) {
+        char c = in[i];
+        if (c < 'A' || c > 'Z') {
+            out[i] = c;
+            continue;
+        }
+        s = m->next[s];
+        if (m->built[s] != m->generation) {
+            enigma_build(m, s);
+        }
+        out[i] = (char)('A' + m->table[s][c - 'A']);
+    }
+    out[i] = '\0';
+}
+
+bool enigma_crypt(const struct enigma_settings *settings, const char *in, char *out)
+{
+    struct enigma_config config;
+    struct enigma_machine *m;
+    unsigned s;
+
+    out[0] = '\0';
+    if (!enigma_config_init(settings, &config) || !enigma_start(settings, &s)) {
+        return false;
+    }
+    // calloc leaves the untouched parts of the tables to the kernel's zero pages
+    m = mem_calloc(1, sizeof(*m));
+    if (m == NULL) {
+        return false;
+    }
+    enigma_configure(m, &config);
+    enigma_run(m, s, in, out);
+    free(m);
+    return true;
+}
+
+// a batch shares a pool of machines, one per thread at most, each reused for as long
+// as consecutive messages on its thread keep the same configuration
+struct enigma_job {
+    const struct enigma_settings *settings;
+    const char *const *in;
+    char *const *out;
+    pthread_mutex_t lock;
+    struct enigma_machine **pool;
+    size_t pooled;
+    atomic_bool failed;
+};
+
+static void enigma_task(void *arg, size_t index)
+{
+    struct enigma_job *job = arg;
+    struct enigma_machine *m = NULL;
+    struct enigma_config config;
+    unsigned s = 0;
+
+    // the settings were checked before the batch started
+    enigma_config_init(&job->settings[index], &config);
+    enigma_start(&job->settings[index], &s);
+
+    pthread_mutex_lock(&job->lock);
+    // prefer a machine that already has this configuration, else take any
+    for (size_t i = 0; i < job->pooled; i++) {
+        if (memcmp(&job->pool[i]->config, &config, sizeof(config)) == 0 || i + 1 == job->pooled) {
+            m = job->pool[i];
+            job->pool[i] = job->pool[--job->pooled];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    if (m == NULL) {
+        m = mem_calloc(1, sizeof(*m));
+        if (m == NULL) {
+            atomic_store(&job->failed, true);
+            job->out[index][0] = '\0';
+            return;
+        }
+    }
+
+    enigma_configure(m, &config);
+    enigma_run(m, s, job->in[index], job->out[index]);
+
+    pthread_mutex_lock(&job->lock);
+    job->pool[job->pooled++] = m;
+    pthread_mutex_unlock(&job->lock);
+}
+
+bool enigma_crypt_batch(const struct enigma_settings *settings, size_t count,
+                        const char *const *in, char *const *out)
+{
+    struct enigma_config config;
+    unsigned s;
+    bool valid = true;
+
+    for (size_t i = 0; i < count; i++) {
+        out[i][0] = '\0';
+        valid = valid && enigma_config_init(&settings[i], &config) && enigma_start(&settings[i], &s);
+    }
+    if (!valid) {
+        return false;
+    }
+
+    // no more machines are out at once than there are threads
+    struct enigma_job job = { settings, in, out, PTHREAD_MUTEX_INITIALIZER,
+                              mem_calloc(parallel_threads(), sizeof(*job.pool)), 0, false };
+    if (job.pool == NULL) {
+        return false;
+    }
+    parallel_run(count, enigma_task, &job);
+    for (size_t i = 0; i < job.pooled; i++) {
+        free(job.pool[i]);
+    }
+    free(job.pool);
+    pthread_mutex_destroy(&job.lock);
+    return !atomic_load(&job.failed);
+}
@@ -0,0 +1,309 @@
+#ifndef SAFECIPHER_HPP
+#define SAFECIPHER_HPP
+
+// a C++20 coroutine interface to the library: Caesar and Vigenere transforms run on a
+// scheduler's threads and are awaited rather than waited for, and streams of chunks are
+// encrypted or decrypted as async generators, a chunk at a time
+
+#include "crypto.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace safecipher {
+
+/** A chunk of a stream. A chunk yielded by a generator is valid until the generator is
+  * resumed (by asking it for the next one).
+  */
+using chunk = std::span<const char>;
+
+/** A coroutine that yields values of type `T` one at a time, and may `co_await` between
+  * them. The consumer asks for each value with `co_await generator.next()`, which resumes
+  * the generator until its next `co_yield` (or its end) without blocking the thread:
+  * while the generator is suspended on something else, so is the consumer.
+  */
+template <typename T>
+class async_generator {
+public:
+    struct promise_type;
+    using handle = std::coroutine_handle<promise_type>;
+
+    // hands control back to the consumer waiting in `next`
+    struct to_consumer {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(handle h) noexcept { return h.promise().consumer; }
+        void await_resume() const noexcept {}
+    };
+
+    struct promise_type {
+        const T *value = nullptr;       // the value of the current co_yield
+        std::exception_ptr error;
+        std::coroutine_handle<> consumer;
+
+        async_generator get_return_object() noexcept
+        {
+            return async_generator(handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        to_consumer final_suspend() const noexcept { return {}; }
+        // the value is a temporary at worst, which lives until the generator resumes
+        to_consumer yield_value(const T &v) noexcept
+        {
+            value = std::addressof(v);
+            return {};
+        }
+        void return_void() const noexcept {}
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    // resumes the generator until it yields or ends
+    struct next_awaiter {
+        handle generator;
+
+        bool await_ready() const noexcept { return generator.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept
+        {
+            generator.promise().consumer = consumer;
+            return generator;
+        }
+        std::optional<T> await_resume()
+        {
+            if (generator.done()) {
+                if (std::exception_ptr error = std::exchange(generator.promise().error, nullptr)) {
+                    std::rethrow_exception(error);
+                }
+                return std::nullopt;
+            }
+            return *generator.promise().value;
+        }
+    };
+
+    async_generator(async_generator &&other) noexcept
+        : coroutine_(std::exchange(other.coroutine_, nullptr)) {}
+    async_generator &operator=(async_generator &&other) noexcept
+    {
+        std::swap(coroutine_, other.coroutine_);
+        return *this;
+    }
+    async_generator(const async_generator &) = delete;
+    async_generator &operator=(const async_generator &) = delete;
+    ~async_generator()
+    {
+        if (coroutine_) {
+            coroutine_.destroy();
+        }
+    }
+
+    /** Await the next value, or `std::nullopt` once the generator has ended; rethrows an
+      * exception the generator ended with.
+      */
+    next_awaiter next() noexcept { return { coroutine_ }; }
+
+private:
+    explicit async_generator(handle coroutine) noexcept : coroutine_(coroutine) {}
+
+    handle coroutine_;
+};
+
+/** What to do to each chunk: a Caesar or Vigenere step over a character range. */
+struct cipher_options {
+    char range_low = 'A';
+    char range_high = 'Z';
+    cipher_step step{};                     //!< its key must outlive the transforms
+    bool decrypt = false;
+    unsigned client = 0;                    //!< the scheduler client the work is charged to
+    const cancel_token *token = nullptr;    //!< if set, stops the transforms once it expires
+};
+
+class pool;
+
+/** A transform submitted to a `pool`, for `co_await`: it suspends the awaiting coroutine
+  * until the transform is done, and yields `true` if it finished or `false` if its token
+  * expired first. The coroutine is resumed on the pool thread that finished it.
+  */
+class transform_awaiter {
+public:
+    bool await_ready() const noexcept { return false; }
+    inline bool await_suspend(std::coroutine_handle<> awaiting);
+    inline bool await_resume();
+
+private:
+    friend class pool;
+
+    transform_awaiter(pool &owner, const cipher_options &options, std::size_t position,
+                      chunk in, char *out) noexcept
+        : pool_(owner), options_(options), position_(position), in_(in), out_(out) {}
+
+    static void finished(void *arg) { static_cast<transform_awaiter *>(arg)->awaiting_.resume(); }
+
+    pool &pool_;
+    cipher_options options_;
+    std::size_t position_;
+    chunk in_;
+    char *out_;
+    std::coroutine_handle<> awaiting_;
+    scheduler_job *job_ = nullptr;
+    bool invalid_ = false;
+};
+
+/** A scheduler (see `scheduler_create`) shared by any number of coroutines. A transform
+  * the scheduler refuses because its queue is full is held until one of the pool's
+  * transforms has been awaited, rather than blocking the coroutine's thread.
+  */
+class pool {
+public:
+    /** \param threads The number of worker threads, or 0 for one per core
+      * \param queue_limit The most transforms submitted and not yet awaited
+      * \param quantum The bytes each client runs per scheduling turn
+      */
+    explicit pool(std::size_t threads = 0, std::size_t queue_limit = 256,
+                  std::size_t quantum = 64 << 10)
+        : scheduler_(scheduler_create(threads, queue_limit, 0, quantum))
+    {
+        if (scheduler_ == nullptr) {
+            throw std::runtime_error("safecipher: could not create the scheduler");
+        }
+    }
+    pool(const pool &) = delete;
+    pool &operator=(const pool &) = delete;
+    /** Lets the submitted transforms finish; their coroutines must not outlive the pool. */
+    ~pool() { scheduler_destroy(scheduler_); }
+
+    /** Transform `in` into `out` (of at least `in.size()` bytes, and which may be
+      * `in.data()`), with the Vigenere key starting at `position`; see
+      * `scheduler_submit_at`. Throws `std::invalid_argument` from the `co_await` if the
+      * step is not a valid Caesar or Vigenere step.
+      */
+    transform_awaiter transform(const cipher_options &options, std::size_t position, chunk in,
+                                char *out) noexcept
+    {
+        return transform_awaiter(*this, options, position, in, out);
+    }
+
+private:
+    friend class transform_awaiter;
+
+    scheduler_status submit(transform_awaiter &t) noexcept
+    {
+        return scheduler_submit_at(scheduler_, t.options_.client, t.options_.range_low,
+                                   t.options_.range_high, &t.options_.step, t.options_.decrypt,
+                                   t.position_, t.in_.data(), t.in_.size(), t.out_,
+                                   t.options_.token, &t.job_);
+    }
+
+    // submits a transform, and returns whether its coroutine stays suspended: until the
+    // transform is done, or until a slot is free for it. The lock is held from the
+    // submission to the queueing, so a slot freed in between is not missed
+    bool start(transform_awaiter &t)
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        scheduler_status status = submit(t);
+        if (status == SCHEDULER_BUSY) {
+            held_.push_back(&t);
+            return true;
+        }
+        guard.unlock();
+        t.invalid_ = status == SCHEDULER_INVALID;
+        return !t.invalid_ && scheduler_notify(scheduler_, t.job_, &transform_awaiter::finished, &t);
+    }
+
+    // called once a transform has been awaited, freeing its slot: submits the oldest held
+    // transform, which is resumed at once if it is already done (or invalid)
+    void released()
+    {
+        transform_awaiter *t = nullptr;
+        scheduler_status status = SCHEDULER_BUSY;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (!held_.empty()) {
+                status = submit(*held_.front());
+                if (status != SCHEDULER_BUSY) {
+                    t = held_.front();
+                    held_.pop_front();
+                }
+            }
+        }
+        if (t != nullptr) {
+            t->invalid_ = status == SCHEDULER_INVALID;
+            if (t->invalid_ || !scheduler_notify(scheduler_, t->job_, &transform_awaiter::finished, t)) {
+                t->awaiting_.resume();
+            }
+        }
+    }
+
+    scheduler *scheduler_;
+    std::mutex lock_;
+    std::deque<transform_awaiter *> held_;
+};
+
+bool transform_awaiter::await_suspend(std::coroutine_handle<> awaiting)
+{
+    awaiting_ = awaiting;
+    return pool_.start(*this);
+}
+
+bool transform_awaiter::await_resume()
+{
+    if (invalid_) {
+        throw std::invalid_argument("safecipher: not a valid Caesar or Vigenere step");
+    }
+    bool finished = scheduler_wait(pool_.scheduler_, job_);
+    pool_.released();
+    return finished;
+}
+
+/** Transform a stream of chunks on a pool, yielding each chunk's output as it is done.
+  * Only one chunk is in memory at a time, whatever the length of the stream; the key
+  * position is carried from each chunk to the next (see `cipher_step_advance`), so the
+  * output is the same however the input is split. Throws `std::runtime_error` if the
+  * options' token expires, and `std::invalid_argument` if the step is not valid.
+  *
+  * The pool must outlive the generator, and the consumer is resumed on pool threads.
+  */
+inline async_generator<chunk> transform_stream(pool &workers, cipher_options options,
+                                               async_generator<chunk> input)
+{
+    std::vector<char> out;
+    std::size_t position = 0;
+
+    while (std::optional<chunk> in = co_await input.next()) {
+        out.resize(in->size());
+        std::size_t next = cipher_step_advance(options.range_low, options.range_high,
+                                               &options.step, position, in->data(), in->size());
+        if (!co_await workers.transform(options, position, *in, out.data())) {
+            throw std::runtime_error("safecipher: the stream was cancelled");
+        }
+        position = next;
+        co_yield chunk(out.data(), out.size());
+    }
+}
+
+/** Encrypt a stream of chunks; see `transform_stream`. */
+inline async_generator<chunk> encrypt(pool &workers, cipher_options options,
+                                      async_generator<chunk> input)
+{
+    options.decrypt = false;
+    return transform_stream(workers, options, std::move(input));
+}
+
+/** Decrypt a stream of chunks; see `transform_stream`. */
+inline async_generator<chunk> decrypt(pool &workers, cipher_options options,
+                                      async_generator<chunk> input)
+{
+    options.decrypt = true;
+    return transform_stream(workers, options, std::move(input));
+}
+
+} // namespace safecipher
+
+#endif
+// SAFECIPHER_HPP
@@ -0,0 +1,414 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+// the most worker threads a scheduler starts
+#define   SCHEDULER_MAX_THREADS   64
+
+// bytes transformed between checks of a job's cancellation token; about a tenth of a
+// millisecond of work, so a cancelled job stops well within a millisecond
+#define   CANCEL_SLICE   (256 << 10)
+
+enum job_state {
+    JOB_FREE,       // in the pool
+    JOB_QUEUED,     // admitted; some of it is still to be transformed
+    JOB_DONE        // transformed, waiting for scheduler_wait
+};
+
+struct scheduler_job {
+    enum job_state state;
+    bool running;               // a worker is transforming one of its chunks
+    struct scheduler_client *client;
+    struct scheduler_job *next; // the client's next admitted job, or the next free one
+    char range_low, range_high;
+    int shift;                  // the Caesar key, if `key` is NULL
+    const char *key;
+    size_t key_len;
+    bool decrypt;
+    const char *in;
+    char *out;
+    size_t len;
+    size_t done;                // bytes transformed, always a whole number of chunks
+    size_t phase;               // the Vigenere key position at `done`
+    const struct cancel_token *token;
+    bool cancelled;             // the token expired before the job was finished
+    void (*notify)(void *arg);  // called once the job is done, if set by scheduler_notify
+    void *notify_arg;
+};
+
+// a client with admitted jobs; it has a place in the round-robin ring while it does
+struct scheduler_client {
+    unsigned id;
+    struct scheduler_job *head, *tail;  // its admitted jobs, oldest first
+    size_t admitted;
+    size_t deficit;                     // bytes it may still run this turn
+};
+
+struct scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // signalled when a chunk may have become runnable
+    pthread_cond_t finished;    // broadcast when a job is done
+    size_t quantum;
+    size_t client_limit;
+    bool stopping;
+
+    struct scheduler_job *jobs;
+    struct scheduler_job *free_jobs;
+    struct scheduler_client *clients;   // `queue_limit` of them, one per possible client
+    struct scheduler_client **ring;     // the clients with admitted jobs, in turn order
+    size_t ring_count;
+    size_t cursor;                      // whose turn it is
+
+    pthread_t threads[SCHEDULER_MAX_THREADS];
+    size_t thread_count;
+};
+
+// the current time in nanoseconds on a monotonic clock
+static uint64_t monotonic_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+void cancel_token_init(struct cancel_token *token, uint64_t timeout_ms)
+{
+    token->cancelled = 0;
+    token->deadline_ns = timeout_ms != 0 ? monotonic_ns() + timeout_ms * 1000000u : 0;
+}
+
+void cancel_token_cancel(struct cancel_token *token)
+{
+    __atomic_store_n(&token->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+bool cancel_token_expired(const struct cancel_token *token)
+{
+    return __atomic_load_n(&token->cancelled, __ATOMIC_RELAXED) != 0
+           || (token->deadline_ns != 0 && monotonic_ns() >= token->deadline_ns);
+}
+
+static size_t saturating_add(size_t a, size_t b)
+{
+    return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
+
+// the oldest of a client's jobs no worker is running a chunk of, if any
+static struct scheduler_job *runnable_job(const struct scheduler_client *client)
+{
+    for (struct scheduler_job *job = client->head; job != NULL; job = job->next) {
+        if (!job->running) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// picks the next chunk to run by deficit round-robin: each turn gives the client whose
+// turn it is a quantum of bytes more to spend, and it keeps the turn while its next
+// chunk fits in what it has left. A chunk is at most a quantum, so a client with a
+// runnable job runs at least a chunk a turn however large its jobs, and a client with
+// many small jobs runs a quantum's worth of them a turn
+static struct scheduler_job *scheduler_pick(struct scheduler *s, size_t *chunk)
+{
+    for (size_t tries = 0; tries <= s->ring_count && s->ring_count > 0; tries++) {
+        struct scheduler_client *client = s->ring[s->cursor];
+        struct scheduler_job *job = runnable_job(client);
+        if (job != NULL) {
+            size_t cost = job->len - job->done < s->quantum ? job->len - job->done : s->quantum;
+            if (client->deficit >= cost) {
+                client->deficit -= cost;
+                *chunk = cost;
+                return job;
+            }
+        }
+        s->cursor = (s->cursor + 1) % s->ring_count;
+        struct scheduler_client *next = s->ring[s->cursor];
+        if (runnable_job(next) != NULL) {
+            next->deficit = saturating_add(next->deficit, s->quantum);
+        }
+    }
+    return NULL;
+}
+
+// takes a finished job off its client's list, and the client out of the ring once it
+// has none left
+static void scheduler_finish(struct scheduler *s, struct scheduler_job *job)
+{
+    struct scheduler_client *client = job->client;
+    struct scheduler_job **link = &client->head;
+
+    while (*link != job) {
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    if (client->tail == job) {
+        client->tail = NULL;
+        for (struct scheduler_job *j = client->head; j != NULL; j = j->next) {
+            client->tail = j;
+        }
+    }
+    job->next = NULL;
+    job->state = JOB_DONE;
+    TRACE_INSTANT(job_done, job->done);
+    if (--client->admitted == 0) {
+        size_t i = 0;
+        while (s->ring[i] != client) {
+            i++;
+        }
+        memmove(&s->ring[i], &s->ring[i + 1], (s->ring_count - i - 1) * sizeof(*s->ring));
+        s->ring_count--;
+        client->deficit = 0;
+        // if it was this client's turn, the turn passes to the one after it
+        if (s->cursor > i) {
+            s->cursor--;
+        } else if (s->cursor == i) {
+            s->cursor = s->cursor == s->ring_count ? 0 : s->cursor;
+            if (s->ring_count > 0 && runnable_job(s->ring[s->cursor]) != NULL) {
+                s->ring[s->cursor]->deficit = saturating_add(s->ring[s->cursor]->deficit,
+                                                             s->quantum);
+            }
+        }
+    }
+    pthread_cond_broadcast(&s->finished);
+}
+
+// runs chunks until the scheduler is destroyed
+static void *scheduler_worker(void *arg)
+{
+    struct scheduler *s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        size_t chunk = 0;
+        struct scheduler_job *job;
+        while ((job = scheduler_pick(s, &chunk)) == NULL && !s->stopping) {
+            pthread_cond_wait(&s->work, &s->lock);
+        }
+        if (job == NULL) {
+            break;
+        }
+        // a job's chunks run one at a time, in order, as each needs the key position
+        // the one before it ended at; with a token, a chunk runs a slice at a time and
+        // stops at the first slice boundary after the token expires
+        job->running = true;
+        size_t start = job->done;
+        size_t slice = job->token != NULL ? CANCEL_SLICE : chunk;
+        size_t ran = 0;
+        pthread_mutex_unlock(&s->lock);
+
+        if (start == 0) {
+            TRACE_INSTANT(job_start, job->len);
+        }
+        TRACE_BEGIN(chunk, chunk);
+
+        while (ran < chunk && (job->token == NULL || !cancel_token_expired(job->token))) {
+            size_t n = chunk - ran < slice ? chunk - ran : slice;
+            if (job->key != NULL) {
+                job->phase = vigenere_transform(job->range_low, job->range_high, job->key,
+                                                job->key_len, job->phase, job->decrypt,
+                                                job->in + start + ran, job->out + start + ran, n);
+            } else {
+                caesar_transform(job->range_low, job->range_high, job->shift,
+                                 job->in + start + ran, job->out + start + ran, n);
+            }
+            ran += n;
+        }
+        TRACE_END(chunk, ran);
+
+        pthread_mutex_lock(&s->lock);
+        job->running = false;
+        job->done += ran;
+        job->cancelled = ran < chunk;
+        if (job->done == job->len || job->cancelled) {
+            scheduler_finish(s, job);
+            // the job may be waited for and reused as soon as the lock is released, so
+            // the callback is taken off it first
+            void (*notify)(void *arg) = job->notify;
+            void *notify_arg = job->notify_arg;
+            job->notify = NULL;
+            if (notify != NULL) {
+                pthread_mutex_unlock(&s->lock);
+                notify(notify_arg);
+                pthread_mutex_lock(&s->lock);
+            }
+        }
+        pthread_cond_signal(&s->work);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+struct scheduler *scheduler_create(size_t threads, size_t queue_limit, size_t client_limit,
+                                   size_t quantum)
+{
+    struct scheduler *s = mem_calloc(1, sizeof(*s));
+
+    if (s == NULL) {
+        return NULL;
+    }
+    if (threads == 0) {
+        threads = parallel_threads();
+    }
+    threads = threads < SCHEDULER_MAX_THREADS ? threads : SCHEDULER_MAX_THREADS;
+    s->quantum = quantum != 0 ? quantum : 1;
+    s->client_limit = client_limit != 0 ? client_limit : queue_limit;
+    s->jobs = mem_calloc(queue_limit, sizeof(*s->jobs));
+    s->clients = mem_calloc(queue_limit, sizeof(*s->clients));
+    s->ring = mem_calloc(queue_limit, sizeof(*s->ring));
+    if (queue_limit == 0 || s->jobs == NULL || s->clients == NULL || s->ring == NULL
+        || pthread_mutex_init(&s->lock, NULL) != 0) {
+        free(s->jobs);
+        free(s->clients);
+        free(s->ring);
+        free(s);
+        return NULL;
+    }
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->finished, NULL);
+    for (size_t i = queue_limit; i-- > 0;) {
+        s->jobs[i].next = s->free_jobs;
+        s->free_jobs = &s->jobs[i];
+    }
+    while (s->thread_count < threads
+           && pthread_create(&s->threads[s->thread_count], NULL, scheduler_worker, s) == 0) {
+        s->thread_count++;
+    }
+    if (s->thread_count == 0) {
+        scheduler_destroy(s);
+        return NULL;
+    }
+    return s;
+}
+
+enum scheduler_status scheduler_submit(struct scheduler *s, unsigned client_id,
+                                       char range_low, char range_high,
+                                       const struct cipher_step *step, bool decrypt,
+                                       const char *in, size_t len, char *out,
+                                       const struct cancel_token *token,
+                                       struct scheduler_job **handle)
+{
+    return scheduler_submit_at(s, client_id, range_low, range_high, step, decrypt, 0, in, len,
+                               out, token, handle);
+}
+
+enum scheduler_status scheduler_submit_at(struct scheduler *s, unsigned client_id,
+                                          char range_low, char range_high,
+                                          const struct cipher_step *step, bool decrypt,
+                                          size_t position, const char *in, size_t len,
+                                          char *out, const struct cancel_token *token,
+                                          struct scheduler_job **handle)
+{
+    int shift = 0;
+
+    if (step->kind == CIPHER_CAESAR) {
+        int range_size = range_high - range_low + 1;
+        shift = step->shift % range_size;
+        shift = decrypt ? -shift : shift;
+    } else if (step->kind != CIPHER_VIGENERE || !vigenere_key_valid(range_low, range_high, step->key)) {
+        return SCHEDULER_INVALID;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    struct scheduler_job *job = s->free_jobs;
+    struct scheduler_client *client = NULL;
+    for (size_t i = 0; i < s->ring_count && client == NULL; i++) {
+        client = s->ring[i]->id == client_id ? s->ring[i] : NULL;
+    }
+    if (job == NULL || (client != NULL && client->admitted >= s->client_limit)) {
+        pthread_mutex_unlock(&s->lock);
+        TRACE_INSTANT(job_refused, client_id);
+        return SCHEDULER_BUSY;
+    }
+    // there are as many client records as jobs, and a free job means one of them has
+    // no admitted jobs
+    if (client == NULL) {
+        client = s->clients;
+        while (client->admitted != 0) {
+            client++;
+        }
+        *client = (struct scheduler_client){ .id = client_id };
+        s->ring[s->ring_count++] = client;
+    }
+
+    s->free_jobs = job->next;
+    *job = (struct scheduler_job){
+        .state = JOB_QUEUED, .client = client,
+        .range_low = range_low, .range_high = range_high, .shift = shift,
+        .key = step->kind == CIPHER_VIGENERE ? step->key : NULL,
+        .key_len = step->kind == CIPHER_VIGENERE ? strlen(step->key) : 0,
+        .decrypt = decrypt, .in = in, .out = out, .len = len, .token = token,
+    };
+    job->phase = job->key_len != 0 ? position % job->key_len : 0;
+    if (client->tail != NULL) {
+        client->tail->next = job;
+    } else {
+        client->head = job;
+    }
+    client->tail = job;
+    client->admitted++;
+    TRACE_INSTANT(job_submit, client_id);
+    if (len == 0) {
+        scheduler_finish(s, job);
+    }
+    pthread_cond_signal(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    *handle = job;
+    return SCHEDULER_OK;
+}
+
+bool scheduler_notify(struct scheduler *s, struct scheduler_job *job,
+                      void (*notify)(void *arg), void *arg)
+{
+    pthread_mutex_lock(&s->lock);
+    bool pending = job->state != JOB_DONE;
+    if (pending) {
+        job->notify = notify;
+        job->notify_arg = arg;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return pending;
+}
+
+bool scheduler_wait(struct scheduler *s, struct scheduler_job *job)
+{
+    pthread_mutex_lock(&s->lock);
+    while (job->state != JOB_DONE) {
+        pthread_cond_wait(&s->finished, &s->lock);
+    }
+    bool finished = !job->cancelled;
+    job->state = JOB_FREE;
+    job->next = s->free_jobs;
+    s->free_jobs = job;
+    pthread_mutex_unlock(&s->lock);
+    return finished;
+}
+
+void scheduler_destroy(struct scheduler *s)
+{
+    if (s == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->stopping = true;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    for (size_t i = 0; i < s->thread_count; i++) {
+        pthread_join(s->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->finished);
+    free(s->jobs);
+    free(s->clients);
+    free(s->ring);
+    free(s);
+}
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// bytes per block of the rank index, and per write of a shard's output
+#define   SHARD_BLOCK   (1 << 20)
+
+static const char index_magic[8] = { 'S', 'C', 'I', 'N', 'D', 'E', 'X', '1' };
+
+// the rank index starts with this header, followed by one `uint64_t` per block boundary
+// (`size / block + 1` of them): the number of in-range bytes before it
+struct shard_index_header {
+    char magic[8];
+    uint64_t block;
+    uint64_t size;
+    char range_low, range_high;
+    char reserved[6];
+};
+
+// maps a whole file for reading; an empty file maps to NULL
+static bool map_file(int fd, const char **data, size_t *len)
+{
+    struct stat st;
+
+    *data = NULL;
+    *len = 0;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    if (st.st_size == 0) {
+        return true;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    *data = map;
+    *len = (size_t)st.st_size;
+    return true;
+}
+
+static void unmap_file(const char *data, size_t len)
+{
+    if (data != NULL) {
+        munmap((void *)data, len);
+    }
+}
+
+// counts the in-range bytes of each block of a mapped file, a block per task
+struct count_job {
+    char range_low, range_high;
+    const char *data;
+    size_t len;
+    uint64_t *counts;
+};
+
+static void count_task(void *arg, size_t index)
+{
+    struct count_job *job = arg;
+    size_t start = index * SHARD_BLOCK;
+    size_t len = job->len - start < SHARD_BLOCK ? job->len - start : SHARD_BLOCK;
+
+    job->counts[index] = range_count(job->range_low, job->range_high, job->data + start, len);
+}
+
+// the number of in-range bytes of `data[0..len)`, a block per thread at a time
+static uint64_t count_parallel(char range_low, char range_high, const char *data, size_t len,
+                               bool *ok)
+{
+    size_t blocks = (len + SHARD_BLOCK - 1) / SHARD_BLOCK;
+    struct count_job job = { range_low, range_high, data, len, mem_calloc(blocks + 1, sizeof(uint64_t)) };
+    uint64_t total = 0;
+
+    if (job.counts == NULL) {
+        *ok = false;
+        return 0;
+    }
+    TRACE_BEGIN(count, len);
+    parallel_run(blocks, count_task, &job);
+    TRACE_END(count, len);
+    for (size_t i = 0; i < blocks; i++) {
+        total += job.counts[i];
+    }
+    free(job.counts);
+    return total;
+}
+
+bool shard_index_build(char range_low, char range_high, int in_fd, int out_fd)
+{
+    const char *data;
+    size_t len;
+
+    if (!map_file(in_fd, &data, &len)) {
+        return false;
+    }
+    size_t blocks = len / SHARD_BLOCK + 1;
+    struct count_job job = { range_low, range_high, data, len, mem_calloc(blocks, sizeof(uint64_t)) };
+    if (job.counts == NULL) {
+        unmap_file(data, len);
+        return false;
+    }
+    // each block's own count, then turned into the counts before each boundary in place
+    parallel_run((len + SHARD_BLOCK - 1) / SHARD_BLOCK, count_task, &job);
+    uint64_t before = 0;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t count = job.counts[i];
+        job.counts[i] = before;
+        before += count;
+    }
+
+    struct shard_index_header header = { .block = SHARD_BLOCK, .size = len,
+                                         .range_low = range_low, .range_high = range_high };
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    bool ok = write_full(out_fd, (const char *)&header, sizeof(header))
+              && write_full(out_fd, (const char *)job.counts, blocks * sizeof(uint64_t));
+    free(job.counts);
+    unmap_file(data, len);
+    return ok;
+}
+
+// looks up the number of in-range bytes before `offset` in a rank index built for this
+// file and range, counting only the part of a block past the boundary before it
+static bool index_lookup(char range_low, char range_high, int index_fd, const char *data,
+                         size_t len, size_t offset, uint64_t *count)
+{
+    struct shard_index_header header;
+    uint64_t before;
+
+    if (pread(index_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || memcmp(header.magic, index_magic, sizeof(index_magic)) != 0
+        || header.block == 0 || header.size != len
+        || header.range_low != range_low || header.range_high != range_high) {
+        return false;
+    }
+    uint64_t boundary = offset / header.block;
+    if (pread(index_fd, &before, sizeof(before),
+              (off_t)(sizeof(header) + boundary * sizeof(uint64_t))) != (ssize_t)sizeof(before)) {
+        return false;
+    }
+    size_t start = (size_t)(boundary * header.block);
+    *count = before + range_count(range_low, range_high, data + start, offset - start);
+    return true;
+}
+
+// the first byte of shard `shard`; the first `len % shards` shards get a byte more
+static size_t shard_start(size_t len, size_t shard, size_t shards)
+{
+    size_t extra = len % shards;
+    return shard * (len / shards) + (shard < extra ? shard : extra);
+}
+
+bool cipher_shard(char range_low, char range_high, const struct cipher_step *step,
+                  bool decrypt, int in_fd, size_t shard, size_t shards, int index_fd,
+                  int out_fd, struct cipher_checksums *checksums)
+{
+    const char *data;
+    size_t len;
+    int shift = 0;
+    size_t key_len = 0;
+    size_t phase = 0;
+    bool ok = true;
+
+    if (shards == 0 || shard >= shards) {
+        return false;
+    }
+    if (step->kind == CIPHER_CAESAR) {
+        int range_size = range_high - range_low + 1;
+        shift = step->shift % range_size;
+        shift = decrypt ? -shift : shift;
+    } else if (step->kind == CIPHER_VIGENERE && vigenere_key_valid(range_low, range_high, step->key)) {
+        key_len = strlen(step->key);
+    } else {
+        return false;
+    }
+    if (!map_file(in_fd, &data, &len)) {
+        return false;
+    }
+    size_t start = shard_start(len, shard, shards);
+    size_t end = shard_start(len, shard + 1, shards);
+
+    // the key position at the start of the shard: the in-range bytes before it, from the
+    // rank index if there is one, or else counted across all threads
+    if (key_len != 0) {
+        uint64_t before = 0;
+        if (index_fd >= 0) {
+            ok = index_lookup(range_low, range_high, index_fd, data, len, start, &before);
+        } else {
+            before = count_parallel(range_low, range_high, data, start, &ok);
+        }
+        phase = (size_t)(before % key_len);
+    }
+
+    char *buf = ok ? mem_malloc(SHARD_BLOCK) : NULL;
+    uint32_t crc_in = 0, crc_out = 0;
+    ok = buf != NULL;
+    for (size_t at = start; ok && at < end; at += SHARD_BLOCK) {
+        size_t n = end - at < SHARD_BLOCK ? end - at : SHARD_BLOCK;
+        if (key_len != 0) {
+            phase = vigenere_transform(range_low, range_high, step->key, key_len, phase,
+                                       decrypt, data + at, buf, n);
+        } else {
+            caesar_transform(range_low, range_high, shift, data + at, buf, n);
+        }
+        if (checksums != NULL) {
+            crc_in = crc32c(crc_in, data + at, n);
+            crc_out = crc32c(crc_out, buf, n);
+        }
+        TRACE_BEGIN(write, at);
+        ok = write_full(out_fd, buf, n);
+        TRACE_END(write, n);
+    }
+    if (ok && checksums != NULL) {
+        checksums->input = crc_in;
+        checksums->output = crc_out;
+    }
+    free(buf);
+    unmap_file(data, len);
+    return ok;
+}
@@ -0,0 +1,373 @@
+#define _GNU_SOURCE     // vmsplice and the pipe size fcntls
+
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// bytes per chunk; large enough that the per-chunk locking is lost in the cipher work
+#define   STREAM_CHUNK   (1 << 20)
+
+enum slot_state {
+    SLOT_FREE,      // waiting for the reader
+    SLOT_FULL,      // read, waiting for a worker
+    SLOT_BUSY,      // being transformed
+    SLOT_DONE       // transformed, waiting for the writer
+};
+
+// one chunk in flight; chunk `seq` always occupies slot `seq % slot_count`, so the
+// reader can only run `slot_count` chunks ahead of the writer
+struct stream_slot {
+    char *data;
+    size_t len;
+    size_t phase;           // the Vigenere key position at the start of the chunk
+    size_t end;             // the output offset just past the chunk, once written
+    enum slot_state state;
+};
+
+struct stream_job {
+    char range_low, range_high;
+    int shift;              // the Caesar key, if `key` is NULL
+    const char *key;
+    size_t key_len;
+    bool decrypt;
+    int in_fd, out_fd;
+    size_t pipe_capacity;       // bytes the output pipe holds, when splicing into it
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // broadcast on every state change
+    struct stream_slot *slots;
+    size_t slot_count;
+    size_t next_work;           // the next chunk a worker takes
+    size_t chunks;              // chunks read so far
+    bool eof;                   // `chunks` is final
+    bool failed;                // a read or write failed; everyone stops
+    uint32_t crc_in;
+};
+
+// reads until `len` bytes or the end of the input; returns the bytes read, or -1
+static ssize_t read_full(int fd, char *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = read(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+bool write_full(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// the capacity of the output pipe if the chunks can be spliced into it, or 0. The pipe is
+// grown to a chunk if allowed, and it must not be so large that the chunks it can hold
+// (see stream_release) use up the slots
+static size_t pipe_capacity(int fd, size_t slot_count)
+{
+#ifdef __linux__
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return 0;
+    }
+    fcntl(fd, F_SETPIPE_SZ, STREAM_CHUNK);
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    if (size <= 0 || (size_t)size > (slot_count - 2) * STREAM_CHUNK) {
+        return 0;
+    }
+    return (size_t)size;
+#else
+    (void)fd;
+    (void)slot_count;
+    return 0;
+#endif
+}
+
+// hands a chunk's pages to the output pipe rather than copying them into it, falling
+// back to write() if the kernel refuses
+static bool splice_full(struct stream_job *job, const char *buf, size_t len)
+{
+#ifdef __linux__
+    while (len > 0) {
+        struct iovec iov = { (void *)buf, len };
+        ssize_t n = vmsplice(job->out_fd, &iov, 1, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            break;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+#endif
+    return write_full(job->out_fd, buf, len);
+}
+
+// slices the input into chunks, giving each the key position its first byte needs
+// (the count of in-range bytes before it, modulo the key length)
+static void *stream_reader(void *arg)
+{
+    struct stream_job *job = arg;
+    size_t phase = 0;
+
+    for (size_t seq = 0;; seq++) {
+        struct stream_slot *slot = &job->slots[seq % job->slot_count];
+
+        pthread_mutex_lock(&job->lock);
+        while (slot->state != SLOT_FREE && !job->failed) {
+            TRACE_BEGIN(wait_slot, seq);
+            pthread_cond_wait(&job->changed, &job->lock);
+            TRACE_END(wait_slot, seq);
+        }
+        bool failed = job->failed;
+        pthread_mutex_unlock(&job->lock);
+        if (failed) {
+            return NULL;
+        }
+
+        TRACE_BEGIN(read, seq);
+        ssize_t n = read_full(job->in_fd, slot->data, STREAM_CHUNK);
+        TRACE_END(read, n);
+        if (n > 0) {
+            slot->len = (size_t)n;
+            slot->phase = phase;
+            if (job->key != NULL) {
+                phase = (phase + range_count(job->range_low, job->range_high, slot->data,
+                                             slot->len)) % job->key_len;
+            }
+            job->crc_in = crc32c(job->crc_in, slot->data, slot->len);
+        }
+
+        pthread_mutex_lock(&job->lock);
+        if (n < 0) {
+            job->failed = true;
+        } else if (n > 0) {
+            slot->state = SLOT_FULL;
+            job->chunks++;
+        }
+        if (n < STREAM_CHUNK) {
+            job->eof = true;
+        }
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+        if (n < STREAM_CHUNK) {
+            return NULL;
+        }
+    }
+}
+
+// takes the oldest chunk no one has started on, if any; called with the lock held.
+// Chunks `next_work` to `chunks - 1` are always full
+static struct stream_slot *stream_take(struct stream_job *job)
+{
+    if (job->failed || job->next_work == job->chunks) {
+        return NULL;
+    }
+    struct stream_slot *slot = &job->slots[job->next_work++ % job->slot_count];
+    slot->state = SLOT_BUSY;
+    return slot;
+}
+
+// transforms a taken chunk in place, with the lock released
+static void stream_transform(struct stream_job *job, struct stream_slot *slot)
+{
+    pthread_mutex_unlock(&job->lock);
+    TRACE_BEGIN(chunk, slot->len);
+    if (job->key != NULL) {
+        vigenere_transform(job->range_low, job->range_high, job->key, job->key_len,
+                           slot->phase, job->decrypt, slot->data, slot->data, slot->len);
+    } else {
+        caesar_transform(job->range_low, job->range_high, job->shift, slot->data,
+                         slot->data, slot->len);
+    }
+    TRACE_END(chunk, slot->len);
+    pthread_mutex_lock(&job->lock);
+    slot->state = SLOT_DONE;
+    pthread_cond_broadcast(&job->changed);
+}
+
+// transforms chunks as they are read until the input ends
+static void *stream_worker(void *arg)
+{
+    struct stream_job *job = arg;
+
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        while (!job->failed && job->next_work == job->chunks && !job->eof) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        struct stream_slot *slot = stream_take(job);
+        if (slot == NULL) {
+            break;
+        }
+        stream_transform(job, slot);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+static void stream_unmap(struct stream_job *job)
+{
+    for (size_t i = 0; job->slots != NULL && i < job->slot_count; i++) {
+        if (job->slots[i].data != NULL) {
+            munmap(job->slots[i].data, STREAM_CHUNK);
+        }
+    }
+    free(job->slots);
+}
+
+size_t cipher_step_advance(char range_low, char range_high, const struct cipher_step *step,
+                           size_t position, const char *text, size_t len)
+{
+    if (step->kind != CIPHER_VIGENERE || step->key == NULL || step->key[0] == '\0') {
+        return position;
+    }
+    size_t key_len = strlen(step->key);
+    return (position % key_len + range_count(range_low, range_high, text, len) % key_len) % key_len;
+}
+
+bool cipher_stream(char range_low, char range_high, const struct cipher_step *step,
+                   bool decrypt, int in_fd, int out_fd, bool zero_copy,
+                   struct cipher_checksums *checksums)
+{
+    struct stream_job job = {
+        .range_low = range_low, .range_high = range_high, .decrypt = decrypt,
+        .in_fd = in_fd, .out_fd = out_fd,
+        .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER,
+    };
+    pthread_t reader;
+    pthread_t workers[64];
+    size_t worker_count = parallel_threads();
+    size_t started = 0;
+    uint32_t crc_out = 0;
+    bool ok = true;
+
+    if (step->kind == CIPHER_CAESAR) {
+        int range_size = range_high - range_low + 1;
+        job.shift = step->shift % range_size;
+        job.shift = decrypt ? -job.shift : job.shift;
+    } else if (step->kind == CIPHER_VIGENERE && vigenere_key_valid(range_low, range_high, step->key)) {
+        job.key = step->key;
+        job.key_len = strlen(step->key);
+    } else {
+        return false;
+    }
+
+    // two chunks per worker keep every worker busy while the writer drains the oldest
+    job.slot_count = 2 * worker_count + 2;
+    job.slots = mem_calloc(job.slot_count, sizeof(*job.slots));
+    // the chunks are mapped rather than allocated, so they are page-aligned for splicing
+    // and their pages go back to the kernel (not to the heap, to be handed out again
+    // while a pipe may still refer to them) when the stream ends
+    for (size_t i = 0; job.slots != NULL && i < job.slot_count; i++) {
+        void *data = mmap(NULL, STREAM_CHUNK, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        job.slots[i].data = data != MAP_FAILED ? data : NULL;
+        ok = ok && job.slots[i].data != NULL;
+        if (job.slots[i].data != NULL) {
+            memory_note(STREAM_CHUNK);
+        }
+    }
+    if (job.slots == NULL || !ok
+        || pthread_create(&reader, NULL, stream_reader, &job) != 0) {
+        stream_unmap(&job);
+        return false;
+    }
+    job.pipe_capacity = zero_copy ? pipe_capacity(out_fd, job.slot_count) : 0;
+    while (started < worker_count && started < sizeof(workers) / sizeof(workers[0])
+           && pthread_create(&workers[started], NULL, stream_worker, &job) == 0) {
+        started++;
+    }
+
+    // the calling thread writes the chunks out in order, transforming the one it waits
+    // for itself if no worker has started on it (so it also works with no workers)
+    size_t written_out = 0;     // bytes written so far
+    size_t released = 0;        // chunks given back to the reader
+    for (size_t seq = 0;; seq++) {
+        struct stream_slot *slot = &job.slots[seq % job.slot_count];
+
+        pthread_mutex_lock(&job.lock);
+        while (!job.failed && slot->state != SLOT_DONE && !(job.eof && seq == job.chunks)) {
+            if (job.next_work == seq && seq < job.chunks) {
+                stream_transform(&job, stream_take(&job));
+                continue;
+            }
+            TRACE_BEGIN(wait_chunk, seq);
+            pthread_cond_wait(&job.changed, &job.lock);
+            TRACE_END(wait_chunk, seq);
+        }
+        bool finished = job.failed || slot->state != SLOT_DONE;
+        pthread_mutex_unlock(&job.lock);
+        if (finished) {
+            break;
+        }
+
+        crc_out = crc32c(crc_out, slot->data, slot->len);
+        TRACE_BEGIN(write, seq);
+        bool written = job.pipe_capacity != 0 ? splice_full(&job, slot->data, slot->len)
+                                              : write_full(out_fd, slot->data, slot->len);
+        TRACE_END(write, slot->len);
+        written_out += slot->len;
+        slot->end = written_out;
+
+        // a spliced chunk's pages are still the pipe's until the other end reads them,
+        // which it must have done once a pipe's worth of later output has gone in after
+        // them, since the pipe never holds more; written chunks are released at once
+        pthread_mutex_lock(&job.lock);
+        while (released <= seq
+               && job.slots[released % job.slot_count].end + job.pipe_capacity <= written_out) {
+            job.slots[released++ % job.slot_count].state = SLOT_FREE;
+        }
+        job.failed = job.failed || !written;
+        pthread_cond_broadcast(&job.changed);
+        pthread_mutex_unlock(&job.lock);
+    }
+
+    pthread_join(reader, NULL);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    ok = !job.failed;
+    if (ok && checksums != NULL) {
+        checksums->input = job.crc_in;
+        checksums->output = crc_out;
+    }
+    stream_unmap(&job);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.changed);
+    return ok;
+}
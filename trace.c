@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "crypto.h"
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// events each thread's ring keeps; the oldest are overwritten
+#define   TRACE_RING_EVENTS   4096
+
+int trace_active;
+
+// every field is written and read with relaxed atomics, as a dump may read a ring while
+// its thread is writing to it
+struct trace_event {
+    uint64_t ns;
+    const char *name;
+    uint64_t arg;
+    uint32_t tid;
+    char phase;
+};
+
+// one thread's events; a ring outlives its thread, and is handed to a later thread once
+// the first has exited, so threads that come and go do not add rings without bound
+struct trace_ring {
+    struct trace_ring *next;
+    uint64_t head;              // events written so far
+    bool in_use;
+    uint32_t tid;
+    struct trace_event events[TRACE_RING_EVENTS];
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *trace_rings;
+static uint32_t trace_next_tid = 1;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct trace_ring *trace_ring;
+static char *trace_path;
+
+static uint64_t trace_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+// gives an exiting thread's ring back for reuse
+static void trace_release(void *ring)
+{
+    pthread_mutex_lock(&trace_lock);
+    ((struct trace_ring *)ring)->in_use = false;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_key_init(void)
+{
+    pthread_key_create(&trace_key, trace_release);
+}
+
+// the calling thread's ring, taking a free one or allocating one the first time
+static struct trace_ring *trace_thread_ring(void)
+{
+    struct trace_ring *ring;
+
+    pthread_once(&trace_key_once, trace_key_init);
+    pthread_mutex_lock(&trace_lock);
+    for (ring = trace_rings; ring != NULL && ring->in_use; ring = ring->next) {
+    }
+    if (ring == NULL && (ring = mem_calloc(1, sizeof(*ring))) != NULL) {
+        ring->next = trace_rings;
+        trace_rings = ring;
+    }
+    if (ring != NULL) {
+        ring->in_use = true;
+        ring->tid = trace_next_tid++;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    if (ring != NULL) {
+        pthread_setspecific(trace_key, ring);
+    }
+    return ring;
+}
+
+void trace_record(char phase, const char *name, uint64_t arg)
+{
+    struct trace_ring *ring = trace_ring;
+
+    if (ring == NULL && (ring = trace_ring = trace_thread_ring()) == NULL) {
+        return;
+    }
+    uint64_t head = ring->head;
+    struct trace_event *event = &ring->events[head % TRACE_RING_EVENTS];
+    __atomic_store_n(&event->ns, trace_now(), __ATOMIC_RELAXED);
+    __atomic_store_n(&event->name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->arg, arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->tid, ring->tid, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->phase, phase, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// writes the events of one ring that are certain not to have been overwritten while
+// they were copied
+static void trace_dump_ring(FILE *f, struct trace_ring *ring, bool *first, long pid)
+{
+    static struct trace_event copy[TRACE_RING_EVENTS];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+
+    for (uint64_t i = start; i < head; i++) {
+        const struct trace_event *e = &ring->events[i % TRACE_RING_EVENTS];
+        struct trace_event *c = &copy[i - start];
+        c->ns = __atomic_load_n(&e->ns, __ATOMIC_RELAXED);
+        c->name = __atomic_load_n(&e->name, __ATOMIC_RELAXED);
+        c->arg = __atomic_load_n(&e->arg, __ATOMIC_RELAXED);
+        c->tid = __atomic_load_n(&e->tid, __ATOMIC_RELAXED);
+        c->phase = __atomic_load_n(&e->phase, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t now = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t valid = now > TRACE_RING_EVENTS ? now - TRACE_RING_EVENTS + 1 : 0;
+
+    for (uint64_t i = start > valid ? start : valid; i < head; i++) {
+        const struct trace_event *c = &copy[i - start];
+        fprintf(f, "%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %ld, "
+                "\"tid\": %" PRIu32 ", %s\"args\": {\"arg\": %" PRIu64 "}}",
+                *first ? "" : ",", c->name, c->phase, (double)c->ns / 1e3, pid, c->tid,
+                c->phase == 'i' ? "\"s\": \"t\", " : "", c->arg);
+        *first = false;
+    }
+}
+
+bool trace_dump(int fd)
+{
+    int copy = dup(fd);
+    FILE *f = copy >= 0 ? fdopen(copy, "w") : NULL;
+    bool first = true;
+
+    if (f == NULL) {
+        if (copy >= 0) {
+            close(copy);
+        }
+        return false;
+    }
+    // the lock keeps the list of rings still, and makes dumps take turns with the one
+    // copy buffer
+    pthread_mutex_lock(&trace_lock);
+    fprintf(f, "{\"traceEvents\": [");
+    for (struct trace_ring *ring = trace_rings; ring != NULL; ring = ring->next) {
+        trace_dump_ring(f, ring, &first, (long)getpid());
+    }
+    fprintf(f, "\n], \"displayTimeUnit\": \"ns\"}\n");
+    pthread_mutex_unlock(&trace_lock);
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+// waits for SIGUSR1 and dumps the rings to the trace file each time it arrives; as the
+// signal is taken with sigwait rather than a handler, the dump can use stdio freely
+static void *trace_signal_thread(void *arg)
+{
+    sigset_t *signals = arg;
+
+    for (;;) {
+        int sig;
+        if (sigwait(signals, &sig) != 0) {
+            continue;
+        }
+        int fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            trace_dump(fd);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+bool trace_enable(const char *path)
+{
+    static sigset_t signals;
+    pthread_t thread;
+
+    if (trace_path != NULL) {
+        return true;
+    }
+    trace_path = strdup(path);
+    if (trace_path == NULL) {
+        return false;
+    }
+    // blocked here, so in every thread created from now on; the signal thread takes it
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0
+        || pthread_create(&thread, NULL, trace_signal_thread, &signals) != 0) {
+        free(trace_path);
+        trace_path = NULL;
+        return false;
+    }
+    pthread_detach(thread);
+    __atomic_store_n(&trace_active, 1, __ATOMIC_RELAXED);
+    return true;
+}